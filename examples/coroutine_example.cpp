@@ -0,0 +1,110 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file coroutine_example.cpp
+ *
+ * One coroutine per sensor, all served by a single event loop thread (C++20, see uskinCoroutine.h).
+ *
+ * Usage: ./coroutine_example [interface...] (default can0), one sensor per interface
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#include "../include/uskinCoroutine.h"
+
+#define FRAMES_PER_SENSOR 1000
+
+static int sensors_running = 0;
+
+UskinTask readSensor(UskinAsyncSensor &sensor, UskinEventLoop &loop, int number)
+{
+  if (!co_await sensor.calibrate())
+    printf("Sensor %d: calibration failed\n", number);
+
+  uskin_async_frame first = co_await sensor.next_frame();
+
+  if (first.nodes != NULL)
+    printf("Sensor %d: first frame at %lld ns\n", number, first.timestamp_ns);
+
+  UskinFrameGenerator frames = sensor.frames();
+  int frames_read = 0;
+
+  while (const uskin_async_frame *frame = co_await frames.next())
+  {
+    if (frames_read % 100 == 0)
+      printf("Sensor %d: frame %lu, node 0 z normalized %d\n", number, frame->frame_count, frame->nodes[0].z_value_normalized);
+
+    if (++frames_read == FRAMES_PER_SENSOR)
+      break;
+  }
+
+  if (--sensors_running == 0)
+    loop.stop();
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> interfaces;
+
+  for (int i = 1; i < argc; i++)
+    interfaces.push_back(argv[i]);
+
+  if (interfaces.empty())
+    interfaces.push_back("can0");
+
+  UskinEventLoop loop;
+  std::vector<UskinSensor *> sensors;
+  std::vector<UskinAsyncSensor *> async_sensors;
+  std::vector<UskinTask> tasks;
+
+  for (std::string &interface_name : interfaces)
+  {
+    UskinSensor *sensor = new UskinSensor(USKIN_COLUMNS, USKIN_ROWS, new CanDriver(interface_name));
+
+    sensor->SetAutomaticRecording(false);
+
+    if (!sensor->StartSensor())
+    {
+      printf("Problems initiating the sensor on %s\n", interface_name.c_str());
+      delete sensor;
+      continue;
+    }
+
+    sensors.push_back(sensor);
+    async_sensors.push_back(new UskinAsyncSensor(sensor, loop));
+  }
+
+  sensors_running = async_sensors.size();
+
+  for (int i = 0; i < (int)async_sensors.size(); i++)
+    tasks.push_back(readSensor(*async_sensors[i], loop, i));
+
+  if (sensors_running > 0)
+    loop.run();
+
+  for (UskinTask &task : tasks)
+    task.get();
+
+  tasks.clear(); // Coroutines go before the sensors they wait for
+
+  for (UskinAsyncSensor *async_sensor : async_sensors)
+    delete async_sensor;
+
+  for (UskinSensor *sensor : sensors)
+  {
+    sensor->StopSensor();
+    delete sensor;
+  }
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file csv_analyzer.cpp
+ *
+ * Per node statistics of CSV recordings written by UskinSensor::SaveData, and conversion to the binary form of
+ * uskinCsvAnalyzer.h. Files ending in .uskc are read as binary recordings.
+ *
+ * Usage: ./csv_analyzer [-t threads] [-o output.uskc] recording...
+ *   With several recordings and -o, output names get the recording's index appended
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "../include/uskinCanDriver.h"
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool endsWith(const std::string &text, const std::string &suffix)
+{
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char **argv)
+{
+  uskin_csv_config config;
+  std::string output;
+  std::vector<std::string> recordings;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string argument = argv[i];
+
+    if (argument == "-t" && i + 1 < argc)
+      config.threads = atoi(argv[++i]);
+    else if (argument == "-o" && i + 1 < argc)
+      output = argv[++i];
+    else
+      recordings.push_back(argument);
+  }
+
+  if (recordings.empty())
+  {
+    printf("Usage: %s [-t threads] [-o output.uskc] recording...\n", argv[0]);
+    return 1;
+  }
+
+  UskinCsvAnalyzer analyzer(config);
+  int failures = 0;
+
+  for (size_t r = 0; r < recordings.size(); r++)
+  {
+    struct stat file_status;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool binary = endsWith(recordings[r], ".uskc");
+
+    if (!(binary ? analyzer.openBinary(recordings[r]) : analyzer.openFile(recordings[r])))
+    {
+      printf("%s: could not be read\n", recordings[r].c_str());
+      failures++;
+      continue;
+    }
+
+    double load_s = secondsSince(start);
+    double file_mb = stat(recordings[r].c_str(), &file_status) == 0 ? file_status.st_size / 1e6 : 0;
+
+    printf("%s: %lu frames of %d nodes, %lu malformed rows, read in %.3f s (%.0f MB/s)\n", recordings[r].c_str(), analyzer.getNumberOfFrames(), analyzer.getNumberOfNodes(), analyzer.getMalformedRows(), load_s, file_mb / load_s);
+
+    if (analyzer.getNumberOfFrames() > 1)
+    {
+      const long long *timestamps = analyzer.getTimestamps();
+      double duration_s = (timestamps[analyzer.getNumberOfFrames() - 1] - timestamps[0]) / 1e9;
+
+      printf("  %.1f s recorded, %.1f frames per second\n", duration_s, duration_s > 0 ? (analyzer.getNumberOfFrames() - 1) / duration_s : 0);
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::vector<uskin_csv_node_statistics> statistics = analyzer.computeStatistics();
+
+    printf("  statistics in %.3f s\n", secondsSince(start));
+    printf("  %-6s %-4s %7s %7s %9s", "node", "axis", "min", "max", "mean");
+
+    for (double percentile : config.percentiles)
+      printf("  p%-5g", percentile);
+
+    printf(" %9s %8s\n", "contact", "contacts");
+
+    for (uskin_csv_node_statistics &node : statistics)
+    {
+      for (int axis = 0; axis < 3; axis++)
+      {
+        printf("  %-6x %-4c %7d %7d %9.1f", node.node_id, "xyz"[axis], node.axis[axis].min, node.axis[axis].max, node.axis[axis].mean);
+
+        for (int value : node.axis[axis].percentiles)
+          printf("  %6d", value);
+
+        if (axis == 2)
+          printf(" %8.1f%% %8lu", analyzer.getNumberOfFrames() > 0 ? 100.0 * node.contact_frames / analyzer.getNumberOfFrames() : 0, node.contacts);
+
+        printf("\n");
+      }
+    }
+
+    if (!output.empty())
+    {
+      std::string output_name = recordings.size() > 1 ? output + "." + std::to_string(r) : output;
+
+      start = std::chrono::steady_clock::now();
+
+      if (!analyzer.saveBinary(output_name))
+      {
+        printf("%s: could not be written\n", output_name.c_str());
+        failures++;
+        continue;
+      }
+
+      double output_mb = stat(output_name.c_str(), &file_status) == 0 ? file_status.st_size / 1e6 : 0;
+      double save_s = secondsSince(start);
+
+      printf("  %s: %.1f MB written in %.3f s (%.0f MB/s)\n", output_name.c_str(), output_mb, save_s, output_mb / save_s);
+    }
+  }
+
+  return failures > 0;
+}
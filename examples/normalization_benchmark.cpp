@@ -0,0 +1,175 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file normalization_benchmark.cpp
+ *
+ * Float (normalizeReading) and fixed point (normalizeReadingFixedPoint) normalization compared. First every 16 bit
+ * reading is checked, for a spread of calibration minimums, against the exact integer quotient; the fixed point
+ * path must match it everywhere (exit code 1 otherwise), and readings where the float path differs are counted.
+ * Then the time to normalize the nodes of synthetic frames is measured in both modes.
+ *
+ * Usage: ./normalization_benchmark [frames] [columns] [rows]
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <climits>
+#include <vector>
+#include <chrono>
+
+#include "../include/uskinCanDriver.h"
+
+#define BENCHMARK_MIN_READ_STEP 97 // Calibration minimums checked: every step up to the axis maximum, and the edges
+#define BENCHMARK_REPETITIONS 5    // Best of
+
+struct axis_limits
+{
+  const char *name;
+  int max_read;
+  int lower_limit;
+};
+
+static const axis_limits axes[3] = {{"x", XNODEMAXREAD, -100}, {"y", YNODEMAXREAD, -100}, {"z", ZNODEMAXREAD, 0}};
+
+// Definition of the normalized value: the quotient truncated towards zero, clamped
+static int exactReading(int value, long long min_read, int max_read, int lower_limit)
+{
+  long long range = max_read - min_read;
+  long long normalized;
+
+  if (range <= 0)
+    normalized = range < 0 || value == min_read ? 0 : (value > min_read ? 100 : lower_limit);
+  else
+    normalized = (value - min_read) * 100 / range;
+
+  return normalized < lower_limit ? lower_limit : (normalized > 100 ? 100 : normalized);
+}
+
+static bool checkExactness()
+{
+  bool exact = true;
+
+  for (const axis_limits &axis : axes)
+  {
+    std::vector<long long> min_reads;
+    unsigned long checked = 0, fixed_point_errors = 0, float_differences = 0;
+
+    for (long long min_read = 0; min_read < axis.max_read; min_read += BENCHMARK_MIN_READ_STEP)
+      min_reads.push_back(min_read);
+
+    for (long long min_read : {axis.max_read - 1, axis.max_read, axis.max_read + 1, 65535})
+      min_reads.push_back(min_read);
+
+    for (long long min_read : min_reads)
+    {
+      uskin_fixed_point_scale scale = fixedPointScale(min_read, axis.max_read);
+
+      for (int value = 0; value <= USHRT_MAX; value++, checked++)
+      {
+        int expected = exactReading(value, min_read, axis.max_read, axis.lower_limit);
+
+        if (normalizeReadingFixedPoint(value, scale, axis.lower_limit) != expected)
+        {
+          if (fixed_point_errors++ < 5)
+            printf("  %s: fixed point %d instead of %d for reading %d, minimum %lld\n", axis.name, normalizeReadingFixedPoint(value, scale, axis.lower_limit), expected, value, min_read);
+        }
+
+        // Minimum equal to the maximum: the float path divides by zero
+        if (min_read != axis.max_read && normalizeReading(value, min_read, axis.max_read, axis.lower_limit) != expected)
+          float_differences++;
+      }
+    }
+
+    printf("%s: %lu readings checked, %lu fixed point errors, float path differs on %lu\n", axis.name, checked, fixed_point_errors, float_differences);
+
+    exact = exact && fixed_point_errors == 0;
+  }
+
+  return exact;
+}
+
+int main(int argc, char **argv)
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 200000;
+  int columns = argc > 2 ? atoi(argv[2]) : USKIN_COLUMNS;
+  int rows = argc > 3 ? atoi(argv[3]) : USKIN_ROWS;
+  int nodes = columns * rows;
+
+  bool exact = checkExactness();
+
+  // Synthetic frames: calibration minimums around a rest value, readings spread around it
+  std::vector<_uskin_node_time_unit_reading> readings(nodes * 64);
+  std::vector<unsigned long int> min_storage(nodes * 3);
+  std::vector<unsigned long int *> min_reads(nodes);
+  std::vector<uskin_fixed_point_scale> scales(nodes * 3);
+
+  srand(1);
+
+  for (int i = 0; i < nodes; i++)
+  {
+    min_reads[i] = &min_storage[3 * i];
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+      min_reads[i][axis] = (axes[axis].max_read * 2 / 3) + rand() % 1000;
+      scales[3 * i + axis] = fixedPointScale(min_reads[i][axis], axes[axis].max_read);
+    }
+  }
+
+  for (size_t r = 0; r < readings.size(); r++)
+  {
+    readings[r].clear();
+    readings[r].x_value = min_reads[r % nodes][0] - 2000 + rand() % 20000;
+    readings[r].y_value = min_reads[r % nodes][1] - 2000 + rand() % 12000;
+    readings[r].z_value = min_reads[r % nodes][2] - 500 + rand() % 12000;
+  }
+
+  double best_ns[2] = {1e30, 1e30};
+  long long checksum[2] = {0, 0};
+
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++)
+  {
+    for (int mode = 0; mode < 2; mode++)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      long long sum = 0;
+
+      for (int frame = 0; frame < frames; frame++)
+      {
+        _uskin_node_time_unit_reading *nodes_of_frame = &readings[(frame % 64) * nodes];
+
+        for (int i = 0; i < nodes; i++)
+        {
+          if (mode == USKIN_NORMALIZATION_FIXED_POINT)
+            nodes_of_frame[i].normalizeFixedPoint(&scales[3 * i]);
+          else
+            nodes_of_frame[i].normalize(min_reads[i]);
+
+          sum += nodes_of_frame[i].x_value_normalized + nodes_of_frame[i].y_value_normalized + nodes_of_frame[i].z_value_normalized;
+        }
+      }
+
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ((double)frames * nodes);
+
+      best_ns[mode] = std::min(best_ns[mode], ns);
+      checksum[mode] = sum;
+    }
+  }
+
+  printf("%d frames of %d nodes\n", frames, nodes);
+  printf("  float:       %6.2f ns per node (checksum %lld)\n", best_ns[USKIN_NORMALIZATION_FLOAT], checksum[USKIN_NORMALIZATION_FLOAT]);
+  printf("  fixed point: %6.2f ns per node (checksum %lld), %.2fx\n", best_ns[USKIN_NORMALIZATION_FIXED_POINT], checksum[USKIN_NORMALIZATION_FIXED_POINT], best_ns[USKIN_NORMALIZATION_FLOAT] / best_ns[USKIN_NORMALIZATION_FIXED_POINT]);
+
+  if (!exact)
+    printf("FAILED: fixed point normalization is not exact\n");
+
+  return exact ? 0 : 1;
+}
@@ -0,0 +1,585 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file soak_test.cpp
+ *
+ * Long run stability test. A UskinSensor with every processing stage enabled is fed from a simulated bus (dropped,
+ * reordered, foreign and truncated messages, and missing frames) for hours of simulated time, as fast as it can
+ * process them. Every report interval the frame throughput, the latency percentiles of retrieving and normalizing a
+ * frame, the resident set size and the number of live heap allocations are printed. The test fails (exit code 1)
+ * when, compared to the end of the first interval, allocations or memory grow, or throughput or latency regress.
+ *
+ * Usage: ./soak_test [hours] [report_minutes] [columns] [rows] [error_percent] [seed]
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "../include/uskinCanDriver.h"
+
+#define SOAK_FRAME_RATE 1000 // Simulated frames per second
+
+// Failure thresholds, relative to the end of the first interval
+#define SOAK_ALLOCATION_SLACK 64      // Live allocations
+#define SOAK_RSS_SLACK_KB 1024        // Resident set size
+#define SOAK_THROUGHPUT_RATIO 0.5     // Lowest share of the first interval's frames per second
+#define SOAK_LATENCY_RATIO 3.0        // Highest multiple of the first interval's 99th percentile...
+#define SOAK_LATENCY_SLACK_NS 20000   // ...that is also this much above it (scheduling noise on short latencies)
+
+//###################### Allocation counting #########################
+// Every operator new / delete of the process goes through these, so live allocations can be compared over time
+
+static std::atomic<long> live_allocations(0);
+static std::atomic<unsigned long> total_allocations(0);
+
+static void *countedAllocation(size_t size)
+{
+  void *memory = malloc(size > 0 ? size : 1);
+
+  if (memory != NULL)
+  {
+    live_allocations++;
+    total_allocations++;
+  }
+
+  return memory;
+}
+
+static void countedRelease(void *memory)
+{
+  if (memory == NULL)
+    return;
+
+  live_allocations--;
+  free(memory);
+}
+
+void *operator new(size_t size)
+{
+  void *memory = countedAllocation(size);
+
+  if (memory == NULL)
+    throw std::bad_alloc();
+
+  return memory;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return countedAllocation(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return countedAllocation(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+  countedRelease(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+  countedRelease(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+  countedRelease(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+  countedRelease(memory);
+}
+
+//###################### Utils #########################
+
+static long residentSetKb()
+{
+  long pages = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+
+  if (statm == NULL)
+    return 0;
+
+  if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+    resident = 0;
+
+  fclose(statm);
+
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Xorshift, so the simulated bus does not allocate and a seed gives the same run
+static unsigned int nextRandom(unsigned int *state)
+{
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return *state = x;
+}
+
+//###################### SimulatedCanDriver #########################
+// CanDriver whose socket is one end of a local socket pair. Each readData call puts the messages of the next frame
+// on the other end, with the configured errors injected, and then reads them through the regular CanDriver::readData
+// path. Frames are timestamped with the simulated time at SOAK_FRAME_RATE
+
+struct soak_bus_errors
+{
+  unsigned long dropped = 0;   // Messages never sent
+  unsigned long reordered = 0; // Messages swapped with the next one
+  unsigned long foreign = 0;   // Messages with an ID outside of the sensor
+  unsigned long truncated = 0; // Messages shorter than a CAN frame
+  unsigned long missing = 0;   // Frames never sent
+};
+
+class SimulatedCanDriver : public CanDriver
+{
+private:
+  const int columns;
+  const int rows;
+  const int error_permille;
+  unsigned int random_state;
+
+  int bus = -1; // Sending end of the socket pair
+  long long simulated_ns;
+
+  std::vector<can_frame> messages;
+
+  soak_bus_errors errors;
+
+  canid_t nodeCanID(int index)
+  {
+    // Decimal ID 1RC (see UskinSensor::convertIndextoCanID), as hex digits
+    return 0x100 | (index % rows) << 4 | (index / rows);
+  }
+
+  bool injectError()
+  {
+    return error_permille > 0 && (int)(nextRandom(&random_state) % 1000) < error_permille;
+  }
+
+  void encode(can_frame *message, canid_t can_id, unsigned int x, unsigned int y, unsigned int z)
+  {
+    memset(message, 0, sizeof(can_frame));
+    message->can_id = can_id;
+    message->can_dlc = 8;
+    message->data[1] = x >> 8;
+    message->data[2] = x & 0xff;
+    message->data[3] = y >> 8;
+    message->data[4] = y & 0xff;
+    message->data[5] = z >> 8;
+    message->data[6] = z & 0xff;
+  }
+
+  // Slow drift on x / y, presses on z moving along the sensor, a vibration burst every 30 s on x / y (slip), one
+  // node that never changes and one that saturates for half of the time (health monitor)
+  void buildFrame()
+  {
+    const int nodes = columns * rows;
+    const double t = simulated_ns / 1e9;
+    const double burst = fmod(t, 30.0) < 0.5 ? 2000 * sin(2 * M_PI * 200 * t) : 0;
+    const int pressed = (int)(t / 2) % nodes;
+
+    messages.resize(nodes);
+
+    for (int i = 0; i < nodes; i++)
+    {
+      unsigned int noise = nextRandom(&random_state);
+      double press = i == pressed ? 6000 * fabs(sin(M_PI * t / 2)) : 0;
+
+      int x = 22000 + 300 * sin(M_PI * t + i) + burst + (int)(noise % 31) - 15;
+      int y = 12000 + 300 * cos(M_PI * t + i) + burst + (int)(noise >> 8 & 31) - 15;
+      int z = 12000 + press + (int)(noise >> 16 & 31) - 15;
+
+      if (i == 0)
+      {
+        x = 22000;
+        y = 12000;
+        z = 12000;
+      }
+
+      if (i == nodes - 1 && fabs(sin(M_PI * t / 2)) > 0.5)
+        z = ZNODEMAXREAD;
+
+      encode(&messages[i], nodeCanID(i), x, y, z);
+    }
+  }
+
+  void sendFrame()
+  {
+    buildFrame();
+
+    if (injectError())
+    {
+      errors.missing++;
+      return;
+    }
+
+    for (int i = 0; i < (int)messages.size(); i++)
+    {
+      if (injectError())
+      {
+        errors.dropped++;
+        continue;
+      }
+
+      if (i + 1 < (int)messages.size() && injectError())
+      {
+        std::swap(messages[i], messages[i + 1]);
+        errors.reordered++;
+      }
+
+      if (injectError())
+      {
+        can_frame foreign;
+
+        encode(&foreign, 0x199, 0, 0, 0);
+        send(bus, &foreign, sizeof(foreign), MSG_DONTWAIT);
+        errors.foreign++;
+      }
+
+      size_t length = sizeof(can_frame);
+
+      if (injectError())
+      {
+        length = 4;
+        errors.truncated++;
+      }
+
+      send(bus, &messages[i], length, MSG_DONTWAIT);
+    }
+  }
+
+public:
+  SimulatedCanDriver(int columns, int rows, int error_permille, unsigned int seed) : columns(columns), rows(rows), error_permille(error_permille), random_state(seed != 0 ? seed : 1)
+  {
+    simulated_ns = 1700000000LL * 1000000000LL;
+  }
+
+  ~SimulatedCanDriver()
+  {
+    if (bus >= 0)
+      close(bus);
+  }
+
+  int openConnection()
+  {
+    int pair[2];
+
+    if (s >= 0)
+      close(s);
+    if (bus >= 0)
+      close(bus);
+
+    s = bus = -1;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) < 0)
+      return 0;
+
+    // Receiving end non blocking: a frame with missing messages ends in a read error instead of waiting forever
+    fcntl(pair[0], F_SETFL, O_NONBLOCK);
+
+    s = pair[0];
+    bus = pair[1];
+
+    return 1;
+  }
+
+  int requestData()
+  {
+    setDataRequested(s >= 0);
+
+    return s >= 0;
+  }
+
+  void stopData()
+  {
+    setDataRequested(false);
+  }
+
+  int readData(can_frame **receiving_frame, int frame_size, int max_can_ID)
+  {
+    struct pollfd pending = {s, POLLIN, 0};
+
+    // Messages left over after an error are read first, as they would be on a bus
+    if (data_requested && poll(&pending, 1, 0) == 0)
+      sendFrame();
+
+    int retrieved = CanDriver::readData(receiving_frame, frame_size, max_can_ID);
+
+    simulated_ns += 1000000000LL / SOAK_FRAME_RATE;
+    last_frame_timestamp.tv_sec = simulated_ns / 1000000000LL;
+    last_frame_timestamp.tv_nsec = simulated_ns % 1000000000LL;
+
+    return retrieved;
+  }
+
+  soak_bus_errors getErrors()
+  {
+    return errors;
+  }
+};
+
+//###################### Soak test #########################
+
+struct soak_interval
+{
+  unsigned long frames;
+  double frames_per_second;
+  long long p50_ns, p99_ns, p999_ns;
+  long rss_kb;
+  long live_allocations;
+};
+
+static std::atomic<bool> consumer_running(false);
+static std::atomic<unsigned long> decimated_frames(0);
+static std::atomic<unsigned long> slip_events(0);
+
+// Subscriber of a decimated stream, as a slower consumer (e.g. a GUI) would be
+static void consumeDecimated(UskinDecimatedStream *stream, int nodes)
+{
+  std::vector<_uskin_node_time_unit_reading> block(nodes);
+
+  while (consumer_running)
+  {
+    if (stream->wait(100) && stream->read(block.data()))
+      decimated_frames++;
+  }
+}
+
+// A second sensor created, used and destroyed, so per sensor allocations that are not released show up as growth
+static void churnSensor(int columns, int rows, int error_permille, unsigned int seed)
+{
+  UskinSensor *sensor = new UskinSensor(columns, rows, new SimulatedCanDriver(columns, rows, error_permille, seed));
+  uskin_filter_config filter;
+
+  filter.type = USKIN_FILTER_BIQUAD_LOWPASS;
+
+  sensor->SetAutomaticRecording(false);
+  sensor->EnableFrameHistory(64);
+  sensor->EnableHealthMonitor();
+  for (int axis = 0; axis < 3; axis++)
+    sensor->SetFilter(axis, filter);
+  sensor->SubscribeDecimated(100, USKIN_DECIMATION_MAX_HOLD);
+  sensor->EnableTactileImage(8, 8);
+
+  if (sensor->StartSensor())
+  {
+    sensor->CalibrateSensor();
+
+    for (int i = 0; i < 200; i++)
+    {
+      sensor->RetrieveFrameData();
+      sensor->NormalizeData();
+    }
+
+    sensor->StopSensor();
+  }
+
+  delete sensor;
+}
+
+static long long percentile(std::vector<long long> &latencies, double fraction)
+{
+  if (latencies.empty())
+    return 0;
+
+  std::vector<long long>::iterator position = latencies.begin() + (size_t)(fraction * (latencies.size() - 1));
+
+  std::nth_element(latencies.begin(), position, latencies.end());
+
+  return *position;
+}
+
+int main(int argc, char **argv)
+{
+  double hours = argc > 1 ? atof(argv[1]) : 2;
+  double report_minutes = argc > 2 ? atof(argv[2]) : std::min(10.0, hours * 30); // Default: 10, or half of shorter runs
+  int columns = argc > 3 ? atoi(argv[3]) : USKIN_COLUMNS;
+  int rows = argc > 4 ? atoi(argv[4]) : USKIN_ROWS;
+  int error_permille = argc > 5 ? (int)(atof(argv[5]) * 10) : 5; // Per message / frame, default 0.5 %
+  unsigned int seed = argc > 6 ? strtoul(argv[6], NULL, 10) : 1;
+
+  // At least two intervals are needed to compare against the first one
+  if (hours <= 0 || report_minutes <= 0 || 2 * report_minutes > hours * 60 || columns <= 0 || columns > 9 || rows <= 0 || rows > 9)
+  {
+    printf("Usage: %s [hours] [report_minutes (at most half the run)] [columns (1-9)] [rows (1-9)] [error_percent] [seed]\n", argv[0]);
+    return 2;
+  }
+
+  // The run lasts the hours requested: the report interval is adjusted to divide it evenly
+  const int intervals = std::max(2, (int)round(hours * 60 / report_minutes));
+  report_minutes = hours * 60 / intervals;
+
+  const unsigned long frames_per_interval = (unsigned long)(report_minutes * 60 * SOAK_FRAME_RATE);
+  const unsigned long calibration_period = 5 * 60 * SOAK_FRAME_RATE; // Recalibrate every 5 simulated minutes
+
+  SimulatedCanDriver *driver = new SimulatedCanDriver(columns, rows, error_permille, seed);
+  UskinSensor *sensor = new UskinSensor(columns, rows, driver);
+  const int nodes = sensor->GetUskinFrameSize();
+
+  uskin_filter_config filter;
+  filter.type = USKIN_FILTER_IIR;
+
+  uskin_slip_config slip;
+  slip.sample_frequency = SOAK_FRAME_RATE;
+
+  sensor->SetAutomaticRecording(false);
+  for (int axis = 0; axis < 3; axis++)
+    sensor->SetFilter(axis, filter);
+  sensor->EnableFrameHistory(256);
+  sensor->EnableHealthMonitor();
+  sensor->EnableSlipDetection(slip, [](const uskin_slip_event &) { slip_events++; });
+  sensor->EnableTactileImage(16, 16);
+  UskinDecimatedStream *stream = sensor->SubscribeDecimated(30);
+
+  if (!sensor->StartSensor())
+  {
+    printf("Problems starting the simulated sensor\n");
+    delete sensor;
+    return 2;
+  }
+
+  sensor->CalibrateSensor();
+
+  consumer_running = true;
+  std::thread consumer(consumeDecimated, stream, nodes);
+
+  // Everything the loop needs is allocated up front, so it does not count as growth
+  std::vector<long long> latencies;
+  latencies.reserve(frames_per_interval);
+  std::vector<_uskin_node_time_unit_reading> frame_copy(nodes);
+  std::vector<int> queued_raw(16 * nodes * 3);
+  std::vector<long long> queued_timestamps(16);
+  std::vector<soak_interval> results;
+  results.reserve(intervals);
+  std::future<bool> calibration;
+
+  unsigned long long next_queued_frame = 0, dropped_queued_frames = 0;
+  unsigned long frame = 0;
+  bool failed = false;
+
+  printf("Soak test: %d x %d nodes, %.1f simulated hours at %d Hz, %.1f %% errors, seed %u\n", columns, rows, intervals * report_minutes / 60, SOAK_FRAME_RATE, error_permille / 10.0, seed);
+  printf("%8s %10s %10s %9s %9s %9s %9s %10s %12s\n", "minutes", "frames", "fps", "p50 us", "p99 us", "p99.9 us", "rss kB", "live alloc", "allocations");
+
+  for (int interval = 0; interval < intervals; interval++)
+  {
+    latencies.clear();
+
+    const long long interval_start = monotonicNow();
+
+    for (unsigned long i = 0; i < frames_per_interval; i++, frame++)
+    {
+      const long long start = monotonicNow();
+
+      sensor->RetrieveFrameData();
+      sensor->NormalizeData();
+      sensor->GetNodeData_xyzValues(frame % nodes);
+
+      latencies.push_back(monotonicNow() - start);
+
+      if (frame % 100 == 0)
+      {
+        sensor->CopyFrame(frame_copy.data(), NULL);
+        sensor->CopyQueuedFrames(&next_queued_frame, 16, queued_raw.data(), NULL, queued_timestamps.data(), &dropped_queued_frames);
+
+        if (calibration.valid() && calibration.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+          calibration.get();
+      }
+
+      if (frame % calibration_period == calibration_period - 1)
+        calibration = sensor->CalibrateSensorAsync(20);
+    }
+
+    const double elapsed = (monotonicNow() - interval_start) / 1e9;
+
+    churnSensor(columns, rows, error_permille, seed + interval + 1);
+
+    soak_interval result;
+    result.frames = frames_per_interval;
+    result.frames_per_second = frames_per_interval / elapsed;
+    result.p50_ns = percentile(latencies, 0.5);
+    result.p99_ns = percentile(latencies, 0.99);
+    result.p999_ns = percentile(latencies, 0.999);
+    result.rss_kb = residentSetKb();
+    result.live_allocations = live_allocations;
+    results.push_back(result);
+
+    printf("%8.1f %10lu %10.0f %9.1f %9.1f %9.1f %9ld %10ld %12lu\n", (interval + 1) * report_minutes, frame, result.frames_per_second, result.p50_ns / 1e3, result.p99_ns / 1e3, result.p999_ns / 1e3, result.rss_kb, result.live_allocations, (unsigned long)total_allocations);
+    fflush(stdout);
+
+    // The first interval is the baseline: caches, the history and the allocator have settled by its end
+    if (interval == 0)
+      continue;
+
+    const soak_interval &baseline = results[0];
+
+    if (result.live_allocations > baseline.live_allocations + SOAK_ALLOCATION_SLACK)
+    {
+      printf("FAIL: live allocations grew from %ld to %ld\n", baseline.live_allocations, result.live_allocations);
+      failed = true;
+    }
+
+    if (result.rss_kb > baseline.rss_kb + SOAK_RSS_SLACK_KB)
+    {
+      printf("FAIL: resident set grew from %ld kB to %ld kB\n", baseline.rss_kb, result.rss_kb);
+      failed = true;
+    }
+
+    if (result.frames_per_second < baseline.frames_per_second * SOAK_THROUGHPUT_RATIO)
+    {
+      printf("FAIL: throughput dropped from %.0f to %.0f frames/s\n", baseline.frames_per_second, result.frames_per_second);
+      failed = true;
+    }
+
+    if (result.p99_ns > baseline.p99_ns * SOAK_LATENCY_RATIO && result.p99_ns > baseline.p99_ns + SOAK_LATENCY_SLACK_NS)
+    {
+      printf("FAIL: 99th percentile latency rose from %.1f us to %.1f us\n", baseline.p99_ns / 1e3, result.p99_ns / 1e3);
+      failed = true;
+    }
+
+    if (failed)
+      break;
+  }
+
+  consumer_running = false;
+  consumer.join();
+
+  soak_bus_errors errors = driver->getErrors();
+
+  printf("Injected: %lu dropped, %lu reordered, %lu foreign, %lu truncated messages, %lu missing frames\n", errors.dropped, errors.reordered, errors.foreign, errors.truncated, errors.missing);
+  printf("Decimated frames read: %lu, slip events: %lu, history frames dropped: %llu\n", (unsigned long)decimated_frames, (unsigned long)slip_events, dropped_queued_frames);
+
+  sensor->StopSensor();
+  delete sensor;
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+
+  return failed ? 1 : 0;
+}
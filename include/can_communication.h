@@ -18,6 +18,7 @@
 #include <iostream>
 #include <sstream>
 #include <cstdio>
+#include <vector>
 
 #include <unistd.h>
 #include <string.h>
@@ -29,8 +30,20 @@
 #include <sys/time.h>
 #include <sys/types.h>
 
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <linux/sockios.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include "candumpLog.h"
+#include "uskinProbes.h"
 
 #define DEBUG 0
 
@@ -46,13 +59,15 @@ unsigned long convert_dec_to_24bit_hex(unsigned int data);
 
 std::string canFrameToString(can_frame *message);
 
+bool checkMessagesIdOrder(canid_t current_can_id, canid_t previous_can_id);
+
 //###################### CanDriver #########################
 
 class CanDriver
 {
-    // Access specifier
-private:
-    int s;
+    // Access specifier (protected, so other frame sources can be derived from CanDriver)
+protected:
+    int s = -1;
     struct sockaddr_can addr;
     struct ifreq ifr;
 
@@ -67,23 +82,74 @@ private:
     can_frame temporary_reading;
     bool temporary_reading_available = false;
 
+    // Messages of the frame pollData is assembling
+    std::vector<can_frame> pending_messages;
+
+    // Kernel timestamp of the last CAN frame read
+    struct timespec last_frame_timestamp = {0, 0};
+
+    // Copy of all received traffic in candump log format (NULL if not recording)
+    CandumpWriter *candump_writer = NULL;
+
+    // PACKET_MMAP (TPACKET_V3) receive ring. When enabled, frames are read from the ring instead of recvfrom
+    bool mmap_receive_enabled = false;
+    int packet_socket = -1;
+    struct tpacket_req3 ring_request;
+    __u8 *ring_buffer = NULL;
+    unsigned int ring_current_block = 0;
+    bool ring_block_in_use = false;
+    struct tpacket3_hdr *ring_current_frame = NULL;
+    unsigned int ring_frames_left = 0;
+
+    int openReceiveRing();
+    void closeReceiveRing();
+    int readMessageFromRing(can_frame *receiving_frame, bool wait = true);
+
     int sendMessage(can_frame sending_frame);
-    int readMessage(can_frame *receiving_frame);
+    // With wait false, returns 0 with errno EAGAIN when no message is available
+    int readMessage(can_frame *receiving_frame, bool wait = true);
 
 public:
     CanDriver();
     CanDriver(std::string new_network);
     CanDriver(std::string new_network, __u32 new_device_id);
     CanDriver(__u32 new_device_id);
-    ~CanDriver();
+    virtual ~CanDriver();
+
+    // Must be called before openConnection(). block_size must be a multiple of the page size
+    void enableMmapReceive(unsigned int block_size = 1 << 16, unsigned int block_number = 32, unsigned int block_timeout_ms = 1);
+
+    virtual int openConnection();
+    virtual void closeConnection(); // Done by openConnection and the destructor otherwise
+
+    virtual int requestData();
+
+    virtual void stopData();
+
+    virtual int readData(can_frame **receiving_frame, int frame_size, int max_can_ID);
+
+    // Non-blocking readData: reads the messages available and returns the number of messages of the frame once it is
+    // complete (as readData would have), 0 while it is not (the messages read are kept for the next call), or -1 on
+    // errors. Meant to be called when getReceiveDescriptor() is readable (see UskinEventLoop)
+    virtual int pollData(can_frame **receiving_frame, int frame_size, int max_can_ID);
 
-    int openConnection();
+    // True once the driver will deliver no more frames (e.g. the end of a replay). A bus never finishes
+    virtual bool isFinished();
 
-    int requestData();
+    struct timespec getLastFrameTimestamp();
 
-    void stopData();
+    // Access for callers sending the start / stop requests of several devices at once (see UskinSensorGroup).
+    // getDataRequestFrame builds the frame requestData (start) or stopData (!start) would send; once it has been
+    // sent by other means, setDataRequested records the new state as those methods do
+    can_frame getDataRequestFrame(bool start);
+    void setDataRequested(bool requested);
+    std::string getInterfaceName();
+    int getSocket(); // -1 if the driver has no CAN socket open (e.g. replay)
+    int getReceiveDescriptor(); // Descriptor to poll for incoming frames (the ring's socket when mmap receive is enabled)
 
-    int readData(can_frame **receiving_frame, int frame_size, int max_can_ID);
+    // Record every frame received in a 'candump -l' compatible log
+    int startCandumpLog(std::string file_name);
+    void stopCandumpLog();
 
     //can_frame ** readData(int number_of_filters, struct can_filter *rfilter); // This method will allow to filter incoming data
 };
@@ -0,0 +1,90 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file candumpLog.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef CANDUMPLOG_H
+#define CANDUMPLOG_H
+
+#include <string>
+#include <cstdio>
+#include <time.h>
+
+#include <linux/can.h>
+
+// Output buffer of CandumpWriter
+#define CANDUMP_WRITE_BUFFER_SIZE (1 << 16)
+
+//###################### Utils #########################
+
+// Decode 2 * number_of_bytes hex characters. Returns number of bytes decoded (stops at the first non hex character)
+int decodeHexPayload(const char *text, __u8 *data, int number_of_bytes);
+
+//###################### CandumpReader #########################
+// Memory mapped reader of raw CAN captures. Understands can-utils 'candump -l' logs
+//   (1436509052.249713) can0 100#0011223344556677
+// and Vector ASC style lines
+//   1.234567 1  100             Rx   d 8 00 11 22 33 44 55 66 77
+// Lines that are not classic CAN data frames (headers, CAN FD, error frames) are skipped
+class CandumpReader
+{
+private:
+  int file_descriptor = -1;
+
+  const char *file_data = NULL;
+  size_t file_size = 0;
+  size_t position = 0;
+
+  unsigned long lines_skipped = 0;
+
+  bool parseLogLine(const char *line, const char *line_end, can_frame *frame, struct timespec *timestamp);
+  bool parseASCLine(const char *line, const char *line_end, can_frame *frame, struct timespec *timestamp);
+
+public:
+  CandumpReader();
+  ~CandumpReader();
+
+  int openFile(std::string file_name);
+  void closeFile();
+
+  // Next CAN frame of the capture. Returns 0 at the end of the file
+  int readFrame(can_frame *frame, struct timespec *timestamp);
+
+  void rewind();
+
+  unsigned long getLinesSkipped();
+};
+
+//###################### CandumpWriter #########################
+// Writes CAN frames in 'candump -l' format, so captures can be read back with CandumpReader or can-utils
+class CandumpWriter
+{
+private:
+  FILE *file = NULL;
+
+  std::string interface_name;
+
+  char *file_buffer = NULL;
+
+public:
+  CandumpWriter();
+  ~CandumpWriter();
+
+  int openFile(std::string file_name, std::string new_interface_name);
+  void closeFile();
+
+  bool isOpen();
+
+  void writeFrame(const can_frame *frame, const struct timespec *timestamp);
+};
+
+#endif
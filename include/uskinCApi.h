@@ -0,0 +1,74 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinCApi.h
+ *
+ * C interface of UskinSensor, for C, Rust, LabVIEW and other foreign runtimes.
+ * Frame data is always copied into buffers owned by the caller, so nothing returned by
+ * this API is invalidated by later reads. Frame buffers hold frame_size * 3 values
+ * per frame (x, y, z of every node, in node index order).
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINCAPI_H
+#define USKINCAPI_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef struct uskin_sensor uskin_sensor;
+
+  // history_frames is the number of frames that can be queued for uskin_read_frames (0 disables it)
+  uskin_sensor *uskin_create(int columns, int rows, const char *interface_name, uint32_t device_id, int history_frames);
+
+  // Sensor replaying a recording (CSV or candump capture). speed: 0 as fast as possible, 1 recorded speed, otherwise scaled
+  uskin_sensor *uskin_create_replay(int columns, int rows, const char *recording, double speed, int history_frames);
+
+  void uskin_destroy(uskin_sensor *sensor);
+
+  // Functions returning int return 1 on success and 0 on failure, unless stated otherwise
+  int uskin_start(uskin_sensor *sensor);
+  int uskin_stop(uskin_sensor *sensor);
+
+  // Blocking calibration. Sensor must be at rest. duration_ms > 0 calibrates for a period of time instead of a number of frames
+  int uskin_calibrate(uskin_sensor *sensor, int frames, long duration_ms);
+  int uskin_is_calibrated(uskin_sensor *sensor);
+
+  // Normalize with integer arithmetic only if fixed_point != 0 (for hosts without a fast FPU), in floating point otherwise (default)
+  int uskin_set_fixed_point_normalization(uskin_sensor *sensor, int fixed_point);
+
+  // Retrieve frames continuously on a native thread, normalizing them if normalize != 0
+  int uskin_start_acquisition(uskin_sensor *sensor, int normalize);
+  int uskin_stop_acquisition(uskin_sensor *sensor);
+
+  int uskin_frame_size(uskin_sensor *sensor);
+
+  // Latest frame. Without the acquisition thread a new frame is read first (blocking).
+  // Any output pointer may be NULL. raw and normalized hold frame_size * 3 values
+  int uskin_read_frame(uskin_sensor *sensor, int32_t *raw, int32_t *normalized, int64_t *timestamp_ns);
+
+  // Up to max_frames frames retrieved since the previous call, oldest first. raw and normalized hold
+  // max_frames * frame_size * 3 values, timestamps max_frames values; any of them may be NULL.
+  // Frames lost because the history wrapped around are reported in dropped_frames (may be NULL).
+  // Returns the number of frames written, -1 on error
+  int uskin_read_frames(uskin_sensor *sensor, int max_frames, int32_t *raw, int32_t *normalized, int64_t *timestamps, uint64_t *dropped_frames);
+
+  // Minimum readings of the current calibration (frame_size * 3 values)
+  int uskin_get_calibration(uskin_sensor *sensor, uint32_t *min_readings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,8 +23,27 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <thread>
+#include <condition_variable>
 
 #include "can_communication.h" // Our library for can communication
+#include "uskinFilters.h"
+#include "uskinFrameHistory.h"
+#include "uskinContactFeatures.h"
+#include "uskinSlipDetection.h"
+#include "uskinTactileImage.h"
+#include "uskinForceCalibration.h"
+#include "uskinSensorGroup.h"
+#include "uskinHealthMonitor.h"
+#include "uskinDecimation.h"
+#include "uskinEventLoop.h"
+#include "uskinDiscovery.h"
+#include "uskinStream.h"
+#include "uskinCsvAnalyzer.h"
 
 // Default for 4x6 uSkin version
 #define USKIN_ROWS 4
@@ -37,14 +56,90 @@
 
 //#define ZNODEMINREAD 18300 // not used
 
-static unsigned long int **frame_min_reads;
-static int frame_min_reads_size = 0;
+// Longest wait of the acquisition thread between reads that returned no data
+#define USKIN_ACQUISITION_MAX_BACKOFF_MS 100
+
+// Minimum readings from calibration are kept per sensor (UskinSensor::getCalibrationValues)
 // static unsigned long int **frame_max_reads;
 
 //###################### Utils #########################
 
 void open_log_file(std::string file_name);
 
+// Current CLOCK_MONOTONIC time in nanoseconds
+inline long long monotonicNow()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// MinMax normalization of a single reading, clamped to [lower_limit, 100]
+inline int normalizeReading(int value, unsigned long int min_read, int max_read, int lower_limit)
+{
+  int normalized = (((float)value - min_read) / (max_read - min_read)) * 100;
+
+  return normalized < lower_limit ? lower_limit : (normalized > 100 ? 100 : normalized);
+}
+
+// Fractional bits of uskin_fixed_point_scale::factor. Exact for ranges below 2^(USKIN_FIXED_POINT_SHIFT / 2)
+#define USKIN_FIXED_POINT_SHIFT 40
+
+enum uskin_normalization_mode
+{
+  USKIN_NORMALIZATION_FLOAT,      // normalizeReading
+  USKIN_NORMALIZATION_FIXED_POINT // normalizeReadingFixedPoint, integer only
+};
+
+// Per node and axis constants of normalizeReadingFixedPoint, computed once per calibration
+struct uskin_fixed_point_scale
+{
+  long long min_read;
+  long long range;           // max_read - min_read
+  unsigned long long factor; // ceil(100 * 2^USKIN_FIXED_POINT_SHIFT / range)
+};
+
+inline uskin_fixed_point_scale fixedPointScale(unsigned long int min_read, int max_read)
+{
+  uskin_fixed_point_scale scale;
+
+  scale.min_read = min_read;
+  scale.range = max_read - scale.min_read;
+  scale.factor = scale.range > 0 ? ((100ULL << USKIN_FIXED_POINT_SHIFT) + scale.range - 1) / scale.range : 0;
+
+  return scale;
+}
+
+// normalizeReading in integer arithmetic: the exact quotient truncated towards zero, clamped the same way, so results
+// are identical on every platform. They differ from normalizeReading only where its float rounding falls just short
+// of a whole percentage (e.g. 52 for 53), see examples/normalization_benchmark.cpp. A range of zero gives the limit
+// on the side of the reading, and a negative range (minimum above max_read) gives 0
+inline int normalizeReadingFixedPoint(int value, const uskin_fixed_point_scale &scale, int lower_limit)
+{
+  long long offset = value - scale.min_read;
+  long long magnitude = offset < 0 ? -offset : offset;
+  long long normalized;
+
+  if (scale.range <= 0)
+    normalized = scale.range < 0 || offset == 0 ? 0 : (offset > 0 ? 100 : lower_limit);
+  else if (magnitude >= scale.range) // Beyond the limits, whatever the sign
+    normalized = offset < 0 ? -100 : 100;
+  else
+  {
+    if (scale.range < 1LL << (USKIN_FIXED_POINT_SHIFT / 2))
+      normalized = (long long)((unsigned long long)magnitude * scale.factor >> USKIN_FIXED_POINT_SHIFT);
+    else
+      normalized = magnitude * 100 / scale.range;
+
+    if (offset < 0)
+      normalized = -normalized;
+  }
+
+  return normalized < lower_limit ? lower_limit : (normalized > 100 ? 100 : normalized);
+}
+
 //###################### Data Structures #########################
 struct _uskin_node_time_unit_reading
 {
@@ -56,6 +151,13 @@ struct _uskin_node_time_unit_reading
   int x_value_normalized;
   int y_value_normalized;
   int z_value_normalized;
+  float x_value_filtered;
+  float y_value_filtered;
+  float z_value_filtered;
+  float x_force; // Newtons, when a force calibration has been loaded (see UskinSensor::LoadForceCalibration)
+  float y_force;
+  float z_force;
+  unsigned int health_flags; // uskin_health_flag bits, when a health monitor is enabled (see UskinSensor::EnableHealthMonitor)
 
   void clear()
   {
@@ -66,28 +168,44 @@ struct _uskin_node_time_unit_reading
     x_value_normalized = 0;
     y_value_normalized = 0;
     z_value_normalized = 0;
+    x_value_filtered = 0;
+    y_value_filtered = 0;
+    z_value_filtered = 0;
+    x_force = 0;
+    y_force = 0;
+    z_force = 0;
+    health_flags = 0;
   }
 
-  void normalize()
+  // min_reads: minimum x, y and z of this node from calibration (NULL if the sensor has not been calibrated)
+  void normalize(const unsigned long int *min_reads)
   {
-    if (frame_min_reads_size != 0) // Validating if frame_min_reads has already been initialized (from calibration)
+    if (min_reads != NULL)
     {
-      std::stringstream converted_msg;
+      if (DEBUG)
+      {
+        std::stringstream converted_msg;
 
-      converted_msg << "Normalizing node with CAN ID: " << std::hex << node_id << " With Index: " << std::dec << index << " Using the following minimum readings, X: " << frame_min_reads[index][0] << " Y: " << frame_min_reads[index][1] << " Z: " << frame_min_reads[index][2] << std::endl;
-      logInfo(4, converted_msg.str());
-      x_value_normalized = (((float)x_value - frame_min_reads[index][0]) / (XNODEMAXREAD - frame_min_reads[index][0])) * 100;
-      y_value_normalized = (((float)y_value - frame_min_reads[index][1]) / (YNODEMAXREAD - frame_min_reads[index][1])) * 100;
-      z_value_normalized = (((float)z_value - frame_min_reads[index][2]) / (ZNODEMAXREAD - frame_min_reads[index][2])) * 100;
+        converted_msg << "Normalizing node with CAN ID: " << std::hex << node_id << " With Index: " << std::dec << index << " Using the following minimum readings, X: " << min_reads[0] << " Y: " << min_reads[1] << " Z: " << min_reads[2] << std::endl;
+        logInfo(4, converted_msg.str());
+      }
       // if (z_value < 0)
       //   z_value = 0; // Force Z to be above 0. Z would only get negative values if a node is being "pulled", which should not happen
       // Force normalized valies to be within boundaries
-      z_value_normalized < 0 ? z_value_normalized = 0 : (z_value_normalized > 100 ? z_value_normalized = 100 : z_value_normalized);
-      y_value_normalized < -100 ? y_value_normalized = -100 : (y_value_normalized > 100 ? y_value_normalized = 100 : y_value_normalized);
-      x_value_normalized < -100 ? x_value_normalized = -100 : (x_value_normalized > 100 ? x_value_normalized = 100 : x_value_normalized);
+      x_value_normalized = normalizeReading(x_value, min_reads[0], XNODEMAXREAD, -100);
+      y_value_normalized = normalizeReading(y_value, min_reads[1], YNODEMAXREAD, -100);
+      z_value_normalized = normalizeReading(z_value, min_reads[2], ZNODEMAXREAD, 0);
     }
   }
 
+  // scales: x, y and z scales of this node from calibration (see UskinSensor::SetNormalizationMode)
+  void normalizeFixedPoint(const uskin_fixed_point_scale *scales)
+  {
+    x_value_normalized = normalizeReadingFixedPoint(x_value, scales[0], -100);
+    y_value_normalized = normalizeReadingFixedPoint(y_value, scales[1], -100);
+    z_value_normalized = normalizeReadingFixedPoint(z_value, scales[2], 0);
+  }
+
   std::string to_str()
   {
     std::stringstream output;
@@ -100,8 +218,11 @@ struct _uskin_node_time_unit_reading
 struct uskin_time_unit_reading
 {
   struct timeval timestamp;
+  long long timestamp_ns = 0; // Kernel receive time of the frame's last CAN message (ns since epoch)
   struct _uskin_node_time_unit_reading *instant_reading;
   int number_of_nodes = 0;
+  uskin_contact_features contact; // Computed from the normalized values (see UskinSensor::NormalizeData)
+  unsigned int health_flags = 0;  // Health flags of all nodes OR-ed together
 
   void clear()
   {
@@ -110,20 +231,22 @@ struct uskin_time_unit_reading
       instant_reading[i].clear();
     }
 
+    contact = uskin_contact_features();
+    health_flags = 0;
+
     number_of_nodes = 0;
   }
 
-  void normalize()
+  // min_reads: per node minimum readings from calibration (NULL if the sensor has not been calibrated)
+  void normalize(unsigned long int **min_reads)
   {
     logInfo(3, "Normalizing data with the following minimum and maximum readings:");
-    logInfo(3, "Sizeof frame min reads:" + std::to_string(frame_min_reads_size));
 
-    if (frame_min_reads_size != 0) // Validating if frame_min_reads_size has already been initialized (from calibration)
+    if (min_reads != NULL) // Validating if min_reads has already been initialized (from calibration)
     {
-      logInfo(3, "Normalizing data with the following minimum and maximum readings:");
       for (int i = 0; i < number_of_nodes; i++)
       {
-        instant_reading[i].normalize();
+        instant_reading[i].normalize(min_reads[i]);
       }
     }
     else
@@ -159,6 +282,47 @@ private:
   // Flags if sensor has been calibrated
   int sensor_is_calibrated = 0;
 
+  // Minimum x, y, z readings of every node (frame_size arrays of 3), allocated by the first calibration
+  unsigned long int **frame_min_reads = NULL;
+
+  // Calibration stage run on retrieved frames (see CalibrateSensorAsync). calibration_mutex also
+  // guards frame_min_reads, so a new baseline is swapped in atomically with respect to NormalizeData
+  std::mutex calibration_mutex;
+  std::atomic<bool> calibration_in_progress;
+  int calibration_frames_left = 0;
+  int calibration_valid_frames = 0; // Frames that carried data
+  long long calibration_deadline_ns = 0; // 0 if calibration is based on number of frames
+  unsigned long int *calibration_min_reads = NULL; // Minimum x, y, z per node collected so far
+  std::promise<bool> calibration_promise;
+  std::function<void(bool)> calibration_callback;
+
+  // Fixed point scales of every node (frame_size * 3, x y z per node), computed from frame_min_reads with every
+  // calibration whatever the mode, so switching modes costs nothing. Guarded by calibration_mutex
+  uskin_normalization_mode normalization_mode = USKIN_NORMALIZATION_FLOAT;
+  uskin_fixed_point_scale *fixed_point_scales = NULL;
+
+  std::function<void()> updateCalibration(bool frame_is_valid);
+  void failCalibration();
+  void commitCalibration();
+  void updateFixedPointScales();
+  void normalizeNode(_uskin_node_time_unit_reading *node, int index);
+
+  // Guards frame_reading and frame_history while a frame is being stored or normalized (see CopyFrameData)
+  std::mutex frame_mutex;
+
+  // Native acquisition thread (see StartAcquisition)
+  std::thread acquisition_thread;
+  std::atomic<bool> acquisition_running;
+  bool acquisition_normalizes = false;
+  std::mutex frame_count_mutex;
+  std::condition_variable frame_count_changed;
+  std::atomic<unsigned long> frames_retrieved;
+
+  void acquisitionLoop();
+
+  // RetrieveFrameData / NormalizeData record frames with SaveData / SaveNormalizedData (see SetAutomaticRecording)
+  std::atomic<bool> automatic_recording;
+
   // Flags if sensor is being stored in CSV file
   int data_is_being_saved = 0;
 
@@ -170,29 +334,146 @@ private:
   // Sensor's readings from all the sensitive nodes that compose it's frame
   uskin_time_unit_reading *frame_reading;
 
+  // Temporal filter applied to every frame retrieved (NULL if no filter has been configured)
+  UskinFrameFilter *frame_filter = NULL;
+
+  // Last raw frames retrieved (NULL if history has not been enabled)
+  UskinFrameHistory *frame_history = NULL;
+
+  // Contact features of the normalized frame (created on the first normalization)
+  UskinContactFeatures *contact_features = NULL;
+  uskin_contact_config contact_config;
+
+  // Slip detection stage run on every retrieved frame (NULL if not enabled). Events are collected while the frame
+  // is processed and passed to slip_callback once frame_mutex has been released
+  UskinSlipDetector *slip_detector = NULL;
+  uskin_slip_event *slip_events = NULL;
+  std::function<void(const uskin_slip_event &)> slip_callback;
+
+  // Dense images of the normalized frame, rendered by NormalizeData (NULL if not enabled)
+  UskinTactileImage *tactile_image = NULL;
+
+  // Per node force models applied to every retrieved frame (NULL if no force calibration has been loaded)
+  UskinForceCalibration *force_calibration = NULL;
+
+  // Normalized values and forces are computed for a node when it is first accessed in a frame. A node's values are
+  // current while its stamp equals frame_generation, which is incremented for every frame retrieved with data (and
+  // when the calibration or normalization mode changes), so a whole frame is invalidated in O(1). The filter is
+  // stateful and stays eager
+  unsigned long frame_generation = 0;
+  unsigned long *normalized_generation;
+  unsigned long *force_generation;
+
+  // Frames retrieved with data, under frame_mutex. NormalizeData runs contact, image and recording once per frame: a
+  // calibration or mode change invalidates the derived values, but does not make the frame a new one
+  unsigned long frame_sequence = 0;
+  unsigned long frame_stages_sequence = 0; // Frame NormalizeData last ran those stages for
+
+  // Bring the normalized values and / or forces of one node (every node if node < 0) up to date. frame_mutex must be held
+  void updateDerivedValues(int node, bool normalized, bool forces);
+
+  // Per node health updated with every retrieved frame (NULL if not enabled). node_received marks the nodes of the frame
+  UskinHealthMonitor *health_monitor = NULL;
+  bool *node_received = NULL;
+
+  // Lower rate streams fed with every retrieved frame (created on the first subscription)
+  UskinDecimator *decimator = NULL;
+
   void initializeCSVdataStructure(std::ofstream *csv);
 
+  // Store the messages of a frame read by the driver and run every per frame stage (RetrieveFrameData / PollFrameData)
+  void storeFrame(can_frame **raw_data, int n_frames_read);
+  // Messages read by PollFrameData, sized at construction so each call does not put frame_size pointers on the stack
+  can_frame **poll_buffer;
+
+  // Opens the connection and sends the start / stop requests of several sensors at once
+  friend class UskinSensorGroup;
+
 public:
   UskinSensor();
   UskinSensor(std::string new_log_file);
   UskinSensor(int column_nodes, int row_nodes);
   UskinSensor(int column_nodes, int row_nodes, std::string new_log_file);
+  UskinSensor(int column_nodes, int row_nodes, CanDriver *new_driver);
   ~UskinSensor();
 
   int convertCanIDtoIndex(canid_t can_id);
   int convertIndextoCanID(int index);
 
 
+  void EnableMmapReceive(); // Read CAN frames from a PACKET_MMAP ring. Must be called before StartSensor()
+
   int StartSensor();
   int StopSensor();
   int GetUskinFrameSize();
 
   void CalibrateSensor(); // Leaving the sensor untouched for a period of time
 
-  unsigned long int ** getCalibrationValues();
+  // Calibrate from the next retrieved frames while data keeps flowing. Collects number_of_frames frames,
+  // or frames for duration_ms milliseconds if duration_ms > 0. The baseline is replaced only when complete, and resolves
+  // false (keeping the previous baseline) if none of those frames carried data. callback runs without the frame lock held
+  std::future<bool> CalibrateSensorAsync(int number_of_frames = 10, long duration_ms = 0, std::function<void(bool)> callback = nullptr);
+  bool get_sensor_calibration_in_progress();
+
+  // Retrieve (and optionally normalize) frames continuously on a dedicated thread. Data in GetFrameData() is then
+  // updated in place; use GetFrameCount() / WaitForFrame() to detect new frames. Reads without data are retried with
+  // a growing delay; the thread stops by itself once the driver is finished (end of a replay)
+  int StartAcquisition(bool normalize = true);
+  void StopAcquisition();
+  bool get_sensor_acquisition_status();
 
-  void RetrieveFrameData();
+  // Number of frames with data retrieved since the sensor was created
+  unsigned long GetFrameCount();
+  // Wait until more than last_frame_count frames have been retrieved. Returns false on timeout
+  bool WaitForFrame(unsigned long last_frame_count, long timeout_ms);
 
+  // Consistent copy of the current frame into caller buffers of frame_size * 3 values (x, y, z per node). Any pointer may be NULL
+  void CopyFrameData(int *raw_values, int *normalized_values, long long *timestamp_ns);
+
+  // Copy up to max_frames frames of the history with sequence number >= *next_frame, oldest first, and advance *next_frame.
+  // Frames already overwritten in the history are counted in *dropped_frames. Returns the number of frames copied
+  int CopyQueuedFrames(unsigned long long *next_frame, int max_frames, int *raw_values, int *normalized_values, long long *timestamps, unsigned long long *dropped_frames);
+
+  // Sample the history at tick_ns into values (frame_size * 3): interpolated between the frames around the tick if interpolate
+  // is set and the tick is within the stored span, the nearest frame otherwise. *newest_ns is the timestamp of the newest frame.
+  // Returns false if the history is disabled or empty
+  bool SampleFrameHistory(long long tick_ns, bool interpolate, float *values, long long *sample_ns, long long *newest_ns);
+
+  // Copy the last number_of_frames frames of the history, oldest first, into raw_values (number_of_frames * frame_size * 3).
+  // Returns false if the history is disabled or holds fewer frames
+  bool CopyLastFrames(int number_of_frames, int *raw_values);
+
+  unsigned long int ** getCalibrationValues();
+  // Consistent copy of the calibration minimums into min_readings (frame_size * 3 values, x, y, z per node). Returns false if
+  // the sensor has not been calibrated
+  bool CopyCalibrationValues(unsigned long int *min_readings);
+
+  // Copy of all nodes of the current frame (frame_size nodes)
+  void CopyFrame(_uskin_node_time_unit_reading *nodes, long long *timestamp_ns);
+  // Normalize nodes (frame_size nodes, e.g. copied with CopyFrame) with the current calibration. Returns false if not calibrated
+  bool NormalizeFrame(_uskin_node_time_unit_reading *nodes);
+
+  // USKIN_NORMALIZATION_FLOAT by default. USKIN_NORMALIZATION_FIXED_POINT normalizes with integer arithmetic only
+  // (for hosts without a fast FPU), with the same clamping, in every normalized output of the sensor
+  void SetNormalizationMode(uskin_normalization_mode mode);
+  uskin_normalization_mode GetNormalizationMode();
+
+  // Enabled by default. When disabled, RetrieveFrameData and NormalizeData no longer call SaveData / SaveNormalizedData
+  void SetAutomaticRecording(bool enable);
+
+  // Returns 1 if a frame with data was stored, 0 otherwise (timeout, read error, end of a replay)
+  int RetrieveFrameData();
+  // True once the driver will deliver no more frames (end of a replay)
+  bool IsDriverFinished();
+
+  // Non-blocking RetrieveFrameData: reads the messages received so far and retrieves the frame once all of them are in.
+  // Returns 1 if a frame was retrieved, 0 if the frame is not complete yet and -1 on errors. Call it when
+  // GetReceiveDescriptor() is readable, e.g. from a UskinEventLoop shared by many sensors
+  int PollFrameData();
+  int GetReceiveDescriptor(); // -1 for drivers without a descriptor (e.g. replay)
+
+  // Normalized values (once calibrated) and forces of the returned node, or of every node, are brought up to date on
+  // access. Only the nodes accessed are computed, and only once per frame
   _uskin_node_time_unit_reading *GetNodeData_xyzValues(int node);
   _uskin_node_time_unit_reading *GetFrameData();
 
@@ -213,6 +494,9 @@ public:
   void SaveNormalizedData();
   void SaveNormalizedData(std::string filename);
 
+  // Record raw CAN traffic in candump log format (filename must include the full path)
+  void SaveRawCanData(std::string filename);
+
   bool get_sensor_status();
 
   bool get_sensor_calibration_status();
@@ -221,6 +505,56 @@ public:
 
   void retrieveSensorMinReadings(int number_of_readings);
   bool NormalizeData();
+
+  // Filtered values are published in the *_value_filtered fields of each node
+  void SetFilter(int axis, uskin_filter_config config);
+  void DisableFilter();
+
+  // Keep the last number_of_frames raw frames retrieved
+  void EnableFrameHistory(int number_of_frames);
+  UskinFrameHistory *GetFrameHistory();
+
+  long long GetFrameTimestamp();
+
+  // Contact features are computed on every normalized frame (NormalizeData) and published in frame_reading->contact
+  void SetContactConfiguration(uskin_contact_config config);
+  uskin_contact_features GetContactFeatures();
+  // Contact region of each node in the last normalized frame, 0 if not in contact (frame_size values)
+  void CopyContactLabels(int *labels);
+
+  // Analyse x/y of every retrieved frame for slip and vibration. callback is called for every node that starts
+  // slipping, from the thread retrieving frames (e.g. the acquisition thread), right after the frame is stored
+  void EnableSlipDetection(uskin_slip_config config, std::function<void(const uskin_slip_event &)> callback = nullptr);
+  void DisableSlipDetection();
+  UskinSlipDetector *GetSlipDetector();
+
+  // Render every normalized frame into output_rows x output_columns images, one per axis
+  void EnableTactileImage(int output_rows, int output_columns, uskin_interpolation method = USKIN_INTERPOLATION_BILINEAR);
+  void DisableTactileImage();
+  UskinTactileImage *GetTactileImage();
+  // Consistent copy of the latest image of one axis, without row padding (output_rows * output_columns values)
+  bool CopyTactileImage(int axis, float *image);
+
+  // Load per node force models (see uskinForceCalibration.h). Forces are computed into the x_force, y_force and z_force
+  // fields when a node is read (GetNodeData_xyzValues, GetFrameData, CopyFrame), and for every retrieved frame while
+  // decimated streams are subscribed. Models fitted relative to the baseline need CalibrateSensor() first
+  bool LoadForceCalibration(std::string filename);
+  void DisableForceCalibration();
+  bool get_sensor_force_calibration_status();
+
+  // Track the health of every node (see uskinHealthMonitor.h). Flags are published with each retrieved frame in the
+  // health_flags fields of the nodes and of frame_reading
+  void EnableHealthMonitor(uskin_health_config config = uskin_health_config());
+  void DisableHealthMonitor();
+  UskinHealthMonitor *GetHealthMonitor();
+  uskin_node_health GetNodeHealth(int node);
+  unsigned int GetFrameHealth();
+
+  // Subscribe to a stream of the retrieved frames at rate_hz, averaged (or max held) per node over each period. The
+  // stream is fed by the thread retrieving frames and read by the subscriber with read() / wait(), without either
+  // blocking the other. The stream is deleted by UnsubscribeDecimated or with the sensor
+  UskinDecimatedStream *SubscribeDecimated(double rate_hz, uskin_decimation_mode mode = USKIN_DECIMATION_AVERAGE);
+  void UnsubscribeDecimated(UskinDecimatedStream *stream);
 };
 
 #endif
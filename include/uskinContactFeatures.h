@@ -0,0 +1,103 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinContactFeatures.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINCONTACTFEATURES_H
+#define USKINCONTACTFEATURES_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Regions beyond this number are merged into the frame totals but not reported individually
+#define USKIN_MAX_CONTACT_REGIONS 8
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Data Structures #########################
+struct uskin_contact_config
+{
+  // Normalized z thresholds. A node starts a contact at high_threshold, and stays in contact
+  // (or joins a neighbouring contact) until it drops below low_threshold
+  int high_threshold = 15;
+  int low_threshold = 5;
+
+  bool eight_connected = false; // Diagonal neighbours belong to the same region
+};
+
+struct uskin_contact_region
+{
+  int label = 0; // Value of the region's nodes in the label map (1 based)
+  int number_of_nodes = 0;
+  int peak_node = -1; // Index of the node with the highest z
+  float total_force = 0;
+  float center_column = 0; // Center of pressure, in node units
+  float center_row = 0;
+};
+
+// Features of a normalized frame. Positions are given in node units (column, row), where node index = column * rows + row
+struct uskin_contact_features
+{
+  bool in_contact = false;
+  int nodes_in_contact = 0;
+
+  float total_force = 0; // Sum of normalized z over the nodes in contact
+  float center_column = 0;
+  float center_row = 0;
+
+  // Force weighted mean of the normalized x and y of the nodes in contact
+  float shear_x = 0;
+  float shear_y = 0;
+  float shear_magnitude = 0;
+  float shear_direction = 0; // atan2(shear_y, shear_x), radians
+
+  int number_of_regions = 0;
+  uskin_contact_region regions[USKIN_MAX_CONTACT_REGIONS];
+};
+
+//###################### UskinContactFeatures #########################
+// Contact features computed from every normalized frame: total force, center of pressure, shear and
+// contact regions. Regions are 4 (or 8) connected components of the grid, labeled with hysteresis:
+// seeds are nodes above the high threshold, or nodes still above the low threshold that were in contact
+// in the previous frame, and regions grow over neighbours above the low threshold.
+// All buffers are allocated once, so computing the features of a frame never allocates
+class UskinContactFeatures
+{
+private:
+  const int columns;
+  const int rows;
+  const int number_of_nodes;
+
+  uskin_contact_config config;
+
+  int *labels;         // Region of each node, 0 if not in contact
+  bool *was_in_contact; // Node state in the previous frame
+  int *stack;          // Flood fill work list
+
+public:
+  UskinContactFeatures(int number_of_columns, int number_of_rows);
+  ~UskinContactFeatures();
+
+  void configure(uskin_contact_config new_config);
+
+  uskin_contact_config getConfiguration();
+
+  void reset();
+
+  void compute(const _uskin_node_time_unit_reading *frame, uskin_contact_features *features);
+
+  // Label map of the last frame computed (number_of_nodes values, in node index order)
+  const int *getNodeLabels();
+};
+
+#endif
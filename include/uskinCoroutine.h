@@ -0,0 +1,362 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinCoroutine.h
+ *
+ * C++20 coroutine interface of a sensor served by a UskinEventLoop:
+ *
+ *   UskinAsyncSensor sensor(&uskin, loop);
+ *   bool calibrated = co_await sensor.calibrate();
+ *   uskin_async_frame frame = co_await sensor.next_frame();
+ *   UskinFrameGenerator frames = sensor.frames();
+ *   while (const uskin_async_frame *next = co_await frames.next()) ...
+ *
+ * Coroutines are resumed on the loop's thread, right after the frame they waited for is retrieved. Unlike the rest
+ * of the driver, which builds as C++11, this header is only usable from C++20 code, so it is header only.
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINCOROUTINE_H
+#define USKINCOROUTINE_H
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "uskinCoroutine.h needs C++20 coroutines (compile with -std=c++20)"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <algorithm>
+#include <vector>
+
+#include "uskinCanDriver.h"
+
+//###################### Data Structures #########################
+// A frame delivered to a coroutine. nodes is the sensor's frame (GetFrameData), valid until the loop retrieves the
+// next frame of the sensor, i.e. until the coroutine awaits again. nodes is NULL if the sensor is not being served
+struct uskin_async_frame
+{
+  _uskin_node_time_unit_reading *nodes = NULL;
+  long long timestamp_ns = 0;
+  unsigned long frame_count = 0; // UskinSensor::GetFrameCount() of this frame
+};
+
+//###################### UskinTask #########################
+// Minimal coroutine type for code without an executor of its own: starts running immediately and keeps its result
+// (an exception thrown by the coroutine is rethrown by get()). Destroying the task destroys the coroutine
+class UskinTask
+{
+public:
+  struct promise_type
+  {
+    std::exception_ptr exception;
+
+    UskinTask get_return_object() { return UskinTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  UskinTask(UskinTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+  UskinTask(const UskinTask &) = delete;
+  UskinTask &operator=(const UskinTask &) = delete;
+
+  ~UskinTask()
+  {
+    if (handle)
+      handle.destroy();
+  }
+
+  bool done() { return !handle || handle.done(); }
+
+  void get()
+  {
+    if (handle && handle.done() && handle.promise().exception)
+      std::rethrow_exception(handle.promise().exception);
+  }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit UskinTask(std::coroutine_handle<promise_type> new_handle) : handle(new_handle) {}
+};
+
+//###################### UskinFrameGenerator #########################
+// Asynchronous generator of frames: co_await next() resumes the generator until it yields its next frame, and
+// returns NULL once it has finished
+class UskinFrameGenerator
+{
+public:
+  struct promise_type
+  {
+    uskin_async_frame current;
+    std::coroutine_handle<> consumer;
+    std::exception_ptr exception;
+    bool finished = false;
+
+    // Hand control straight back to the coroutine awaiting next()
+    struct transfer_to_consumer
+    {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> generator) noexcept
+      {
+        std::coroutine_handle<> consumer = generator.promise().consumer;
+        return consumer ? consumer : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+
+    UskinFrameGenerator get_return_object() { return UskinFrameGenerator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    transfer_to_consumer final_suspend() noexcept
+    {
+      finished = true;
+      return {};
+    }
+    transfer_to_consumer yield_value(uskin_async_frame frame)
+    {
+      current = frame;
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  struct next_awaiter
+  {
+    std::coroutine_handle<promise_type> generator;
+
+    bool await_ready() { return !generator || generator.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer)
+    {
+      generator.promise().consumer = consumer;
+      return generator;
+    }
+    const uskin_async_frame *await_resume()
+    {
+      if (!generator)
+        return NULL;
+
+      if (generator.promise().exception)
+        std::rethrow_exception(generator.promise().exception);
+
+      return generator.promise().finished ? NULL : &generator.promise().current;
+    }
+  };
+
+  UskinFrameGenerator(UskinFrameGenerator &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+  UskinFrameGenerator(const UskinFrameGenerator &) = delete;
+  UskinFrameGenerator &operator=(const UskinFrameGenerator &) = delete;
+
+  ~UskinFrameGenerator()
+  {
+    if (handle)
+      handle.destroy();
+  }
+
+  next_awaiter next() { return next_awaiter{handle}; }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit UskinFrameGenerator(std::coroutine_handle<promise_type> new_handle) : handle(new_handle) {}
+};
+
+//###################### UskinAsyncSensor #########################
+// Serves a started sensor from a UskinEventLoop and resumes the coroutines awaiting it. Frames are normalized on
+// retrieval once the sensor is calibrated (if normalize is set). Coroutines still waiting must be destroyed before
+// the UskinAsyncSensor; destroying a waiting coroutine cancels its wait
+class UskinAsyncSensor
+{
+private:
+  UskinSensor *sensor;
+  UskinEventLoop &loop;
+  bool normalize;
+  bool attached;
+
+  uskin_async_frame current;
+
+  struct calibration_waiter
+  {
+    std::future<bool> *result;
+    std::coroutine_handle<> handle;
+  };
+
+  std::vector<std::coroutine_handle<>> frame_waiters;
+  std::vector<calibration_waiter> calibration_waiters;
+  std::vector<std::coroutine_handle<>> resuming; // Kept to reuse its capacity
+
+  void cancel(std::coroutine_handle<> handle)
+  {
+    frame_waiters.erase(std::remove(frame_waiters.begin(), frame_waiters.end(), handle), frame_waiters.end());
+
+    for (std::vector<calibration_waiter>::iterator waiter = calibration_waiters.begin(); waiter != calibration_waiters.end(); ++waiter)
+    {
+      if (waiter->handle == handle)
+      {
+        calibration_waiters.erase(waiter);
+        break;
+      }
+    }
+  }
+
+  void onFrame()
+  {
+    if (normalize && sensor->get_sensor_calibration_status())
+      sensor->NormalizeData();
+
+    for (std::vector<calibration_waiter>::iterator waiter = calibration_waiters.begin(); waiter != calibration_waiters.end();)
+    {
+      if (waiter->result->wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      {
+        resuming.push_back(waiter->handle);
+        waiter = calibration_waiters.erase(waiter);
+      }
+      else
+        ++waiter;
+    }
+
+    if (!frame_waiters.empty())
+    {
+      current.nodes = sensor->GetFrameData();
+      current.timestamp_ns = sensor->GetFrameTimestamp();
+      current.frame_count = sensor->GetFrameCount();
+
+      // Coroutines that await again while being resumed wait for the next frame
+      resuming.insert(resuming.end(), frame_waiters.begin(), frame_waiters.end());
+      frame_waiters.clear();
+    }
+
+    for (size_t i = 0; i < resuming.size(); i++)
+      resuming[i].resume();
+
+    resuming.clear();
+  }
+
+  // The loop stopped serving the sensor (read error): every waiting coroutine resumes with no frame
+  void onDetached()
+  {
+    attached = false;
+
+    for (size_t i = 0; i < calibration_waiters.size(); i++)
+      resuming.push_back(calibration_waiters[i].handle);
+
+    resuming.insert(resuming.end(), frame_waiters.begin(), frame_waiters.end());
+    calibration_waiters.clear();
+    frame_waiters.clear();
+
+    for (size_t i = 0; i < resuming.size(); i++)
+      resuming[i].resume();
+
+    resuming.clear();
+  }
+
+public:
+  struct frame_awaiter
+  {
+    UskinAsyncSensor *owner;
+    std::coroutine_handle<> handle = nullptr;
+
+    frame_awaiter(UskinAsyncSensor *new_owner) : owner(new_owner) {}
+    frame_awaiter(const frame_awaiter &) = delete;
+
+    ~frame_awaiter()
+    {
+      if (handle)
+        owner->cancel(handle);
+    }
+
+    bool await_ready() { return !owner->attached; }
+    void await_suspend(std::coroutine_handle<> waiting)
+    {
+      handle = waiting;
+      owner->frame_waiters.push_back(waiting);
+    }
+    uskin_async_frame await_resume()
+    {
+      handle = nullptr;
+      return owner->attached ? owner->current : uskin_async_frame();
+    }
+  };
+
+  struct calibration_awaiter
+  {
+    UskinAsyncSensor *owner;
+    std::future<bool> result;
+    std::coroutine_handle<> handle = nullptr;
+
+    calibration_awaiter(UskinAsyncSensor *new_owner, std::future<bool> &&new_result) : owner(new_owner), result(std::move(new_result)) {}
+    calibration_awaiter(const calibration_awaiter &) = delete;
+
+    ~calibration_awaiter()
+    {
+      if (handle)
+        owner->cancel(handle);
+    }
+
+    // A calibration rejected (one is already in progress) is ready at once
+    bool await_ready() { return !owner->attached || result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    void await_suspend(std::coroutine_handle<> waiting)
+    {
+      handle = waiting;
+      owner->calibration_waiters.push_back({&result, waiting});
+    }
+    bool await_resume()
+    {
+      handle = nullptr;
+      return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready && result.get();
+    }
+  };
+
+  // The sensor must have been started
+  UskinAsyncSensor(UskinSensor *new_sensor, UskinEventLoop &new_loop, bool new_normalize = true) : sensor(new_sensor), loop(new_loop), normalize(new_normalize)
+  {
+    attached = loop.addSensor(sensor, [this] { onFrame(); }, [this] { onDetached(); });
+  }
+
+  ~UskinAsyncSensor()
+  {
+    if (attached)
+      loop.removeSensor(sensor);
+  }
+
+  UskinAsyncSensor(const UskinAsyncSensor &) = delete;
+  UskinAsyncSensor &operator=(const UskinAsyncSensor &) = delete;
+
+  // False if the loop could not serve the sensor (not started, no receive descriptor, or a read error); awaiting then returns at once
+  bool isAttached() { return attached; }
+  UskinSensor *getSensor() { return sensor; }
+
+  // Resumes with the next frame retrieved
+  frame_awaiter next_frame() { return frame_awaiter(this); }
+
+  // Calibrates from the next frames (see UskinSensor::CalibrateSensorAsync) and resumes with the result once the
+  // baseline has been replaced. The sensor should not be touched meanwhile
+  calibration_awaiter calibrate(int number_of_frames = 10, long duration_ms = 0)
+  {
+    return calibration_awaiter(this, sensor->CalibrateSensorAsync(number_of_frames, duration_ms));
+  }
+
+  // Every frame retrieved while the generator is being awaited
+  UskinFrameGenerator frames()
+  {
+    for (;;)
+    {
+      uskin_async_frame frame = co_await next_frame();
+
+      if (frame.nodes == NULL)
+        co_return;
+
+      co_yield frame;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinCsvAnalyzer.h
+ *
+ * Offline analysis of CSV recordings written by UskinSensor::SaveData. Binary form written by saveBinary (native
+ * byte order, the magic reads differently on a host of the other order):
+ *
+ *   u32 magic "USKC", u32 version, u32 nodes, u32 value bytes (2: u16, 4: i32), u64 frames,
+ *   u32 node IDs [nodes], i64 timestamps (ns) [frames], values [nodes x 3][frames] (one column per node axis)
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINCSVANALYZER_H
+#define USKINCSVANALYZER_H
+
+#include <string>
+#include <vector>
+#include <linux/types.h>
+
+#define USKIN_CSV_BINARY_MAGIC 0x434B5355 // "USKC"
+#define USKIN_CSV_BINARY_VERSION 1
+
+// Bytes of the file parsed per task. Chunks end at row boundaries
+#define USKIN_CSV_CHUNK_BYTES (16 << 20)
+
+//###################### Data Structures #########################
+struct uskin_csv_config
+{
+  int threads = 0; // 0: one per core
+  size_t chunk_bytes = USKIN_CSV_CHUNK_BYTES;
+
+  // Contacts are found on the z values normalized as UskinSensor would, with the minimum of the first
+  // calibration_frames frames as calibration, and the thresholds of uskin_contact_config
+  int calibration_frames = 10;
+  int contact_high_threshold = 15;
+  int contact_low_threshold = 5;
+
+  std::vector<double> percentiles = {1, 50, 99};
+};
+
+struct uskin_csv_axis_statistics
+{
+  int min = 0;
+  int max = 0;
+  double mean = 0;
+  std::vector<int> percentiles; // Nearest rank, in the order of uskin_csv_config::percentiles
+};
+
+struct uskin_csv_node_statistics
+{
+  __u32 node_id = 0;
+  uskin_csv_axis_statistics axis[3]; // x, y, z
+
+  unsigned long contact_frames = 0; // Frames in contact
+  unsigned long contacts = 0;       // Contacts started
+};
+
+//###################### UskinCsvAnalyzer #########################
+// Loads a recording into columnar arrays using every core: the file is memory mapped, split into chunks at row
+// boundaries, and the chunks are parsed in parallel straight into their place in the columns (rows are counted
+// first). Rows that do not have the layout of the first data row (e.g. a truncated last line) are skipped and
+// counted
+class UskinCsvAnalyzer
+{
+private:
+  uskin_csv_config config;
+
+  int number_of_nodes = 0;
+  unsigned long number_of_frames = 0;
+  unsigned long malformed_rows = 0;
+
+  std::vector<__u32> node_ids;
+  std::vector<long long> timestamps;
+  std::vector<int> values; // Column (node * 3 + axis) starts at (node * 3 + axis) * number_of_frames
+
+  int numberOfThreads();
+  void clear();
+
+public:
+  UskinCsvAnalyzer(uskin_csv_config new_config = uskin_csv_config());
+
+  // Returns 1 on success, 0 otherwise (as CandumpReader::openFile)
+  int openFile(std::string file_name);
+  int openBinary(std::string file_name);
+  int saveBinary(std::string file_name);
+
+  // Computed in parallel, one column per task
+  std::vector<uskin_csv_node_statistics> computeStatistics();
+
+  int getNumberOfNodes();
+  unsigned long getNumberOfFrames();
+  unsigned long getMalformedRows();
+  const std::vector<__u32> &getNodeIds();
+  const long long *getTimestamps(); // ns since the epoch, from the local time written by SaveData
+  const int *getColumn(int node, int axis);
+};
+
+#endif
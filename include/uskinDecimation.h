@@ -0,0 +1,121 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinDecimation.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINDECIMATION_H
+#define USKINDECIMATION_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+
+#include "uskinFilters.h"
+
+// Values decimated per node: raw, filtered and force, x y z each
+#define USKIN_DECIMATION_CHANNELS 9
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Data Structures #########################
+enum uskin_decimation_mode
+{
+  USKIN_DECIMATION_AVERAGE, // Mean of the frames of each period (box filter, attenuates content above the output rate)
+  USKIN_DECIMATION_MAX_HOLD // Largest value of each period, so short presses are not lost
+};
+
+//###################### UskinDecimatedStream #########################
+// One output of a UskinDecimator: the full rate frames are accumulated per node over periods of 1 / rate seconds of
+// frame time, and each completed period is published as one frame (timestamped with its last frame). Publishing goes through a triple buffer, so the
+// thread retrieving frames never waits for a consumer and a consumer always reads the latest complete period
+class UskinDecimatedStream
+{
+private:
+  const int number_of_nodes;
+  const int padded_nodes;
+  const long long period_ns;
+  const uskin_decimation_mode mode;
+
+  float *accumulator[USKIN_DECIMATION_CHANNELS];
+  unsigned int *window_health_flags; // Health flags of each node OR-ed over the period
+  int frames_in_window = 0;
+  long long window_end_ns = 0;
+
+  struct block
+  {
+    _uskin_node_time_unit_reading *nodes;
+    long long timestamp_ns;
+    int frames;
+  };
+
+  // Triple buffer: the producer fills back, then swaps it with middle; the consumer swaps front with middle when a new block is there
+  block blocks[3];
+  int back = 0;
+  int front = 1;
+  std::atomic<int> middle; // Block index, plus a flag set while it holds a block not read yet
+
+  std::mutex published_mutex;
+  std::condition_variable published_changed;
+  unsigned long blocks_published = 0;
+
+  void resetWindow();
+  void publish(const _uskin_node_time_unit_reading *frame);
+
+public:
+  UskinDecimatedStream(int number_of_nodes, double rate_hz, uskin_decimation_mode new_mode);
+  ~UskinDecimatedStream();
+
+  // Producer side (see UskinDecimator::process). input holds the channels of the frame as node arrays
+  void accumulate(float *const *input, const _uskin_node_time_unit_reading *frame, long long timestamp_ns);
+
+  // Copy the latest period into nodes (number_of_nodes nodes). Raw values are rounded, normalized values are left at 0
+  // (see UskinSensor::NormalizeFrame) and health_flags are those seen during the period. Returns false if no period
+  // has been completed since the last read
+  bool read(_uskin_node_time_unit_reading *nodes, long long *timestamp_ns = NULL, int *frames = NULL);
+
+  // Wait until a period not read yet is available. Returns false on timeout
+  bool wait(long timeout_ms);
+
+  double getRate();
+  uskin_decimation_mode getMode();
+  unsigned long getBlocksPublished();
+};
+
+//###################### UskinDecimator #########################
+// Feeds every full rate frame to any number of decimated streams. The frame is converted once into per channel node
+// arrays, and each stream then costs a vector add (or max) per channel and node, plus building one output frame per period
+class UskinDecimator
+{
+private:
+  const int number_of_nodes;
+  const int padded_nodes;
+
+  float *input[USKIN_DECIMATION_CHANNELS];
+
+  std::vector<UskinDecimatedStream *> streams;
+
+public:
+  UskinDecimator(int number_of_nodes);
+  ~UskinDecimator();
+
+  // The decimator owns the stream until it is removed
+  UskinDecimatedStream *subscribe(double rate_hz, uskin_decimation_mode mode);
+  bool unsubscribe(UskinDecimatedStream *stream);
+  int getNumberOfStreams();
+
+  void process(const _uskin_node_time_unit_reading *frame, long long timestamp_ns);
+};
+
+#endif
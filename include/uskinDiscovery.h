@@ -0,0 +1,78 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinDiscovery.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINDISCOVERY_H
+#define USKINDISCOVERY_H
+
+#include <vector>
+#include <string>
+#include <linux/types.h>
+
+class UskinSensor;
+
+// Listening time of each discovery phase
+#define USKIN_DISCOVERY_WINDOW_MS 100
+// After stopping a probed device, wait at most this long for its traffic to end
+#define USKIN_DISCOVERY_QUIET_MS 20
+
+//###################### Data Structures #########################
+struct uskin_discovery_config
+{
+  long window_ms = USKIN_DISCOVERY_WINDOW_MS;
+
+  // Device IDs sent a start request, one after the other, to find patches that are not streaming yet. Probed
+  // patches are stopped again. Nothing is sent if probe is false (only patches already streaming are found)
+  std::vector<__u32> device_ids = {0x201};
+  bool probe = true;
+};
+
+// A patch found on a bus. Its node messages have IDs whose hex digits read B R C (block, row, column), 0x1RC for
+// the patches UskinSensor reads, and its grid is inferred from the largest row and column seen
+struct uskin_discovered_sensor
+{
+  std::string interface_name;
+  __u32 device_id = 0;     // Device ID that started it (0 if it was already streaming and its start request was not seen)
+  int id_block = 1;        // B digit of its node IDs
+  int rows = 0;
+  int columns = 0;
+  int nodes_seen = 0;      // Distinct node IDs received
+  bool complete = false;   // Every node of the rows x columns grid was received
+  bool was_streaming = false; // Streaming before discovery started
+  double frame_rate_hz = 0;   // Messages of its busiest node per second
+};
+
+//###################### UskinBusDiscovery #########################
+// Finds the uSkin patches on CAN interfaces within a bounded time: a passive listening window finds patches that
+// are already streaming, then every candidate device ID is sent a start request and the node IDs that start
+// arriving identify its patch and grid. At most window_ms * (1 + device IDs) plus the quiet waits
+class UskinBusDiscovery
+{
+private:
+  uskin_discovery_config config;
+
+public:
+  UskinBusDiscovery(uskin_discovery_config new_config = uskin_discovery_config());
+
+  // With no interfaces, every CAN interface of the host is searched
+  std::vector<uskin_discovered_sensor> discover(std::vector<std::string> interfaces = std::vector<std::string>());
+
+  // CAN interfaces of the host (e.g. can0, vcan0)
+  static std::vector<std::string> listCanInterfaces();
+
+  // Sensor configured with the discovered interface, device ID and geometry (not started). NULL if its node IDs are
+  // not of the 0x1RC form UskinSensor reads
+  static UskinSensor *createSensor(const uskin_discovered_sensor &discovered);
+};
+
+#endif
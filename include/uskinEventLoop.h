@@ -0,0 +1,87 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinEventLoop.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINEVENTLOOP_H
+#define USKINEVENTLOOP_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+class UskinSensor;
+
+//###################### UskinEventLoop #########################
+// Readiness based retrieval of many started sensors on one thread. The receive descriptor of every sensor is
+// watched with epoll; when one is readable the messages received so far are read without blocking
+// (UskinSensor::PollFrameData) and on_frame is called for every frame completed. Nothing waits for a slow sensor,
+// so one thread serves any number of them. This is the integration point for executors: getDescriptor() is readable
+// whenever runOnce(0) has work, so the loop can itself be watched by another event loop (see uskinCoroutine.h for
+// C++20 awaitables built on it)
+class UskinEventLoop
+{
+private:
+  struct watched_sensor
+  {
+    UskinSensor *sensor;
+    int descriptor;
+    std::function<void()> on_frame;
+    std::function<void()> on_error;
+    bool removed;
+  };
+
+  int epoll_descriptor = -1;
+  int wake_descriptor = -1; // eventfd signalled by stop() and post()
+
+  std::vector<watched_sensor *> sensors;
+  std::vector<watched_sensor *> removed_sensors; // Released once no dispatch can refer to them
+  bool dispatching = false;
+
+  std::mutex posted_mutex;
+  std::vector<std::function<void()>> posted;
+  std::vector<std::function<void()>> running_posted;
+
+  std::atomic<bool> stop_requested;
+
+  void wake();
+  void runPosted();
+  void releaseRemoved();
+
+public:
+  UskinEventLoop();
+  ~UskinEventLoop();
+
+  // The sensor must have been started (its descriptor changes when it is restarted) and is not owned by the loop.
+  // on_frame is called on the loop's thread after each frame retrieved. A sensor whose read fails or whose descriptor
+  // reports an error or hang up is removed, then on_error is called. Returns false if the sensor has no descriptor
+  bool addSensor(UskinSensor *sensor, std::function<void()> on_frame = nullptr, std::function<void()> on_error = nullptr);
+  // May be called from on_frame. Remove a sensor before stopping it
+  bool removeSensor(UskinSensor *sensor);
+  int getNumberOfSensors();
+
+  // Run work on the loop's thread (thread safe)
+  void post(std::function<void()> work);
+
+  // Wait up to timeout_ms (-1: no limit) for readable sensors or posted work and handle them. Returns the number of frames retrieved
+  int runOnce(long timeout_ms);
+  // Handle events until stop() is called
+  void run();
+  // Thread safe
+  void stop();
+
+  // Readable when runOnce has something to do (epoll descriptor)
+  int getDescriptor();
+};
+
+#endif
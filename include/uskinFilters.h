@@ -0,0 +1,130 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFilters.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINFILTERS_H
+#define USKINFILTERS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// 4 lane float vector (SSE on x86, NEON on ARM). Node arrays are padded to a multiple of USKIN_VECTOR_LANES
+typedef float uskin_vec4 __attribute__((vector_size(16)));
+#define USKIN_VECTOR_LANES 4
+
+#define USKIN_AXIS_X 0
+#define USKIN_AXIS_Y 1
+#define USKIN_AXIS_Z 2
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Utils #########################
+
+float *allocateNodeArray(int number_of_elements);
+
+void freeNodeArray(float *array);
+
+int padNodeCount(int number_of_nodes);
+
+inline uskin_vec4 vec_min(uskin_vec4 a, uskin_vec4 b)
+{
+  return a < b ? a : b;
+}
+
+inline uskin_vec4 vec_max(uskin_vec4 a, uskin_vec4 b)
+{
+  return a > b ? a : b;
+}
+
+inline uskin_vec4 vec_set(float value)
+{
+  uskin_vec4 vector = {value, value, value, value};
+  return vector;
+}
+
+//###################### Data Structures #########################
+enum uskin_filter_type
+{
+  USKIN_FILTER_NONE,
+  USKIN_FILTER_IIR,            // First order IIR: y += alpha * (x - y)
+  USKIN_FILTER_BIQUAD_LOWPASS, // 2nd order Butterworth-style low-pass (RBJ cookbook)
+  USKIN_FILTER_MEDIAN          // Median over the last 3 or 5 samples
+};
+
+struct uskin_filter_config
+{
+  uskin_filter_type type = USKIN_FILTER_NONE;
+
+  float alpha = 0.2; // IIR smoothing factor, (0, 1]
+
+  float cutoff_frequency = 50;   // Biquad cut-off frequency (Hz)
+  float sample_frequency = 1000; // Frame rate of the sensor (Hz)
+  float q = 0.7071;              // Biquad quality factor
+
+  int median_window = 3; // 3 or 5
+};
+
+//###################### UskinFrameFilter #########################
+// Temporal filter applied to every node of a frame. State is kept per axis as contiguous arrays
+// of nodes (structure of arrays), so each filter step processes 4 nodes per instruction
+class UskinFrameFilter
+{
+private:
+  const int number_of_nodes;
+
+  // Node arrays are padded so vector loops need no remainder handling
+  const int padded_nodes;
+
+  uskin_filter_config config[3];
+
+  // Biquad coefficients, per axis
+  float b0[3], b1[3], b2[3], a1[3], a2[3];
+
+  float *input[3];
+  float *output[3];
+
+  // IIR output / biquad delay line, per axis
+  float *state_1[3];
+  float *state_2[3];
+
+  // Last median_window samples for each node, per axis (median_window * padded_nodes)
+  float *median_history[3];
+  int median_position = 0;
+
+  // Filter state is seeded from the first frame to avoid a start-up transient
+  bool state_initialized = false;
+
+  void seedState();
+
+  void filterIIR(int axis);
+  void filterBiquad(int axis);
+  void filterMedian(int axis);
+
+public:
+  UskinFrameFilter(int number_of_nodes);
+  ~UskinFrameFilter();
+
+  void configureAxis(int axis, uskin_filter_config new_config);
+
+  uskin_filter_config getAxisConfiguration(int axis);
+
+  void reset();
+
+  // Filter raw x, y and z values of a frame and store results in the *_value_filtered fields
+  void filter(_uskin_node_time_unit_reading *frame);
+
+  const float *getFilteredValues(int axis);
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinForceCalibration.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINFORCECALIBRATION_H
+#define USKINFORCECALIBRATION_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "uskinFilters.h"
+
+struct _uskin_node_time_unit_reading;
+
+//###################### UskinForceCalibration #########################
+// Per node models mapping raw (x, y, z) readings to force in newtons. Calibration files are text, one node per line
+// ('#' starts a comment):
+//
+//   input baseline|raw                        (optional, default baseline)
+//   <node index> linear m00 m01 m02 m10 m11 m12 m20 m21 m22 ox oy oz
+//   <node index> poly ox c1x c2x c3x oy c1y c2y c3y oz c1z c2z c3z
+//
+// linear: F = M r + o. poly: F_axis = o + c1 r + c2 r^2 + c3 r^3, per axis. With 'input baseline', r is the raw
+// reading minus the at-rest reading collected by UskinSensor::CalibrateSensor; with 'input raw', r is the raw reading.
+// Both models are evaluated by a single kernel, F_a = o_a + sum_b M_ab r_b + c2_a r_a^2 + c3_a r_a^3, applied to all
+// nodes at once on per axis node arrays, 4 nodes per instruction. Nodes without a model output 0
+class UskinForceCalibration
+{
+private:
+  const int number_of_nodes;
+  const int padded_nodes;
+
+  bool relative_to_baseline = true;
+
+  float *offset[3];
+  float *matrix[3][3]; // matrix[a][b]: contribution of r_b to F_a
+  float *square[3];
+  float *cube[3];
+
+  float *baseline[3];
+  float *input[3];
+  float *output[3];
+
+  bool *node_calibrated;
+
+  void clearModels();
+
+public:
+  UskinForceCalibration(int number_of_nodes);
+  ~UskinForceCalibration();
+
+  // Replace all models with the ones in filename. On error the previous models are kept
+  bool loadFile(std::string filename);
+
+  bool usesBaseline();
+  void setBaseline(int node, float x, float y, float z);
+
+  bool isNodeCalibrated(int node);
+
+  // Compute x_force, y_force and z_force of every node of the frame
+  void apply(_uskin_node_time_unit_reading *frame);
+  // Same, for a single node
+  void applyNode(_uskin_node_time_unit_reading *frame, int node);
+
+  const float *getForces(int axis);
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFrameFusion.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINFRAMEFUSION_H
+#define USKINFRAMEFUSION_H
+
+#include <vector>
+#include <time.h>
+
+class UskinSensor;
+
+// History kept for sensors that did not enable one before being added
+#define USKIN_FUSION_DEFAULT_HISTORY 32
+
+//###################### Data Structures #########################
+enum uskin_fusion_mode
+{
+  USKIN_FUSION_NEAREST,    // Use each sensor's frame closest to the tick
+  USKIN_FUSION_INTERPOLATE // Interpolate between the frames around the tick (newest frame if tick is ahead of the data)
+};
+
+struct uskin_fusion_sensor_status
+{
+  bool valid = false;         // Sensor had at least one frame
+  long long sample_ns = 0;    // Time the fused values of this sensor correspond to
+  long long age_ns = 0;       // Tick minus timestamp of the sensor's newest frame
+  long long skew_ns = 0;      // sample_ns minus tick
+};
+
+//###################### UskinFrameFusion #########################
+// Aligns the frame histories of several sensors to a common clock tick and builds a single
+// contiguous [total nodes x 3] frame (x, y, z), sensors laid out in the order they were added.
+// Timestamps are CLOCK_REALTIME nanoseconds, the same clock used for kernel receive timestamps.
+class UskinFrameFusion
+{
+private:
+  uskin_fusion_mode mode;
+
+  std::vector<UskinSensor *> sensors;
+  std::vector<int> node_offsets;
+  std::vector<uskin_fusion_sensor_status> sensor_status;
+
+  int total_nodes = 0;
+
+  float *fused_frame = NULL;
+
+  long long last_tick_ns = 0;
+
+public:
+  UskinFrameFusion(uskin_fusion_mode new_mode = USKIN_FUSION_INTERPOLATE);
+  ~UskinFrameFusion();
+
+  // Returns the sensor's position in the fused output. Enables a frame history on the sensor if needed
+  int addSensor(UskinSensor *sensor);
+
+  int getNumberOfSensors();
+  int getTotalNodes();
+  int getNodeOffset(int sensor);
+
+  // Build the fused frame for the given tick. Returns true if every sensor contributed
+  bool fuse(long long tick_ns);
+  // Same, using the current time as tick
+  bool fuse();
+
+  const float *getFusedFrame();
+  long long getLastTick();
+
+  uskin_fusion_sensor_status getSensorStatus(int sensor);
+
+  // Largest absolute skew among sensors for the last tick
+  long long getMaxSkew();
+
+  static long long now();
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFrameHistory.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINFRAMEHISTORY_H
+#define USKINFRAMEHISTORY_H
+
+#include <string.h>
+
+struct _uskin_node_time_unit_reading;
+
+//###################### UskinFrameHistory #########################
+// Preallocated ring of the last 'capacity' raw frames with nanosecond timestamps.
+// Every frame is written twice (slot i and slot i + capacity), so the last T frames are always
+// available as one contiguous [T x nodes x 3] block of x, y, z values without copying.
+// Frames are indexed from 0 (oldest) to size() - 1 (newest). Timestamps must not decrease.
+class UskinFrameHistory
+{
+private:
+  const int capacity;
+
+  const int number_of_nodes;
+
+  // Number of values per frame (number_of_nodes * 3)
+  const int frame_stride;
+
+  // 2 * capacity frames of x, y, z values and their timestamps
+  int *values;
+  long long *timestamps;
+
+  // Next slot to be written, in [0, capacity)
+  int head = 0;
+
+  int frames_stored = 0;
+
+  unsigned long long frames_pushed = 0;
+
+  int physicalSlot(int index);
+
+public:
+  UskinFrameHistory(int capacity, int number_of_nodes);
+  ~UskinFrameHistory();
+
+  void push(long long timestamp_ns, const _uskin_node_time_unit_reading *frame);
+  void clear();
+
+  int size();
+  int getCapacity();
+  int getNumberOfNodes();
+
+  // Total number of frames pushed since creation, also counting overwritten ones
+  unsigned long long getFramesPushed();
+
+  // x, y, z values of all nodes of a single frame ([nodes x 3])
+  const int *getFrame(int index);
+  long long getTimestamp(int index);
+
+  // Last number_of_frames frames, oldest first, as contiguous [T x nodes x 3] values and [T] timestamps
+  const int *getWindow(int number_of_frames);
+  const long long *getWindowTimestamps(int number_of_frames);
+
+  // Frames with start_ns <= timestamp <= end_ns. Returns number of frames found and stores index of the first one
+  int findRange(long long start_ns, long long end_ns, int *first_index);
+
+  // Index of the frame closest in time, -1 if history is empty
+  int findNearest(long long timestamp_ns);
+
+  // Linear interpolation of all node values between the two frames around timestamp_ns ([nodes x 3]).
+  // Returns false if timestamp_ns is outside the stored time span
+  bool interpolate(long long timestamp_ns, float *output);
+};
+
+#endif
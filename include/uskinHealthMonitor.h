@@ -0,0 +1,102 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinHealthMonitor.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINHEALTHMONITOR_H
+#define USKINHEALTHMONITOR_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Data Structures #########################
+// Node health flags, published per node in _uskin_node_time_unit_reading::health_flags and OR-ed over the
+// frame in uskin_time_unit_reading::health_flags
+enum uskin_health_flag
+{
+  USKIN_NODE_DEAD = 1 << 0,      // Missing from the last dead_frames frames
+  USKIN_NODE_STUCK = 1 << 1,     // No axis has changed for stuck_time_ms
+  USKIN_NODE_NOISY = 1 << 2,     // Frame to frame changes above noise_threshold (standard deviation)
+  USKIN_NODE_SATURATED = 1 << 3  // Share of recent readings at a rail above saturated_ratio
+};
+
+struct uskin_health_config
+{
+  int dead_frames = 50;
+
+  long stuck_time_ms = 2000;
+
+  float noise_threshold = 2000; // Raw units
+
+  // A reading within rail_margin of 0 or of the axis maximum (XNODEMAXREAD, YNODEMAXREAD, ZNODEMAXREAD) hits a rail
+  int rail_margin = 100;
+  float saturated_ratio = 0.5;
+
+  // Weight of the newest frame in the noise variance and in the rail share (about 1 / frames averaged)
+  float smoothing = 0.01;
+};
+
+struct uskin_node_health
+{
+  unsigned int flags = 0;
+  float noise = 0;              // Standard deviation of the frame to frame change, largest axis
+  float rail_share = 0;         // Recent share of readings at a rail
+  long long last_change_ns = 0; // Timestamp of the last frame where any axis changed
+  unsigned long rail_hits = 0;  // Readings at a rail since the last reset
+  unsigned long missing_frames = 0; // Frames without this node since the last reset
+  int consecutive_missing = 0;
+};
+
+//###################### UskinHealthMonitor #########################
+// Incremental health of every node of a sensor, updated with each retrieved frame at a constant cost per node:
+// an exponentially weighted variance of the frame to frame change (West's update of Welford's algorithm),
+// the time since the last change, rail hits and missing frames
+class UskinHealthMonitor
+{
+private:
+  struct node_state
+  {
+    int previous[3];
+    float delta_mean[3];
+    float delta_variance[3];
+    bool seen;
+    uskin_node_health health;
+  };
+
+  const int number_of_nodes;
+
+  uskin_health_config config;
+
+  node_state *nodes;
+
+public:
+  UskinHealthMonitor(int number_of_nodes);
+  ~UskinHealthMonitor();
+
+  void configure(uskin_health_config new_config);
+
+  uskin_health_config getConfiguration();
+
+  void reset();
+
+  // Update with a new frame. received[i] tells whether node i was part of the frame; the flags of each node are
+  // written to its health_flags field. Returns the flags of all nodes OR-ed together
+  unsigned int process(_uskin_node_time_unit_reading *frame, const bool *received, long long timestamp_ns);
+
+  uskin_node_health getNodeHealth(int node);
+  unsigned int getFlags(int node);
+};
+
+#endif
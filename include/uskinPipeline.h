@@ -0,0 +1,223 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinPipeline.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINPIPELINE_H
+#define USKINPIPELINE_H
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <functional>
+
+#include "uskinCanDriver.h"
+
+#define USKIN_PIPELINE_CACHE_LINE 64 // Bytes
+
+//###################### UskinSpscQueue #########################
+// Bounded lock-free queue for one producer thread and one consumer thread. Capacity is rounded up to a power of two
+template <typename T>
+class UskinSpscQueue
+{
+private:
+  std::vector<T> buffer;
+  size_t mask;
+
+  // Head and tail are kept a cache line apart (and apart from the fields above and any object allocated after the
+  // queue) by explicit padding, so producer and consumer do not invalidate each other's line. Padding rather than
+  // alignas, which operator new does not honour before C++17
+  char head_padding[USKIN_PIPELINE_CACHE_LINE];
+  std::atomic<size_t> head; // Next slot to read (consumer)
+  char tail_padding[USKIN_PIPELINE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail; // Next slot to write (producer)
+  char end_padding[USKIN_PIPELINE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+
+public:
+  UskinSpscQueue(size_t minimum_capacity) : head(0), tail(0)
+  {
+    size_t capacity = 2;
+
+    while (capacity < minimum_capacity)
+      capacity <<= 1;
+
+    buffer.resize(capacity);
+    mask = capacity - 1;
+  }
+
+  bool push(const T &value)
+  {
+    size_t current_tail = tail.load(std::memory_order_relaxed);
+
+    if (current_tail - head.load(std::memory_order_acquire) > mask)
+      return false;
+
+    buffer[current_tail & mask] = value;
+    tail.store(current_tail + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool pop(T &value)
+  {
+    size_t current_head = head.load(std::memory_order_relaxed);
+
+    if (current_head == tail.load(std::memory_order_acquire))
+      return false;
+
+    value = buffer[current_head & mask];
+    head.store(current_head + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool empty()
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
+
+//###################### Data Structures #########################
+// Frame travelling through a pipeline. Frames come from a pool allocated when the pipeline is created, and only
+// the pointer is handed from stage to stage, so a frame belongs to exactly one stage at any time
+struct uskin_pipeline_frame
+{
+  unsigned long long sequence = 0;
+  long long timestamp_ns = 0;
+  int number_of_nodes = 0;
+  _uskin_node_time_unit_reading *nodes = NULL;
+  bool normalized = false;
+  bool discarded = false; // Set when a stage rejects the frame; later stages are skipped
+};
+
+//###################### UskinPipelineStage #########################
+class UskinPipelineStage
+{
+public:
+  virtual ~UskinPipelineStage(){};
+
+  // Called once per frame, on the thread the stage has been assigned to. Return false to discard the frame
+  virtual bool process(uskin_pipeline_frame *frame) = 0;
+
+  virtual std::string getName() = 0;
+};
+
+// Stage running a user function
+class UskinFunctionStage : public UskinPipelineStage
+{
+private:
+  std::string name;
+  std::function<bool(uskin_pipeline_frame *)> function;
+
+public:
+  UskinFunctionStage(std::string new_name, std::function<bool(uskin_pipeline_frame *)> new_function);
+
+  bool process(uskin_pipeline_frame *frame);
+  std::string getName();
+};
+
+// MinMax normalization with the sensor's current calibration. Frames are passed on unnormalized until the sensor is calibrated
+class UskinNormalizeStage : public UskinPipelineStage
+{
+private:
+  UskinSensor *sensor;
+
+public:
+  UskinNormalizeStage(UskinSensor *new_sensor);
+
+  bool process(uskin_pipeline_frame *frame);
+  std::string getName();
+};
+
+// Record frames in the CSV layout of UskinSensor::SaveData (raw values) or SaveNormalizedData (normalized values)
+class UskinCsvRecorderStage : public UskinPipelineStage
+{
+private:
+  std::ofstream csv_file;
+  bool record_normalized;
+  bool header_written = false;
+
+public:
+  UskinCsvRecorderStage(std::string filename, bool normalized = false);
+  ~UskinCsvRecorderStage();
+
+  bool isOpen();
+
+  bool process(uskin_pipeline_frame *frame);
+  std::string getName();
+};
+
+//###################### UskinPipeline #########################
+// source -> stages -> sinks processing of the frames of a sensor. The source (thread 0) retrieves frames with
+// UskinSensor::RetrieveFrameData and copies each one into a free frame of the pool. Stages are added in processing
+// order and assigned to numbered threads; consecutive stages on the same thread are called one after the other,
+// and a change of thread hands the frame over through a lock-free single producer / single consumer queue.
+// Thread numbers must not decrease along the pipeline. When every pool frame is in flight the source discards new
+// frames (counted in getFramesDropped) instead of blocking acquisition.
+// The pipeline turns off the sensor's automatic CSV recording while running (see UskinSensor::SetAutomaticRecording)
+class UskinPipeline
+{
+private:
+  struct segment
+  {
+    int thread_id;
+    int cpu = -1;
+    std::vector<UskinPipelineStage *> stages;
+    UskinSpscQueue<uskin_pipeline_frame *> *input = NULL; // NULL for the source segment
+    std::thread thread;
+    std::atomic<bool> finished; // Set when the thread has handed over its last frame
+  };
+
+  UskinSensor *sensor;
+
+  const int pool_size;
+  uskin_pipeline_frame *pool;
+  _uskin_node_time_unit_reading *pool_nodes;
+  UskinSpscQueue<uskin_pipeline_frame *> free_frames;
+
+  std::vector<segment *> segments;
+
+  std::atomic<bool> running;
+  std::atomic<unsigned long long> frames_processed;
+  std::atomic<unsigned long long> frames_dropped;
+  unsigned long long next_sequence = 0;
+
+  void sourceLoop();
+  void workerLoop(int segment_index);
+  void runSegment(int segment_index, uskin_pipeline_frame *frame);
+  void pinThread(int segment_index);
+
+public:
+  // The sensor must outlive the pipeline
+  UskinPipeline(UskinSensor *new_sensor, int new_pool_size = 64);
+  ~UskinPipeline();
+
+  // The pipeline takes ownership of stage. Stages can only be added while the pipeline is stopped
+  bool addStage(UskinPipelineStage *stage, int thread_id = 0);
+  bool addStage(std::string name, std::function<bool(uskin_pipeline_frame *)> function, int thread_id = 0);
+
+  // Pin a pipeline thread to a CPU core (applied when the pipeline starts)
+  void setThreadAffinity(int thread_id, int cpu);
+
+  // The sensor must have been started. The source stops by itself once the sensor's driver is finished (end of a
+  // replay), isRunning() is then false; stop() must still be called before starting again
+  bool start();
+  void stop();
+  bool isRunning();
+
+  unsigned long long getFramesProcessed();
+  unsigned long long getFramesDropped();
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinProbes.h
+ *
+ * USDT (SystemTap / DTrace style) static probes of provider "uskin", for perf, bpftrace or SystemTap.
+ * Probes are compiled in when <sys/sdt.h> is available (systemtap-sdt-dev / systemtap-sdt-devel) unless
+ * USKIN_DISABLE_PROBES is defined. A probe that nobody is attached to is a single nop instruction.
+ *
+ * Timestamps are nanoseconds since the epoch (CLOCK_REALTIME), as in uskin_time_unit_reading::timestamp_ns.
+ *
+ *   message_received (can_id, timestamp_ns)                    every CAN message read by CanDriver (kernel receive time)
+ *   frame_received   (can_id, index, timestamp_ns)             every node stored by UskinSensor::RetrieveFrameData
+ *   frame_completed  (frame_count, number_of_messages, timestamp_ns)
+ *   out_of_order     (can_id, previous_can_id)                 message held back for the next frame
+ *   normalize        (frame_count, timestamp_ns)               frame normalized
+ *   record_enqueued  (frame_count, timestamp_ns)               frame written to a CSV recording
+ *   sensor_start     (device_id)
+ *   sensor_stop      (device_id)
+ *
+ * e.g. frame period, and out of order messages per CAN ID:
+ *   bpftrace -e 'usdt:./main:uskin:frame_completed { if (@last) { @period_us = hist((nsecs - @last) / 1000); } @last = nsecs; }'
+ *   bpftrace -e 'usdt:./main:uskin:out_of_order { @[arg0] = count(); }'
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINPROBES_H
+#define USKINPROBES_H
+
+#if !defined(USKIN_DISABLE_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define USKIN_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef USKIN_PROBES_ENABLED
+
+#define USKIN_PROBE_MESSAGE_RECEIVED(can_id, timestamp_ns) DTRACE_PROBE2(uskin, message_received, can_id, timestamp_ns)
+#define USKIN_PROBE_FRAME_RECEIVED(can_id, index, timestamp_ns) DTRACE_PROBE3(uskin, frame_received, can_id, index, timestamp_ns)
+#define USKIN_PROBE_FRAME_COMPLETED(frame_count, number_of_messages, timestamp_ns) DTRACE_PROBE3(uskin, frame_completed, frame_count, number_of_messages, timestamp_ns)
+#define USKIN_PROBE_OUT_OF_ORDER(can_id, previous_can_id) DTRACE_PROBE2(uskin, out_of_order, can_id, previous_can_id)
+#define USKIN_PROBE_NORMALIZE(frame_count, timestamp_ns) DTRACE_PROBE2(uskin, normalize, frame_count, timestamp_ns)
+#define USKIN_PROBE_RECORD_ENQUEUED(frame_count, timestamp_ns) DTRACE_PROBE2(uskin, record_enqueued, frame_count, timestamp_ns)
+#define USKIN_PROBE_SENSOR_START(device_id) DTRACE_PROBE1(uskin, sensor_start, device_id)
+#define USKIN_PROBE_SENSOR_STOP(device_id) DTRACE_PROBE1(uskin, sensor_stop, device_id)
+
+#else
+
+#define USKIN_PROBE_MESSAGE_RECEIVED(can_id, timestamp_ns) ((void)0)
+#define USKIN_PROBE_FRAME_RECEIVED(can_id, index, timestamp_ns) ((void)0)
+#define USKIN_PROBE_FRAME_COMPLETED(frame_count, number_of_messages, timestamp_ns) ((void)0)
+#define USKIN_PROBE_OUT_OF_ORDER(can_id, previous_can_id) ((void)0)
+#define USKIN_PROBE_NORMALIZE(frame_count, timestamp_ns) ((void)0)
+#define USKIN_PROBE_RECORD_ENQUEUED(frame_count, timestamp_ns) ((void)0)
+#define USKIN_PROBE_SENSOR_START(device_id) ((void)0)
+#define USKIN_PROBE_SENSOR_STOP(device_id) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinReplay.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINREPLAY_H
+#define USKINREPLAY_H
+
+#include <fstream>
+#include <string>
+#include <time.h>
+
+#include "can_communication.h"
+
+// Size of the file read buffer. Files are streamed, so memory use does not depend on recording length
+#define USKIN_REPLAY_BUFFER_SIZE (1 << 20)
+
+//###################### Data Structures #########################
+enum uskin_replay_speed
+{
+  USKIN_REPLAY_RECORDED_SPEED, // Frames are delivered with the recorded time between them
+  USKIN_REPLAY_SCALED_SPEED,   // Recorded timing divided by a speed factor (2.0 plays twice as fast)
+  USKIN_REPLAY_AS_FAST_AS_POSSIBLE
+};
+
+//###################### ReplayCanDriver #########################
+// Frame source that plays back a recorded session through the regular CanDriver interface, so a
+// UskinSensor built on it (UskinSensor(columns, rows, new ReplayCanDriver(...))) goes through the same
+// RetrieveFrameData / GetFrameData / NormalizeData path as with live data.
+// Supported recordings: CSV files written by UskinSensor::SaveData, and raw CAN captures in candump log
+// or ASC format (files ending in .log or .asc), e.g. written by UskinSensor::SaveRawCanData or 'candump -l'
+class ReplayCanDriver : public CanDriver
+{
+private:
+  std::string file_name;
+
+  std::ifstream replay_file;
+  char *file_buffer = NULL;
+  std::string line;
+
+  // Raw CAN capture, used instead of replay_file for candump / ASC recordings
+  bool is_capture = false;
+  CandumpReader capture;
+
+  uskin_replay_speed speed_mode;
+  double speed_factor;
+
+  bool loop = false;
+  bool end_of_recording = false;
+
+  unsigned long frames_replayed = 0;
+
+  // Pacing: wall clock (CLOCK_MONOTONIC) and recorded time of the first frame replayed
+  struct timespec wall_start;
+  long long recorded_start_ns = -1;
+
+  bool readLine();
+  void waitUntilDue(long long recorded_ns);
+
+  int parseCSVLine(can_frame **receiving_frame, int frame_size);
+  int readCaptureFrames(can_frame **receiving_frame, int frame_size, int max_can_ID);
+
+public:
+  ReplayCanDriver(std::string recording, uskin_replay_speed new_speed_mode = USKIN_REPLAY_AS_FAST_AS_POSSIBLE, double new_speed_factor = 1.0);
+  ~ReplayCanDriver();
+
+  void setLoop(bool enable);
+  bool isFinished();
+  unsigned long getFramesReplayed();
+
+  int openConnection();
+  void closeConnection();
+  int requestData();
+  void stopData();
+
+  int readData(can_frame **receiving_frame, int frame_size, int max_can_ID);
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinSensorGroup.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINSENSORGROUP_H
+#define USKINSENSORGROUP_H
+
+#include <vector>
+#include <string>
+
+class UskinSensor;
+
+// Time allowed for every sensor to deliver its first frame after a group start
+#define USKIN_GROUP_FIRST_FRAME_TIMEOUT_MS 1000
+
+//###################### Data Structures #########################
+// Timestamps are CLOCK_REALTIME nanoseconds, the clock of the kernel receive timestamps
+struct uskin_group_sensor_report
+{
+  bool started = false;          // Start request sent
+  bool first_frame = false;      // A frame was received within the timeout
+  long long request_ns = 0;      // Time the start request was handed to the kernel
+  long long first_frame_ns = 0;  // Timestamp of the first frame retrieved
+  long long latency_ns = 0;      // first_frame_ns - request_ns
+  long long skew_ns = 0;         // first_frame_ns minus the earliest first frame of the group
+};
+
+//###################### UskinSensorGroup #########################
+// Starts and stops several sensors together. Every connection is opened first, then the start (or stop) requests
+// of all sensors are sent back to back: one sendmmsg per CAN interface, on a command socket the group keeps for
+// that interface, so patches sharing a bus start within microseconds instead of one socket setup apart.
+// Sensors without a CAN socket (e.g. ReplayCanDriver) are started one by one with their driver's requestData.
+// After a start, the first frame of every sensor is retrieved to measure its latency and the group's start skew.
+class UskinSensorGroup
+{
+private:
+  struct command_socket
+  {
+    std::string interface_name;
+    int s = -1;
+  };
+
+  std::vector<UskinSensor *> sensors;
+  std::vector<uskin_group_sensor_report> reports;
+  std::vector<command_socket> command_sockets;
+
+  bool started = false;
+
+  int getCommandSocket(std::string interface_name);
+  // Send the start (or stop) request of every sensor. Returns the number of requests sent
+  int sendRequests(bool start);
+  void measureFirstFrames(long timeout_ms);
+
+public:
+  UskinSensorGroup();
+  ~UskinSensorGroup();
+
+  // Sensors are not owned by the group and must not have been started. Returns the sensor's position in the group
+  int addSensor(UskinSensor *sensor);
+  int getNumberOfSensors();
+
+  // Returns true if every sensor was started. The first frame of each sensor is consumed by the measurement
+  bool start(long first_frame_timeout_ms = USKIN_GROUP_FIRST_FRAME_TIMEOUT_MS);
+  void stop();
+  bool isStarted();
+
+  uskin_group_sensor_report getSensorReport(int sensor);
+  // Spread between the earliest and latest first frame of the last start (sensors that delivered a frame)
+  long long getStartSkew();
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinSlipDetection.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINSLIPDETECTION_H
+#define USKINSLIPDETECTION_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "uskinFilters.h"
+
+#define USKIN_SLIP_MAX_WINDOW 64
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Data Structures #########################
+struct uskin_slip_config
+{
+  int window = 16; // Analysis window (frames), up to USKIN_SLIP_MAX_WINDOW
+
+  float sample_frequency = 1000; // Frame rate of the sensor (Hz)
+  float band_low_frequency = 100; // Vibration band (Hz), rounded to DFT bins of the window
+  float band_high_frequency = 400;
+
+  // Raw x/y units squared. A node starts slipping when either measure exceeds its threshold, and
+  // stops when both drop below half of it. A threshold of 0 disables that measure
+  float derivative_energy_threshold = 1e5; // Mean of dx^2 + dy^2 over the window
+  float band_power_threshold = 1e4;        // Mean square of x and y within the band
+};
+
+struct uskin_slip_event
+{
+  long long timestamp_ns; // Timestamp of the frame where slip was detected
+  int node;               // Node index
+  float derivative_energy;
+  float band_power;
+};
+
+//###################### UskinSlipDetector #########################
+// Streaming slip / vibration analysis of the x and y (shear) readings of every node. Per node it keeps
+// the sliding window energy of the frame to frame derivative and the power of a frequency band, given by
+// a sliding DFT of the band's bins. State is stored per axis as contiguous node arrays, and every update
+// processes 4 nodes per instruction. The DFT is recomputed from the window once per window length, so
+// floating point error of the sliding update does not accumulate
+class UskinSlipDetector
+{
+private:
+  const int number_of_nodes;
+  const int padded_nodes;
+
+  uskin_slip_config config;
+
+  int first_bin;
+  int number_of_bins;
+  float twiddle_cos[USKIN_SLIP_MAX_WINDOW]; // cos / sin of 2 * pi * m / window
+  float twiddle_sin[USKIN_SLIP_MAX_WINDOW];
+
+  float *input[2];      // x and y of the current frame
+  float *samples[2];    // Last window samples (window * padded_nodes), per axis
+  float *bin_real[2];   // DFT state (number_of_bins * padded_nodes), per axis
+  float *bin_imag[2];
+  float *squared_derivatives; // dx^2 + dy^2 of the last window frames (window * padded_nodes)
+  float *energy_sum;
+  float *derivative_energy;
+  float *band_power;
+
+  bool *slipping;
+
+  int position = 0; // Slot of the oldest sample in the window
+  bool state_initialized = false;
+
+  void seedState();
+  void recomputeState();
+
+public:
+  UskinSlipDetector(int number_of_nodes);
+  ~UskinSlipDetector();
+
+  void configure(uskin_slip_config new_config);
+
+  uskin_slip_config getConfiguration();
+
+  void reset();
+
+  // Update with a new frame. Nodes that start slipping are written to events (room for number_of_nodes events).
+  // Returns the number of events
+  int process(const _uskin_node_time_unit_reading *frame, long long timestamp_ns, uskin_slip_event *events);
+
+  const float *getDerivativeEnergy();
+  const float *getBandPower();
+  bool isSlipping(int node);
+};
+
+#endif
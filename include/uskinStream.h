@@ -0,0 +1,211 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinStream.h
+ *
+ * Local streaming of a sensor's frames to other processes over Unix domain datagram sockets or UDP on the loopback
+ * interface. Wire format (all fields little endian):
+ *
+ *   header (20 bytes): u32 magic "USKN", u8 version, u8 type, u16 content, u16 nodes, u16 frames, u32 sequence, u32 dropped
+ *
+ *   USKIN_STREAM_SUBSCRIBE (client -> server, renewed before the lease ends): header, u32 max rate (mHz, 0: every
+ *     frame), u16 max frames per datagram (0: as many as fit). content selects the values sent
+ *   USKIN_STREAM_UNSUBSCRIBE (client -> server): header only
+ *   USKIN_STREAM_FRAMES (server -> client): header, then frames times
+ *     i64 timestamp (ns, CLOCK_REALTIME), u64 frame number, [nodes x 3 u16 raw x y z], [nodes x 3 i8 normalized x y z]
+ *
+ * sequence counts the datagrams sent to the subscriber, so gaps are datagrams lost; dropped counts the frames the
+ * server could not send it since the previous datagram (overload). Frames left out by the subscriber's rate limit
+ * are not dropped.
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINSTREAM_H
+#define USKINSTREAM_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <sys/socket.h>
+
+class UskinSensor;
+
+#define USKIN_STREAM_MAGIC 0x4E4B5355 // "USKN"
+#define USKIN_STREAM_VERSION 1
+#define USKIN_STREAM_HEADER_SIZE 20
+#define USKIN_STREAM_MAX_DATAGRAM 60000
+
+#define USKIN_STREAM_DEFAULT_PATH "/tmp/uskin_stream.sock"
+#define USKIN_STREAM_DEFAULT_PORT 27100
+
+// A subscription ends if it is not renewed for this long; clients renew every third of it
+#define USKIN_STREAM_LEASE_MS 3000
+
+//###################### Data Structures #########################
+enum uskin_stream_transport
+{
+  USKIN_STREAM_UNIX, // Datagram socket at a path
+  USKIN_STREAM_UDP   // UDP on 127.0.0.1
+};
+
+enum uskin_stream_message
+{
+  USKIN_STREAM_SUBSCRIBE = 1,
+  USKIN_STREAM_UNSUBSCRIBE = 2,
+  USKIN_STREAM_FRAMES = 3
+};
+
+// Values carried per frame
+enum uskin_stream_content
+{
+  USKIN_STREAM_RAW = 1 << 0,
+  USKIN_STREAM_NORMALIZED = 1 << 1
+};
+
+struct uskin_stream_config
+{
+  uskin_stream_transport transport = USKIN_STREAM_UNIX;
+  std::string unix_path = USKIN_STREAM_DEFAULT_PATH;
+  int udp_port = USKIN_STREAM_DEFAULT_PORT;
+
+  int max_subscribers = 16;
+
+  int history_frames = 256; // Frame history enabled on the sensor if it has none (frames queued while the server sends)
+};
+
+struct uskin_stream_subscription
+{
+  double max_rate_hz = 0; // 0: every frame
+  unsigned int content = USKIN_STREAM_RAW | USKIN_STREAM_NORMALIZED;
+  int max_frames_per_datagram = 0; // 0: as many as fit. 1 for the lowest latency under load
+};
+
+// A received frame. Values are nodes * 3 (x, y, z per node), NULL if not subscribed to, and stay valid until the next receive
+struct uskin_stream_frame
+{
+  long long timestamp_ns;
+  unsigned long long frame_number;
+  const int *raw;
+  const int *normalized;
+};
+
+//###################### UskinStreamServer #########################
+// Publishes the frames of a sensor to the processes subscribed. The sensor's frames must be retrieved by another
+// thread (e.g. StartAcquisition); the server's thread wakes on every new frame and sends the frames queued since
+// the previous one in the frame history: one frame per datagram while it keeps up, several per datagram when frames
+// queue up (under load), so a busy host costs fewer system calls instead of more latency. Sends never block: a
+// subscriber whose socket is full loses those frames, not the others
+class UskinStreamServer
+{
+private:
+  struct subscriber
+  {
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    unsigned int content;
+    long long period_ns;
+    long long next_due_ns;
+    int max_frames;
+    uint32_t sequence;
+    unsigned long long dropped;
+    long long lease_end_ns;
+  };
+
+  UskinSensor *sensor;
+  uskin_stream_config config;
+  const int number_of_nodes;
+
+  int s = -1;
+
+  std::thread server_thread;
+  std::atomic<bool> running;
+
+  std::mutex subscribers_mutex; // Guards subscribers for getNumberOfSubscribers
+  std::vector<subscriber> subscribers;
+
+  // Frames read from the history, oldest first
+  std::vector<int> raw_values;
+  std::vector<int> normalized_values;
+  std::vector<long long> timestamps;
+  int batch_frames;
+
+  std::vector<int> selected; // Frames of the batch a subscriber gets after its rate limit
+  std::vector<uint8_t> datagram;
+
+  std::atomic<unsigned long long> datagrams_sent;
+  std::atomic<unsigned long long> frames_sent;
+
+  bool openSocket();
+  void handleRequests(long long now_ns);
+  void sendFrames(unsigned long long first_frame_number, int n_frames, unsigned long long dropped_frames);
+  void sendDatagram(subscriber &destination, const int *frame_indexes, int n_frames, unsigned long long first_frame_number);
+  void serverLoop();
+
+public:
+  UskinStreamServer(UskinSensor *new_sensor, uskin_stream_config new_config = uskin_stream_config());
+  ~UskinStreamServer();
+
+  bool start();
+  void stop();
+  bool isRunning();
+
+  int getNumberOfSubscribers();
+  unsigned long long getDatagramsSent();
+  unsigned long long getFramesSent();
+};
+
+//###################### UskinStreamClient #########################
+// Receiving side of a UskinStreamServer, renewing its subscription while it receives
+class UskinStreamClient
+{
+private:
+  int s = -1; // Connected to the server
+
+  uskin_stream_subscription subscription;
+  long long next_renewal_ns = 0;
+
+  int number_of_nodes = 0;
+  std::vector<uint8_t> datagram;
+  std::vector<int> raw_values;
+  std::vector<int> normalized_values;
+  std::vector<uskin_stream_frame> frames;
+
+  bool sequence_known = false;
+  uint32_t next_sequence = 0;
+  unsigned long long datagrams_lost = 0;
+  unsigned long long frames_dropped = 0;
+
+  bool connectTo(int family, const struct sockaddr *local, socklen_t local_length, const struct sockaddr *server, socklen_t server_length, uskin_stream_subscription new_subscription);
+  bool sendRequest(uskin_stream_message type);
+  int decode(int length);
+
+public:
+  UskinStreamClient();
+  ~UskinStreamClient();
+
+  bool connectUnix(std::string path = USKIN_STREAM_DEFAULT_PATH, uskin_stream_subscription new_subscription = uskin_stream_subscription());
+  bool connectUdp(int port = USKIN_STREAM_DEFAULT_PORT, uskin_stream_subscription new_subscription = uskin_stream_subscription());
+  void disconnect();
+
+  // Wait up to timeout_ms (-1: no limit) for a datagram. Returns the number of frames received (see getFrame), 0 on
+  // timeout and -1 on errors
+  int receive(long timeout_ms);
+  const uskin_stream_frame *getFrame(int frame);
+
+  int getNumberOfNodes();
+  unsigned long long getDatagramsLost();
+  unsigned long long getFramesDropped(); // Reported by the server
+  int getDescriptor();
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinTactileImage.h
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#ifndef USKINTACTILEIMAGE_H
+#define USKINTACTILEIMAGE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "uskinFilters.h"
+
+struct _uskin_node_time_unit_reading;
+
+//###################### Data Structures #########################
+enum uskin_interpolation
+{
+  USKIN_INTERPOLATION_BILINEAR,
+  USKIN_INTERPOLATION_BICUBIC // Keys cubic convolution (a = -0.5)
+};
+
+//###################### UskinTactileImage #########################
+// Renders the normalized x, y and z values of a frame into dense images (one per axis) of
+// output_rows x output_columns pixels. Image rows and columns follow the sensor's node rows and columns
+// (node index = column * rows + row), with pixel centers aligned to node centers as in image resizing.
+// Interpolation is separable: every axis is resampled along the columns and then along the rows by
+// multiplying with weight matrices precomputed at construction, in 4-lane vector loops. Images are stored
+// row-major with a row stride of getRowStride() floats (rows are padded to a multiple of 4)
+class UskinTactileImage
+{
+private:
+  const int rows;
+  const int columns;
+  const int output_rows;
+  const int output_columns;
+  const int stride;
+
+  uskin_interpolation method;
+
+  float *column_weights; // columns x stride: contribution of each node column to each output column
+  float *row_weights;    // output_rows x rows: contribution of each node row to each output row
+
+  float *grid;         // rows x columns values of the axis being rendered
+  float *intermediate; // rows x stride, grid resampled along the columns
+  float *image[3];
+
+  void computeWeights(float *weights, int input_size, int output_size, int weights_stride, bool output_major);
+
+public:
+  UskinTactileImage(int number_of_columns, int number_of_rows, int new_output_rows, int new_output_columns, uskin_interpolation new_method = USKIN_INTERPOLATION_BILINEAR);
+  ~UskinTactileImage();
+
+  void render(const _uskin_node_time_unit_reading *frame);
+
+  // Image of USKIN_AXIS_X, USKIN_AXIS_Y or USKIN_AXIS_Z
+  const float *getImage(int axis);
+  int getRowStride();
+  int getOutputRows();
+  int getOutputColumns();
+  uskin_interpolation getInterpolation();
+};
+
+#endif
@@ -0,0 +1,18 @@
+# Build the uskin Python module: python3 setup.py build_ext --inplace
+import glob
+import os
+
+from setuptools import Extension, setup
+
+here = os.path.dirname(os.path.abspath(__file__))
+
+uskin = Extension(
+    "uskin",
+    sources=[os.path.join(here, "uskin_module.cpp")] + sorted(glob.glob(os.path.join(here, "..", "src", "*.cpp"))),
+    include_dirs=[os.path.join(here, "..", "include")],
+    extra_compile_args=["-std=c++11", "-pthread"],
+    extra_link_args=["-pthread"],
+    language="c++",
+)
+
+setup(name="uskin", version="0.1", ext_modules=[uskin])
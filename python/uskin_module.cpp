@@ -0,0 +1,509 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskin_module.cpp
+ *
+ * Python bindings of UskinSensor. Frame data is exported with the buffer protocol, so
+ * numpy.asarray(sensor.raw) is a view of the driver's own memory (no copies per frame).
+ * Normalized values are only refreshed when the frame is normalized (normalize(), or
+ * start_acquisition(normalize=True)).
+ * Acquisition runs on UskinSensor's native thread, which never takes the GIL.
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+
+#include "../include/uskinCanDriver.h"
+#include "../include/uskinReplay.h"
+
+//###################### FrameView #########################
+// Read only, possibly strided, view of frame data owned by a Sensor object (or of a copy of it)
+
+typedef struct
+{
+  PyObject_HEAD
+  PyObject *owner; // Sensor (or bytes copy) the memory belongs to, kept alive while the view exists
+  char *data;
+  const char *format;
+  Py_ssize_t itemsize;
+  int ndim;
+  Py_ssize_t shape[3];
+  Py_ssize_t strides[3];
+} FrameViewObject;
+
+static void FrameView_dealloc(FrameViewObject *self)
+{
+  Py_XDECREF(self->owner);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int FrameView_getbuffer(FrameViewObject *self, Py_buffer *view, int flags)
+{
+  if (flags & PyBUF_WRITABLE)
+  {
+    PyErr_SetString(PyExc_BufferError, "uSkin frame views are read only");
+    return -1;
+  }
+
+  bool contiguous = self->strides[self->ndim - 1] == self->itemsize;
+  for (int i = self->ndim - 2; i >= 0; i--)
+    contiguous = contiguous && self->strides[i] == self->strides[i + 1] * self->shape[i + 1];
+
+  if (!contiguous && (flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+  {
+    PyErr_SetString(PyExc_BufferError, "uSkin frame view is not contiguous, a strided buffer must be requested");
+    return -1;
+  }
+
+  view->buf = self->data;
+  view->obj = (PyObject *)self;
+  Py_INCREF(self);
+  view->len = self->itemsize;
+  for (int i = 0; i < self->ndim; i++)
+    view->len *= self->shape[i];
+  view->readonly = 1;
+  view->itemsize = self->itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+  view->ndim = self->ndim;
+  view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+
+  return 0;
+}
+
+static PyBufferProcs FrameView_as_buffer = {
+    (getbufferproc)FrameView_getbuffer,
+    NULL,
+};
+
+static PyTypeObject FrameViewType = {
+    PyVarObject_HEAD_INIT(NULL, 0) "uskin.FrameView",
+};
+
+// View of one int / float field (x, y, z consecutive) of every node: shape (nodes, 3)
+static PyObject *newNodeFieldView(PyObject *owner, _uskin_node_time_unit_reading *frame, int number_of_nodes, size_t field_offset, const char *format, Py_ssize_t itemsize)
+{
+  FrameViewObject *view = PyObject_New(FrameViewObject, &FrameViewType);
+
+  if (view == NULL)
+    return NULL;
+
+  Py_INCREF(owner);
+  view->owner = owner;
+  view->data = (char *)frame + field_offset;
+  view->format = format;
+  view->itemsize = itemsize;
+  view->ndim = 2;
+  view->shape[0] = number_of_nodes;
+  view->shape[1] = 3;
+  view->strides[0] = sizeof(_uskin_node_time_unit_reading);
+  view->strides[1] = itemsize;
+
+  return (PyObject *)view;
+}
+
+//###################### Sensor #########################
+
+typedef struct
+{
+  PyObject_HEAD
+  UskinSensor *sensor;
+} SensorObject;
+
+static int Sensor_init(SensorObject *self, PyObject *args, PyObject *kwds)
+{
+  static const char *keywords[] = {"columns", "rows", "interface", "device_id", "replay", "replay_speed", NULL};
+  int columns = USKIN_COLUMNS, rows = USKIN_ROWS;
+  const char *interface = "can0";
+  unsigned int device_id = 0x201;
+  const char *replay = NULL;
+  double replay_speed = 0;
+  CanDriver *driver;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iisIzd", (char **)keywords, &columns, &rows, &interface, &device_id, &replay, &replay_speed))
+    return -1;
+
+  // Views handed out point into the sensor's frame, replacing it would free their memory
+  if (self->sensor != NULL)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Sensor is already initialized");
+    return -1;
+  }
+
+  if (columns <= 0 || rows <= 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "columns and rows must be positive");
+    return -1;
+  }
+
+  // replay_speed: 0 as fast as possible, 1 recorded speed, otherwise scaled
+  if (replay != NULL)
+    driver = new ReplayCanDriver(replay, replay_speed == 0 ? USKIN_REPLAY_AS_FAST_AS_POSSIBLE : (replay_speed == 1 ? USKIN_REPLAY_RECORDED_SPEED : USKIN_REPLAY_SCALED_SPEED), replay_speed);
+  else
+    driver = new CanDriver(interface, device_id);
+
+  self->sensor = new UskinSensor(columns, rows, driver);
+
+  return 0;
+}
+
+static void Sensor_dealloc(SensorObject *self)
+{
+  UskinSensor *sensor = self->sensor;
+
+  // Joins the acquisition thread
+  Py_BEGIN_ALLOW_THREADS
+  delete sensor;
+  Py_END_ALLOW_THREADS
+
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static bool checkSensor(SensorObject *self)
+{
+  if (self->sensor == NULL)
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Sensor has not been initialized");
+    return false;
+  }
+  return true;
+}
+
+static PyObject *Sensor_start(SensorObject *self, PyObject *Py_UNUSED(ignored))
+{
+  int result;
+
+  if (!checkSensor(self))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = self->sensor->StartSensor();
+  Py_END_ALLOW_THREADS
+
+  return PyBool_FromLong(result);
+}
+
+static PyObject *Sensor_stop(SensorObject *self, PyObject *Py_UNUSED(ignored))
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  self->sensor->StopSensor();
+  Py_END_ALLOW_THREADS
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sensor_calibrate(SensorObject *self, PyObject *args, PyObject *kwds)
+{
+  static const char *keywords[] = {"frames", "duration_ms", NULL};
+  int frames = 10;
+  long duration_ms = 0;
+  bool result;
+
+  if (!checkSensor(self) || !PyArg_ParseTupleAndKeywords(args, kwds, "|il", (char **)keywords, &frames, &duration_ms))
+    return NULL;
+
+  if (!self->sensor->get_sensor_status())
+  {
+    PyErr_SetString(PyExc_RuntimeError, "Sensor must be started before calibrating");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  std::future<bool> calibration = self->sensor->CalibrateSensorAsync(frames, duration_ms);
+
+  // Without the acquisition thread, frames are retrieved here
+  while (!self->sensor->get_sensor_acquisition_status() && calibration.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    self->sensor->RetrieveFrameData();
+
+  result = calibration.get();
+  Py_END_ALLOW_THREADS
+
+  return PyBool_FromLong(result);
+}
+
+static PyObject *Sensor_retrieve(SensorObject *self, PyObject *Py_UNUSED(ignored))
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  self->sensor->RetrieveFrameData();
+  Py_END_ALLOW_THREADS
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sensor_normalize(SensorObject *self, PyObject *Py_UNUSED(ignored))
+{
+  bool result;
+
+  if (!checkSensor(self))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = self->sensor->NormalizeData();
+  Py_END_ALLOW_THREADS
+
+  return PyBool_FromLong(result);
+}
+
+static PyObject *Sensor_start_acquisition(SensorObject *self, PyObject *args, PyObject *kwds)
+{
+  static const char *keywords[] = {"normalize", NULL};
+  int normalize = 1;
+
+  if (!checkSensor(self) || !PyArg_ParseTupleAndKeywords(args, kwds, "|p", (char **)keywords, &normalize))
+    return NULL;
+
+  return PyBool_FromLong(self->sensor->StartAcquisition(normalize));
+}
+
+static PyObject *Sensor_stop_acquisition(SensorObject *self, PyObject *Py_UNUSED(ignored))
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  self->sensor->StopAcquisition();
+  Py_END_ALLOW_THREADS
+
+  Py_RETURN_NONE;
+}
+
+static PyObject *Sensor_wait_frame(SensorObject *self, PyObject *args, PyObject *kwds)
+{
+  static const char *keywords[] = {"last_frame_count", "timeout_ms", NULL};
+  unsigned long last_frame_count;
+  long timeout_ms = 1000;
+  bool result;
+
+  if (!checkSensor(self) || !PyArg_ParseTupleAndKeywords(args, kwds, "k|l", (char **)keywords, &last_frame_count, &timeout_ms))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  result = self->sensor->WaitForFrame(last_frame_count, timeout_ms);
+  Py_END_ALLOW_THREADS
+
+  return PyBool_FromLong(result);
+}
+
+static PyObject *Sensor_enable_history(SensorObject *self, PyObject *args)
+{
+  int frames;
+
+  if (!checkSensor(self) || !PyArg_ParseTuple(args, "i", &frames))
+    return NULL;
+
+  if (self->sensor->get_sensor_acquisition_status())
+  {
+    PyErr_SetString(PyExc_RuntimeError, "History must be enabled before starting acquisition");
+    return NULL;
+  }
+
+  self->sensor->EnableFrameHistory(frames);
+
+  Py_RETURN_NONE;
+}
+
+// Last 'frames' frames as a (frames, nodes, 3) array. Copied under the sensor's frame lock: the ring is overwritten as
+// frames arrive and is replaced when the history is enabled again, so a view of it could be torn or outlive it
+static PyObject *Sensor_history(SensorObject *self, PyObject *args)
+{
+  int frames;
+  bool copied;
+
+  if (!checkSensor(self) || !PyArg_ParseTuple(args, "i", &frames))
+    return NULL;
+
+  if (frames <= 0)
+  {
+    PyErr_SetString(PyExc_ValueError, "frames must be positive");
+    return NULL;
+  }
+
+  int number_of_nodes = self->sensor->GetUskinFrameSize();
+  PyObject *copy = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)frames * number_of_nodes * 3 * sizeof(int));
+
+  if (copy == NULL)
+    return NULL;
+
+  int *values = (int *)PyBytes_AS_STRING(copy);
+
+  Py_BEGIN_ALLOW_THREADS
+  copied = self->sensor->CopyLastFrames(frames, values);
+  Py_END_ALLOW_THREADS
+
+  if (!copied)
+  {
+    Py_DECREF(copy);
+    PyErr_SetString(PyExc_ValueError, "History is disabled or does not hold that many frames");
+    return NULL;
+  }
+
+  FrameViewObject *view = PyObject_New(FrameViewObject, &FrameViewType);
+
+  if (view == NULL)
+  {
+    Py_DECREF(copy);
+    return NULL;
+  }
+
+  view->owner = copy; // The view keeps the only reference to the copy
+  view->data = PyBytes_AS_STRING(copy);
+  view->format = "i";
+  view->itemsize = sizeof(int);
+  view->ndim = 3;
+  view->shape[0] = frames;
+  view->shape[1] = number_of_nodes;
+  view->shape[2] = 3;
+  view->strides[2] = sizeof(int);
+  view->strides[1] = 3 * sizeof(int);
+  view->strides[0] = view->shape[1] * 3 * sizeof(int);
+
+  return (PyObject *)view;
+}
+
+static PyObject *Sensor_get_raw(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return newNodeFieldView((PyObject *)self, self->sensor->GetFrameData(), self->sensor->GetUskinFrameSize(), offsetof(_uskin_node_time_unit_reading, x_value), "i", sizeof(int));
+}
+
+static PyObject *Sensor_get_normalized(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return newNodeFieldView((PyObject *)self, self->sensor->GetFrameData(), self->sensor->GetUskinFrameSize(), offsetof(_uskin_node_time_unit_reading, x_value_normalized), "i", sizeof(int));
+}
+
+static PyObject *Sensor_get_filtered(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return newNodeFieldView((PyObject *)self, self->sensor->GetFrameData(), self->sensor->GetUskinFrameSize(), offsetof(_uskin_node_time_unit_reading, x_value_filtered), "f", sizeof(float));
+}
+
+static PyObject *Sensor_get_frame_count(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return PyLong_FromUnsignedLong(self->sensor->GetFrameCount());
+}
+
+static PyObject *Sensor_get_timestamp_ns(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return PyLong_FromLongLong(self->sensor->GetFrameTimestamp());
+}
+
+static PyObject *Sensor_get_frame_size(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return PyLong_FromLong(self->sensor->GetUskinFrameSize());
+}
+
+static PyObject *Sensor_get_calibrated(SensorObject *self, void *closure)
+{
+  if (!checkSensor(self))
+    return NULL;
+
+  return PyBool_FromLong(self->sensor->get_sensor_calibration_status());
+}
+
+static PyMethodDef Sensor_methods[] = {
+    {"start", (PyCFunction)Sensor_start, METH_NOARGS, "Open connection and request data from the sensor"},
+    {"stop", (PyCFunction)Sensor_stop, METH_NOARGS, "Stop acquisition and data transmission"},
+    {"calibrate", (PyCFunction)Sensor_calibrate, METH_VARARGS | METH_KEYWORDS, "calibrate(frames=10, duration_ms=0): collect a new baseline, sensor must be at rest"},
+    {"retrieve", (PyCFunction)Sensor_retrieve, METH_NOARGS, "Read one frame (when not using the acquisition thread)"},
+    {"normalize", (PyCFunction)Sensor_normalize, METH_NOARGS, "Normalize the current frame, returns False if the sensor is not calibrated"},
+    {"start_acquisition", (PyCFunction)Sensor_start_acquisition, METH_VARARGS | METH_KEYWORDS, "start_acquisition(normalize=True): retrieve frames on a native thread"},
+    {"stop_acquisition", (PyCFunction)Sensor_stop_acquisition, METH_NOARGS, "Stop the acquisition thread"},
+    {"wait_frame", (PyCFunction)Sensor_wait_frame, METH_VARARGS | METH_KEYWORDS, "wait_frame(last_frame_count, timeout_ms=1000): wait for a newer frame, GIL released"},
+    {"enable_history", (PyCFunction)Sensor_enable_history, METH_VARARGS, "enable_history(frames): keep the last frames retrieved"},
+    {"history", (PyCFunction)Sensor_history, METH_VARARGS, "history(frames): (frames, nodes, 3) copy of the last raw frames"},
+    {NULL},
+};
+
+static PyGetSetDef Sensor_getset[] = {
+    {(char *)"raw", (getter)Sensor_get_raw, NULL, (char *)"(nodes, 3) int32 view of raw x, y, z values", NULL},
+    {(char *)"normalized", (getter)Sensor_get_normalized, NULL, (char *)"(nodes, 3) int32 view of normalized x, y, z values, current after normalize() or with start_acquisition(normalize=True)", NULL},
+    {(char *)"filtered", (getter)Sensor_get_filtered, NULL, (char *)"(nodes, 3) float32 view of filtered x, y, z values", NULL},
+    {(char *)"frame_count", (getter)Sensor_get_frame_count, NULL, (char *)"Number of frames retrieved", NULL},
+    {(char *)"timestamp_ns", (getter)Sensor_get_timestamp_ns, NULL, (char *)"Timestamp of the current frame", NULL},
+    {(char *)"frame_size", (getter)Sensor_get_frame_size, NULL, (char *)"Number of nodes", NULL},
+    {(char *)"calibrated", (getter)Sensor_get_calibrated, NULL, (char *)"True once a calibration has completed", NULL},
+    {NULL},
+};
+
+static PyTypeObject SensorType = {
+    PyVarObject_HEAD_INIT(NULL, 0) "uskin.Sensor",
+};
+
+//###################### Module #########################
+
+static PyModuleDef uskin_module = {
+    PyModuleDef_HEAD_INIT,
+    "uskin",
+    "uSkin tactile sensor driver. Frame views support the buffer protocol: numpy.asarray(sensor.raw) does not copy.",
+    -1,
+    NULL,
+};
+
+PyMODINIT_FUNC PyInit_uskin(void)
+{
+  PyObject *module;
+
+  FrameViewType.tp_basicsize = sizeof(FrameViewObject);
+  FrameViewType.tp_dealloc = (destructor)FrameView_dealloc;
+  FrameViewType.tp_flags = Py_TPFLAGS_DEFAULT;
+  FrameViewType.tp_doc = "Read only view of uSkin frame data (buffer protocol)";
+  FrameViewType.tp_as_buffer = &FrameView_as_buffer;
+
+  SensorType.tp_basicsize = sizeof(SensorObject);
+  SensorType.tp_dealloc = (destructor)Sensor_dealloc;
+  SensorType.tp_flags = Py_TPFLAGS_DEFAULT;
+  SensorType.tp_doc = "Sensor(columns=6, rows=4, interface='can0', device_id=0x201, replay=None, replay_speed=0.0)";
+  SensorType.tp_methods = Sensor_methods;
+  SensorType.tp_getset = Sensor_getset;
+  SensorType.tp_init = (initproc)Sensor_init;
+  SensorType.tp_new = PyType_GenericNew;
+
+  if (PyType_Ready(&FrameViewType) < 0 || PyType_Ready(&SensorType) < 0)
+    return NULL;
+
+  if ((module = PyModule_Create(&uskin_module)) == NULL)
+    return NULL;
+
+  Py_INCREF(&SensorType);
+  if (PyModule_AddObject(module, "Sensor", (PyObject *)&SensorType) < 0)
+  {
+    Py_DECREF(&SensorType);
+    Py_DECREF(module);
+    return NULL;
+  }
+
+  return module;
+}
@@ -0,0 +1,135 @@
+# Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+#                Queen Mary University of London, London, UK
+# Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+# CopyPolicy: Released under the terms of the GNU GPL v3.0.
+"""Client of UskinStreamServer (include/uskinStream.h) with the standard library only.
+
+    client = StreamClient.unix()            # or StreamClient.udp()
+    while True:
+        for frame in client.receive(timeout=1.0):
+            print(frame.frame_number, frame.normalized[2])
+"""
+
+import socket
+import struct
+import time
+
+MAGIC = 0x4E4B5355
+VERSION = 1
+SUBSCRIBE, UNSUBSCRIBE, FRAMES = 1, 2, 3
+RAW, NORMALIZED = 1, 2
+
+DEFAULT_PATH = "/tmp/uskin_stream.sock"
+DEFAULT_PORT = 27100
+LEASE_S = 3.0
+
+_header = struct.Struct("<IBBHHHII")
+_frame_header = struct.Struct("<qQ")
+
+
+class Frame(object):
+    """Values are tuples of nodes * 3 (x, y, z per node), None if not subscribed to."""
+
+    __slots__ = ("timestamp_ns", "frame_number", "raw", "normalized")
+
+    def __init__(self, timestamp_ns, frame_number, raw, normalized):
+        self.timestamp_ns = timestamp_ns
+        self.frame_number = frame_number
+        self.raw = raw
+        self.normalized = normalized
+
+
+class StreamClient(object):
+    def __init__(self, family, local, server, max_rate_hz=0, content=RAW | NORMALIZED, max_frames_per_datagram=0):
+        self.sock = socket.socket(family, socket.SOCK_DGRAM)
+        self.sock.bind(local)
+        self.sock.connect(server)
+        self.request = struct.pack("<IH", int(max_rate_hz * 1000 + 0.5), max_frames_per_datagram)
+        self.content = content
+        self.next_sequence = None
+        self.datagrams_lost = 0
+        self.frames_dropped = 0
+        self._subscribe()
+
+    @classmethod
+    def unix(cls, path=DEFAULT_PATH, **subscription):
+        return cls(socket.AF_UNIX, "", path, **subscription)  # "": the kernel picks an abstract name
+
+    @classmethod
+    def udp(cls, port=DEFAULT_PORT, **subscription):
+        return cls(socket.AF_INET, ("127.0.0.1", 0), ("127.0.0.1", port), **subscription)
+
+    def _send(self, message_type, payload=b""):
+        try:
+            self.sock.send(_header.pack(MAGIC, VERSION, message_type, self.content, 0, 0, 0, 0) + payload)
+        except (ConnectionRefusedError, FileNotFoundError):  # No server yet
+            pass
+
+    def _subscribe(self):
+        self._send(SUBSCRIBE, self.request)
+        self.next_renewal = time.monotonic() + LEASE_S / 3
+
+    def receive(self, timeout=None):
+        """Frames of the next datagram, [] on timeout (None: no limit)."""
+        deadline = None if timeout is None else time.monotonic() + timeout
+
+        while True:
+            now = time.monotonic()
+            if now >= self.next_renewal:
+                self._subscribe()
+
+            wait = self.next_renewal - now
+            if deadline is not None:
+                wait = min(wait, deadline - now)
+            self.sock.settimeout(max(wait, 0))
+
+            try:
+                frames = self._decode(self.sock.recv(65536))
+                if frames:
+                    return frames
+            except (socket.timeout, BlockingIOError, ConnectionRefusedError):
+                pass
+
+            if deadline is not None and time.monotonic() >= deadline:
+                return []
+
+    def _decode(self, datagram):
+        if len(datagram) < _header.size:
+            return None
+
+        magic, version, message_type, content, nodes, n_frames, sequence, dropped = _header.unpack_from(datagram)
+        values = nodes * 3
+        frame_size = _frame_header.size + (values * 2 if content & RAW else 0) + (values if content & NORMALIZED else 0)
+
+        if magic != MAGIC or version != VERSION or message_type != FRAMES or len(datagram) != _header.size + n_frames * frame_size:
+            return None
+
+        if self.next_sequence is not None:
+            self.datagrams_lost += (sequence - self.next_sequence) & 0xFFFFFFFF
+        self.next_sequence = (sequence + 1) & 0xFFFFFFFF
+        self.frames_dropped += dropped
+
+        raw_format = struct.Struct("<%dH" % values)
+        normalized_format = struct.Struct("<%db" % values)
+        frames = []
+        offset = _header.size
+
+        for _ in range(n_frames):
+            timestamp_ns, frame_number = _frame_header.unpack_from(datagram, offset)
+            offset += _frame_header.size
+            raw = normalized = None
+
+            if content & RAW:
+                raw = raw_format.unpack_from(datagram, offset)
+                offset += raw_format.size
+            if content & NORMALIZED:
+                normalized = normalized_format.unpack_from(datagram, offset)
+                offset += normalized_format.size
+
+            frames.append(Frame(timestamp_ns, frame_number, raw, normalized))
+
+        return frames
+
+    def close(self):
+        self._send(UNSUBSCRIBE)
+        self.sock.close()
@@ -32,7 +32,14 @@ CanDriver::CanDriver(__u32 new_device_id)
     device_id = new_device_id;
 }
 
-CanDriver::~CanDriver(){};
+CanDriver::~CanDriver()
+{
+    closeReceiveRing();
+    stopCandumpLog();
+
+    if (s >= 0)
+        close(s);
+};
 
 //###################### Utils #########################
 
@@ -99,6 +106,13 @@ int CanDriver::openConnection()
 
     logInfo(1, ">> CanDriver::open_connection()");
 
+    // Reconnecting (e.g. StartSensor after StopSensor) replaces the previous socket and ring
+    closeReceiveRing();
+    if (s >= 0)
+        close(s);
+    pending_messages.clear();
+    temporary_reading_available = false;
+
     if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0)
     {
         logError(2, "Error while opening socket");
@@ -117,6 +131,8 @@ int CanDriver::openConnection()
 
     if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
     {
+        close(s);
+        s = -1;
         logError(2, "Error in socket bind");
         logInfo(1, "<< CanDriver::open_connection()");
 
@@ -141,11 +157,121 @@ int CanDriver::openConnection()
 
     logInfo(2, "new current sock_buf_size" + std::to_string(sock_buf_size));
 
+    if (mmap_receive_enabled)
+    {
+        if (!openReceiveRing())
+        {
+            logError(2, "Error while setting up the receive ring");
+            logInfo(1, "<< CanDriver::open_connection()");
+
+            return 0;
+        }
+
+        // Incoming frames are now read from the ring, so the raw socket does not need to queue them
+        setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+    }
+
     logInfo(1, "<< CanDriver::open_connection()");
 
     return 1;
 }
 
+// Select the PACKET_MMAP receive path. Ring geometry is given in blocks; a block is handed over to user space when full or after block_timeout_ms
+void CanDriver::enableMmapReceive(unsigned int block_size, unsigned int block_number, unsigned int block_timeout_ms)
+{
+    memset(&ring_request, 0, sizeof(ring_request));
+    ring_request.tp_block_size = block_size;
+    ring_request.tp_block_nr = block_number;
+    ring_request.tp_frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + sizeof(struct can_frame));
+    ring_request.tp_frame_nr = (block_size / ring_request.tp_frame_size) * block_number;
+    ring_request.tp_retire_blk_tov = block_timeout_ms;
+
+    mmap_receive_enabled = true;
+}
+
+// Bind an AF_PACKET socket with a TPACKET_V3 ring to the CAN interface and map the ring in memory
+int CanDriver::openReceiveRing()
+{
+    logInfo(2, ">> CanDriver::openReceiveRing()");
+
+    int version = TPACKET_V3;
+    struct sockaddr_ll link_addr;
+
+    if ((packet_socket = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_CAN))) < 0)
+    {
+        logError(3, "Error while opening packet socket");
+        return 0;
+    }
+
+    if (setsockopt(packet_socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(packet_socket, SOL_PACKET, PACKET_RX_RING, &ring_request, sizeof(ring_request)) < 0)
+    {
+        logError(3, "Error while requesting TPACKET_V3 ring");
+        closeReceiveRing();
+        return 0;
+    }
+
+    ring_buffer = (__u8 *)mmap(NULL, ring_request.tp_block_size * ring_request.tp_block_nr, PROT_READ | PROT_WRITE, MAP_SHARED, packet_socket, 0);
+
+    if (ring_buffer == MAP_FAILED)
+    {
+        ring_buffer = NULL;
+        logError(3, "Error while mapping receive ring");
+        closeReceiveRing();
+        return 0;
+    }
+
+    memset(&link_addr, 0, sizeof(link_addr));
+    link_addr.sll_family = AF_PACKET;
+    link_addr.sll_protocol = htons(ETH_P_CAN);
+    link_addr.sll_ifindex = ifr.ifr_ifindex;
+
+    if (bind(packet_socket, (struct sockaddr *)&link_addr, sizeof(link_addr)) < 0)
+    {
+        logError(3, "Error in packet socket bind");
+        closeReceiveRing();
+        return 0;
+    }
+
+    ring_current_block = 0;
+    ring_block_in_use = false;
+    ring_frames_left = 0;
+
+    logInfo(2, "<< CanDriver::openReceiveRing()");
+
+    return 1;
+}
+
+void CanDriver::closeReceiveRing()
+{
+    if (ring_buffer != NULL)
+    {
+        munmap(ring_buffer, ring_request.tp_block_size * ring_request.tp_block_nr);
+        ring_buffer = NULL;
+    }
+
+    if (packet_socket >= 0)
+    {
+        close(packet_socket);
+        packet_socket = -1;
+    }
+}
+
+void CanDriver::closeConnection()
+{
+    closeReceiveRing();
+
+    if (s >= 0)
+    {
+        close(s);
+        s = -1;
+    }
+
+    pending_messages.clear();
+    temporary_reading_available = false;
+    data_requested = false;
+}
+
 // Send message to the sensor
 int CanDriver::sendMessage(can_frame sending_frame)
 {
@@ -170,7 +296,7 @@ int CanDriver::sendMessage(can_frame sending_frame)
 }
 
 // Read message from the sensor
-int CanDriver::readMessage(can_frame *receiving_frame)
+int CanDriver::readMessage(can_frame *receiving_frame, bool wait)
 {
     logInfo(2, ">> CanDriver::read_message()");
     int nbytes;
@@ -178,19 +304,48 @@ int CanDriver::readMessage(can_frame *receiving_frame)
 
     socklen_t len = sizeof(addr);
 
+    if (mmap_receive_enabled)
+    {
+        if (!readMessageFromRing(receiving_frame, wait))
+        {
+            logError(3, "Error while reading receive ring");
+            logInfo(2, "<< CanDriver::read_message(-1)");
+
+            return 0;
+        }
+
+        if (candump_writer != NULL)
+            candump_writer->writeFrame(receiving_frame, &last_frame_timestamp);
+
+        USKIN_PROBE_MESSAGE_RECEIVED(receiving_frame->can_id, last_frame_timestamp.tv_sec * 1000000000LL + last_frame_timestamp.tv_nsec);
+
+        logInfo(2, canFrameToString(receiving_frame));
+
+        logInfo(2, "<< CanDriver::read_message()");
+
+        return 1;
+    }
+
     //nbytes = read(s, receiving_frame, sizeof(struct can_frame));
     nbytes = recvfrom(s, receiving_frame, sizeof(struct can_frame),
-                      0, (struct sockaddr *)&addr, &len);
+                      wait ? 0 : MSG_DONTWAIT, (struct sockaddr *)&addr, &len);
+    int read_error = errno;
 
     struct timeval tv;
-    ioctl(s, SIOCGSTAMP, &tv);
+    if (ioctl(s, SIOCGSTAMP, &tv) < 0) // No kernel timestamp (e.g. not a CAN socket), use the time of reading
+        gettimeofday(&tv, NULL);
     logInfo(3, ">> Reading at: " + std::to_string(tv.tv_sec) + "." + std::to_string(tv.tv_usec));
 
+    last_frame_timestamp.tv_sec = tv.tv_sec;
+    last_frame_timestamp.tv_nsec = tv.tv_usec * 1000;
+
     if (nbytes < 0)
     {
-        logError(3, "Error while reading raw socket");
+        if (wait || (read_error != EAGAIN && read_error != EWOULDBLOCK))
+            logError(3, "Error while reading raw socket");
         logInfo(2, "<< CanDriver::read_message(-1)");
 
+        errno = read_error;
         return 0;
     }
 
@@ -203,6 +358,11 @@ int CanDriver::readMessage(can_frame *receiving_frame)
         return 0;
     }
 
+    if (candump_writer != NULL)
+        candump_writer->writeFrame(receiving_frame, &last_frame_timestamp);
+
+    USKIN_PROBE_MESSAGE_RECEIVED(receiving_frame->can_id, last_frame_timestamp.tv_sec * 1000000000LL + last_frame_timestamp.tv_nsec);
+
     logInfo(2, canFrameToString(receiving_frame));
 
     logInfo(2, "<< CanDriver::read_message()");
@@ -210,27 +370,84 @@ int CanDriver::readMessage(can_frame *receiving_frame)
     return 1;
 }
 
+// Read next message straight from the shared receive ring. Only blocks (in poll) when the kernel has no retired block for us
+int CanDriver::readMessageFromRing(can_frame *receiving_frame, bool wait)
+{
+    for (;;)
+    {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *)(ring_buffer + ring_current_block * ring_request.tp_block_size);
+
+        if (!ring_block_in_use)
+        {
+            if (!(block->hdr.bh1.block_status & TP_STATUS_USER))
+            {
+                struct pollfd pfd;
+                pfd.fd = packet_socket;
+                pfd.events = POLLIN | POLLERR;
+                pfd.revents = 0;
+
+                int ready = poll(&pfd, 1, wait ? -1 : 0);
+
+                if (ready < 0 && errno != EINTR)
+                    return 0;
+
+                if (ready == 0 && !wait)
+                {
+                    errno = EAGAIN;
+                    return 0;
+                }
+
+                continue;
+            }
+
+            ring_block_in_use = true;
+            ring_frames_left = block->hdr.bh1.num_pkts;
+            ring_current_frame = (struct tpacket3_hdr *)((__u8 *)block + block->hdr.bh1.offset_to_first_pkt);
+        }
+
+        if (ring_frames_left == 0)
+        {
+            // Block fully consumed, hand it back to the kernel
+            __sync_synchronize();
+            block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            ring_block_in_use = false;
+            ring_current_block = (ring_current_block + 1) % ring_request.tp_block_nr;
+            continue;
+        }
+
+        struct tpacket3_hdr *packet = ring_current_frame;
+        struct sockaddr_ll *link_addr = (struct sockaddr_ll *)((__u8 *)packet + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        can_frame *ring_frame = (can_frame *)((__u8 *)packet + packet->tp_mac);
+
+        ring_current_frame = (struct tpacket3_hdr *)((__u8 *)packet + packet->tp_next_offset);
+        ring_frames_left--;
+
+        // Skip frames we sent ourselves (the packet socket also sees outgoing and requested traffic)
+        if (link_addr->sll_pkttype == PACKET_OUTGOING || packet->tp_snaplen < sizeof(struct can_frame) || ring_frame->can_id == device_id)
+            continue;
+
+        *receiving_frame = *ring_frame;
+        last_frame_timestamp.tv_sec = packet->tp_sec;
+        last_frame_timestamp.tv_nsec = packet->tp_nsec;
+
+        return 1;
+    }
+}
+
 // Request the sensor to start reading data
 int CanDriver::requestData()
 {
     int return_value = 1;
     logInfo(1, ">> CanDriver::request_data()");
 
-    struct can_frame sending_frame;
-
-    sending_frame.can_id = device_id;
-    sending_frame.can_dlc = 2; /* frame payload length in byte (0 .. 8) */
-    sending_frame.data[0] = 0x07;
-    sending_frame.data[1] = 0x00;
-
-    if (!sendMessage(sending_frame))
+    if (!sendMessage(getDataRequestFrame(true)))
     {
         return_value = 0;
         logError(2, "<< Problems Requesting Data");
     }
     else
     {
-        data_requested = true;
+        setDataRequested(true);
     }
 
     logInfo(1, "<< CanDriver::request_data()");
@@ -242,20 +459,53 @@ int CanDriver::requestData()
 void CanDriver::stopData()
 {
     logInfo(1, ">> CanDriver::stop_data()");
+
+    sendMessage(getDataRequestFrame(false));
+
+    setDataRequested(false);
+
+    logInfo(1, "<< CanDriver::stop_data()");
+
+    return;
+}
+
+// Start (0x07 0x00) or stop (0x07 0x01) request of this device
+can_frame CanDriver::getDataRequestFrame(bool start)
+{
     struct can_frame sending_frame;
 
+    memset(&sending_frame, 0, sizeof(sending_frame));
     sending_frame.can_id = device_id;
     sending_frame.can_dlc = 2; /* frame payload length in byte (0 .. 8) */
     sending_frame.data[0] = 0x07;
-    sending_frame.data[1] = 0x01;
+    sending_frame.data[1] = start ? 0x00 : 0x01;
 
-    sendMessage(sending_frame);
+    return sending_frame;
+}
 
-    CanDriver::data_requested = false;
+void CanDriver::setDataRequested(bool requested)
+{
+    data_requested = requested;
 
-    logInfo(1, "<< CanDriver::stop_data()");
+    if (requested)
+        USKIN_PROBE_SENSOR_START(device_id);
+    else
+        USKIN_PROBE_SENSOR_STOP(device_id);
+}
 
-    return;
+std::string CanDriver::getInterfaceName()
+{
+    return ifname;
+}
+
+int CanDriver::getSocket()
+{
+    return s;
+}
+
+int CanDriver::getReceiveDescriptor()
+{
+    return mmap_receive_enabled ? packet_socket : s;
 }
 
 // Read a stream of data form the sensor. Stream lenght is defined by frame_size
@@ -315,16 +565,17 @@ int CanDriver::readData(can_frame **receiving_frame, int frame_size, int max_can
         if (!CanDriver::readMessage(receiving_frame[i]))
         {
             logError(2, "Problems reading data");
-            free(receiving_frame[i]);
+            delete receiving_frame[i];
             return retreived_elements;
         }
 
         if (i > 0 && !checkMessagesIdOrder(convert_dec_to_24bit_hex(receiving_frame[i]->can_id), convert_dec_to_24bit_hex(receiving_frame[i - 1]->can_id)))
         {
             logError(2, "Problems with messages order");
+            USKIN_PROBE_OUT_OF_ORDER(receiving_frame[i]->can_id, receiving_frame[i - 1]->can_id);
             temporary_reading = *receiving_frame[i];
             temporary_reading_available = true;
-            free(receiving_frame[i]);
+            delete receiving_frame[i];
             // for (int j = 0; j <= i; j++)
             // {
             //     delete receiving_frame[j];
@@ -347,6 +598,116 @@ int CanDriver::readData(can_frame **receiving_frame, int frame_size, int max_can
     return retreived_elements;
 }
 
+int CanDriver::pollData(can_frame **receiving_frame, int frame_size, int max_can_ID)
+{
+    logInfo(1, ">> CanDriver::poll_data()");
+
+    if (!data_requested)
+    {
+        logError(2, "You must first request data from the sensor");
+        logInfo(1, "<< CanDriver::poll_data()");
+        return -1;
+    }
+
+    if (is_filter_set)
+    {
+        setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+        is_filter_set = false;
+    }
+
+    // Message that ended the previous frame out of order (also shared with readData)
+    if (temporary_reading_available)
+    {
+        pending_messages.push_back(temporary_reading);
+        temporary_reading_available = false;
+    }
+
+    bool read_failed = false;
+
+    // Same frame boundaries as readData: the message with max_can_ID, frame_size messages or an out of order message
+    while ((int)pending_messages.size() < frame_size)
+    {
+        can_frame message;
+
+        errno = 0;
+        if (!CanDriver::readMessage(&message, false))
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                logInfo(1, "<< CanDriver::poll_data(0)");
+                return 0;
+            }
+
+            logError(2, "Problems reading data");
+            read_failed = true;
+            break;
+        }
+
+        if (!pending_messages.empty() && !checkMessagesIdOrder(convert_dec_to_24bit_hex(message.can_id), convert_dec_to_24bit_hex(pending_messages.back().can_id)))
+        {
+            logError(2, "Problems with messages order");
+            USKIN_PROBE_OUT_OF_ORDER(message.can_id, pending_messages.back().can_id);
+            temporary_reading = message;
+            temporary_reading_available = true;
+            break;
+        }
+
+        pending_messages.push_back(message);
+
+        if ((int)convert_dec_to_24bit_hex(message.can_id) == max_can_ID)
+            break;
+    }
+
+    int retreived_elements = pending_messages.size();
+
+    for (int i = 0; i < retreived_elements; i++)
+        receiving_frame[i] = new can_frame(pending_messages[i]);
+
+    pending_messages.clear();
+
+    logInfo(1, "<< CanDriver::poll_data()");
+
+    return retreived_elements == 0 && read_failed ? -1 : retreived_elements;
+}
+
+// Kernel receive timestamp of the last frame returned by readMessage
+struct timespec CanDriver::getLastFrameTimestamp()
+{
+    return last_frame_timestamp;
+}
+
+bool CanDriver::isFinished()
+{
+    return false;
+}
+
+// Start copying received traffic to a candump log file
+int CanDriver::startCandumpLog(std::string file_name)
+{
+    logInfo(1, ">> CanDriver::startCandumpLog(" + file_name + ")");
+
+    stopCandumpLog();
+
+    candump_writer = new CandumpWriter;
+
+    if (!candump_writer->openFile(file_name, ifname))
+    {
+        logError(2, "Problems creating candump log");
+        stopCandumpLog();
+        return 0;
+    }
+
+    logInfo(1, "<< CanDriver::startCandumpLog()");
+
+    return 1;
+}
+
+void CanDriver::stopCandumpLog()
+{
+    delete candump_writer;
+    candump_writer = NULL;
+}
+
 // Read a filtered stream of data form the sensor. Stream lenght is defined by frame_size.
 /* can_frame **CanDriver::readData(int number_of_filters, struct can_filter *rfilter)
 {
@@ -0,0 +1,459 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file candumpLog.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../include/can_communication.h"
+#include "../include/candumpLog.h"
+
+//###################### Utils #########################
+
+static inline int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static inline bool isBlank(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+// Parse decimal digits without reading past line_end (the mapped file is not NUL terminated)
+static inline const char *parseDecimal(const char *cursor, const char *line_end, long *value, int *digits)
+{
+  *value = 0;
+  *digits = 0;
+
+  while (cursor < line_end && *cursor >= '0' && *cursor <= '9')
+  {
+    *value = *value * 10 + (*cursor++ - '0');
+    (*digits)++;
+  }
+
+  return cursor;
+}
+
+// seconds[.fraction], fraction of any number of digits
+static inline const char *parseTimestamp(const char *cursor, const char *line_end, struct timespec *timestamp)
+{
+  long value;
+  int digits;
+
+  cursor = parseDecimal(cursor, line_end, &value, &digits);
+  timestamp->tv_sec = value;
+  timestamp->tv_nsec = 0;
+
+  if (digits > 0 && cursor < line_end && *cursor == '.')
+  {
+    int fraction_digits = 0;
+
+    // Digits beyond nanoseconds are ignored
+    for (cursor++; cursor < line_end && *cursor >= '0' && *cursor <= '9'; cursor++)
+    {
+      if (fraction_digits < 9)
+      {
+        timestamp->tv_nsec = timestamp->tv_nsec * 10 + (*cursor - '0');
+        fraction_digits++;
+      }
+    }
+
+    for (; fraction_digits < 9; fraction_digits++)
+      timestamp->tv_nsec *= 10;
+  }
+
+  return digits > 0 ? cursor : NULL;
+}
+
+#ifdef __SSE2__
+// Decode exactly 16 hex characters into 8 bytes. Returns false if any of them is not a hex digit
+static inline bool decodeHex16(const char *text, __u8 *data)
+{
+  __m128i characters = _mm_loadu_si128((const __m128i *)text);
+
+  // Lower case letters; digits already have the 0x20 bit set
+  __m128i lower = _mm_or_si128(characters, _mm_set1_epi8(0x20));
+  __m128i is_letter = _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1));
+  __m128i values = _mm_sub_epi8(lower, _mm_set1_epi8('0'));
+  values = _mm_sub_epi8(values, _mm_and_si128(is_letter, _mm_set1_epi8('a' - '0' - 10)));
+
+  // Every value must be within [0, 15], and characters other than letters within [0, 9] (e.g. ':' would give 10)
+  __m128i out_of_range = _mm_or_si128(_mm_cmpgt_epi8(values, _mm_set1_epi8(15)), _mm_cmplt_epi8(values, _mm_setzero_si128()));
+  out_of_range = _mm_or_si128(out_of_range, _mm_andnot_si128(is_letter, _mm_cmpgt_epi8(values, _mm_set1_epi8(9))));
+
+  if (_mm_movemask_epi8(out_of_range))
+    return false;
+
+  // Each 16 bit lane holds (high nibble, low nibble) of one byte
+  __m128i high = _mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00ff)), 4);
+  __m128i low = _mm_srli_epi16(values, 8);
+  __m128i bytes = _mm_packus_epi16(_mm_or_si128(high, low), _mm_setzero_si128());
+
+  _mm_storel_epi64((__m128i *)data, bytes);
+
+  return true;
+}
+#endif
+
+int decodeHexPayload(const char *text, __u8 *data, int number_of_bytes)
+{
+#ifdef __SSE2__
+  if (number_of_bytes == 8 && decodeHex16(text, data))
+    return 8;
+#endif
+
+  for (int i = 0; i < number_of_bytes; i++)
+  {
+    int high = hexValue(text[2 * i]);
+    int low = high < 0 ? -1 : hexValue(text[2 * i + 1]);
+
+    if (low < 0)
+      return i;
+
+    data[i] = high << 4 | low;
+  }
+
+  return number_of_bytes;
+}
+
+//###################### CandumpReader #########################
+
+CandumpReader::CandumpReader(){};
+
+CandumpReader::~CandumpReader()
+{
+  closeFile();
+};
+
+int CandumpReader::openFile(std::string file_name)
+{
+  logInfo(1, ">> CandumpReader::openFile(" + file_name + ")");
+
+  struct stat file_status;
+
+  closeFile();
+
+  if ((file_descriptor = open(file_name.c_str(), O_RDONLY)) < 0 || fstat(file_descriptor, &file_status) < 0)
+  {
+    logError(2, "Could not open capture " + file_name);
+    closeFile();
+    return 0;
+  }
+
+  file_size = file_status.st_size;
+
+  if (file_size > 0)
+  {
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+      logError(2, "Could not map capture " + file_name);
+      closeFile();
+      return 0;
+    }
+
+    madvise(mapping, file_size, MADV_SEQUENTIAL);
+    file_data = (const char *)mapping;
+  }
+
+  position = 0;
+  lines_skipped = 0;
+
+  logInfo(1, "<< CandumpReader::openFile()");
+
+  return 1;
+}
+
+void CandumpReader::closeFile()
+{
+  if (file_data != NULL)
+    munmap((void *)file_data, file_size);
+
+  if (file_descriptor >= 0)
+    close(file_descriptor);
+
+  file_data = NULL;
+  file_descriptor = -1;
+  file_size = 0;
+  position = 0;
+}
+
+void CandumpReader::rewind()
+{
+  position = 0;
+}
+
+unsigned long CandumpReader::getLinesSkipped()
+{
+  return lines_skipped;
+}
+
+// (seconds.microseconds) interface ID#DATA
+bool CandumpReader::parseLogLine(const char *line, const char *line_end, can_frame *frame, struct timespec *timestamp)
+{
+  const char *cursor = parseTimestamp(line + 1, line_end, timestamp);
+
+  if (cursor == NULL || cursor >= line_end || *cursor != ')')
+    return false;
+
+  // Skip interface name
+  cursor++;
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+  while (cursor < line_end && !isBlank(*cursor))
+    cursor++;
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+
+  const char *id_start = cursor;
+  frame->can_id = 0;
+
+  while (cursor < line_end && hexValue(*cursor) >= 0)
+    frame->can_id = frame->can_id << 4 | hexValue(*cursor++);
+
+  if (cursor == id_start || cursor >= line_end || *cursor != '#')
+    return false;
+
+  if (cursor - id_start > 3)
+    frame->can_id |= CAN_EFF_FLAG;
+
+  cursor++;
+
+  // CAN FD ("##") frames do not fit in a can_frame
+  if (cursor < line_end && *cursor == '#')
+    return false;
+
+  if (cursor < line_end && (*cursor == 'R' || *cursor == 'r'))
+  {
+    frame->can_id |= CAN_RTR_FLAG;
+    frame->can_dlc = 0;
+    return true;
+  }
+
+  int payload_length = (line_end - cursor) / 2;
+
+  if (payload_length > CAN_MAX_DLEN)
+    payload_length = CAN_MAX_DLEN;
+
+  frame->can_dlc = decodeHexPayload(cursor, frame->data, payload_length);
+
+  return true;
+}
+
+// time channel ID direction d DLC byte0 byte1 ...
+bool CandumpReader::parseASCLine(const char *line, const char *line_end, can_frame *frame, struct timespec *timestamp)
+{
+  const char *cursor = parseTimestamp(line, line_end, timestamp);
+  long value;
+  int digits;
+
+  if (cursor == NULL || cursor >= line_end || !isBlank(*cursor))
+    return false;
+
+  // Channel number
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+
+  cursor = parseDecimal(cursor, line_end, &value, &digits);
+
+  if (digits == 0)
+    return false;
+
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+
+  const char *id_start = cursor;
+  frame->can_id = 0;
+
+  while (cursor < line_end && hexValue(*cursor) >= 0)
+    frame->can_id = frame->can_id << 4 | hexValue(*cursor++);
+
+  if (cursor == id_start)
+    return false;
+
+  if (cursor < line_end && *cursor == 'x')
+  {
+    frame->can_id |= CAN_EFF_FLAG;
+    cursor++;
+  }
+
+  // Direction (Rx / Tx) followed by 'd' for data frames
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+  while (cursor < line_end && !isBlank(*cursor))
+    cursor++;
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+
+  if (cursor >= line_end || *cursor != 'd')
+    return false;
+
+  cursor++;
+  while (cursor < line_end && isBlank(*cursor))
+    cursor++;
+
+  cursor = parseDecimal(cursor, line_end, &value, &digits);
+  int dlc = value;
+
+  if (digits == 0 || dlc > CAN_MAX_DLEN)
+    return false;
+
+  for (int i = 0; i < dlc; i++)
+  {
+    while (cursor < line_end && isBlank(*cursor))
+      cursor++;
+
+    if (cursor + 2 > line_end || decodeHexPayload(cursor, &frame->data[i], 1) != 1)
+      return false;
+
+    cursor += 2;
+  }
+
+  frame->can_dlc = dlc;
+
+  return true;
+}
+
+int CandumpReader::readFrame(can_frame *frame, struct timespec *timestamp)
+{
+  while (position < file_size)
+  {
+    const char *line = file_data + position;
+    const char *line_end = (const char *)memchr(line, '\n', file_size - position);
+
+    if (line_end == NULL)
+      line_end = file_data + file_size;
+
+    position = line_end - file_data + 1;
+
+    while (line < line_end && isBlank(*line))
+      line++;
+
+    // Trailing carriage return of files written on Windows
+    if (line_end > line && line_end[-1] == '\r')
+      line_end--;
+
+    memset(frame, 0, sizeof(can_frame));
+
+    if (line < line_end && *line == '(' && parseLogLine(line, line_end, frame, timestamp))
+      return 1;
+
+    if (line < line_end && *line >= '0' && *line <= '9' && parseASCLine(line, line_end, frame, timestamp))
+      return 1;
+
+    lines_skipped++;
+  }
+
+  return 0;
+}
+
+//###################### CandumpWriter #########################
+
+CandumpWriter::CandumpWriter(){};
+
+CandumpWriter::~CandumpWriter()
+{
+  closeFile();
+};
+
+int CandumpWriter::openFile(std::string file_name, std::string new_interface_name)
+{
+  logInfo(1, ">> CandumpWriter::openFile(" + file_name + ")");
+
+  closeFile();
+
+  if ((file = fopen(file_name.c_str(), "w")) == NULL)
+  {
+    logError(2, "Could not create capture " + file_name);
+    return 0;
+  }
+
+  file_buffer = new char[CANDUMP_WRITE_BUFFER_SIZE];
+  setvbuf(file, file_buffer, _IOFBF, CANDUMP_WRITE_BUFFER_SIZE);
+
+  interface_name = new_interface_name;
+
+  logInfo(1, "<< CandumpWriter::openFile()");
+
+  return 1;
+}
+
+void CandumpWriter::closeFile()
+{
+  if (file != NULL)
+    fclose(file);
+
+  file = NULL;
+
+  delete[] file_buffer;
+  file_buffer = NULL;
+}
+
+bool CandumpWriter::isOpen()
+{
+  return file != NULL;
+}
+
+void CandumpWriter::writeFrame(const can_frame *frame, const struct timespec *timestamp)
+{
+  static const char hex_digits[] = "0123456789ABCDEF";
+  char line[96];
+  int length;
+
+  if (file == NULL)
+    return;
+
+  length = snprintf(line, 48, "(%010ld.%06ld) %s ", (long)timestamp->tv_sec, timestamp->tv_nsec / 1000, interface_name.c_str());
+
+  if (length < 0 || length >= 48)
+    return;
+
+  int id_digits = frame->can_id & CAN_EFF_FLAG ? 8 : 3;
+  canid_t can_id = frame->can_id & (frame->can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK);
+
+  for (int i = id_digits - 1; i >= 0; i--)
+    line[length++] = hex_digits[(can_id >> (4 * i)) & 0xf];
+
+  line[length++] = '#';
+
+  if (frame->can_id & CAN_RTR_FLAG)
+  {
+    line[length++] = 'R';
+  }
+  else
+  {
+    for (int i = 0; i < frame->can_dlc && i < CAN_MAX_DLEN; i++)
+    {
+      line[length++] = hex_digits[frame->data[i] >> 4];
+      line[length++] = hex_digits[frame->data[i] & 0xf];
+    }
+  }
+
+  line[length++] = '\n';
+
+  fwrite(line, 1, length, file);
+}
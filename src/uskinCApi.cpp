@@ -0,0 +1,304 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinCApi.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <chrono>
+#include <new>
+#include <vector>
+#include "../include/uskinCApi.h"
+#include "../include/uskinCanDriver.h"
+#include "../include/uskinReplay.h"
+
+static_assert(sizeof(int32_t) == sizeof(int), "Frame buffers are shared with UskinSensor as int");
+static_assert(sizeof(int64_t) == sizeof(long long), "Timestamps are shared with UskinSensor as long long");
+
+struct uskin_sensor
+{
+  UskinSensor *sensor;
+  unsigned long long next_frame; // Sequence number of the next frame returned by uskin_read_frames
+};
+
+// No C++ exception may cross the C boundary: every exported function catches them and returns its failure value
+static uskin_sensor *createHandle(int columns, int rows, CanDriver *driver, int history_frames)
+{
+  if (driver == NULL)
+    return NULL;
+
+  uskin_sensor *handle = new (std::nothrow) uskin_sensor;
+
+  if (handle == NULL)
+  {
+    delete driver;
+    return NULL;
+  }
+
+  handle->sensor = NULL;
+  handle->next_frame = 0;
+
+  try
+  {
+    handle->sensor = new UskinSensor(columns, rows, driver);
+
+    if (history_frames > 0)
+      handle->sensor->EnableFrameHistory(history_frames);
+  }
+  catch (...)
+  {
+    // Once constructed, the sensor owns the driver
+    if (handle->sensor != NULL)
+      delete handle->sensor;
+    else
+      delete driver;
+
+    delete handle;
+    return NULL;
+  }
+
+  return handle;
+}
+
+uskin_sensor *uskin_create(int columns, int rows, const char *interface_name, uint32_t device_id, int history_frames)
+{
+  if (columns <= 0 || rows <= 0 || interface_name == NULL)
+    return NULL;
+
+  try
+  {
+    return createHandle(columns, rows, new CanDriver(interface_name, device_id), history_frames);
+  }
+  catch (...)
+  {
+    return NULL;
+  }
+}
+
+uskin_sensor *uskin_create_replay(int columns, int rows, const char *recording, double speed, int history_frames)
+{
+  if (columns <= 0 || rows <= 0 || recording == NULL)
+    return NULL;
+
+  uskin_replay_speed speed_mode = speed == 0 ? USKIN_REPLAY_AS_FAST_AS_POSSIBLE : (speed == 1 ? USKIN_REPLAY_RECORDED_SPEED : USKIN_REPLAY_SCALED_SPEED);
+
+  try
+  {
+    return createHandle(columns, rows, new ReplayCanDriver(recording, speed_mode, speed), history_frames);
+  }
+  catch (...)
+  {
+    return NULL;
+  }
+}
+
+void uskin_destroy(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return;
+
+  delete sensor->sensor; // Destructors do not throw
+  delete sensor;
+}
+
+int uskin_start(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    return sensor->sensor->StartSensor() ? 1 : 0;
+  }
+  catch (...)
+  {
+    return 0;
+  }
+}
+
+int uskin_stop(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    return sensor->sensor->StopSensor() ? 1 : 0;
+  }
+  catch (...)
+  {
+    return 0;
+  }
+}
+
+int uskin_calibrate(uskin_sensor *sensor, int frames, long duration_ms)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    if (!sensor->sensor->get_sensor_status())
+      return 0;
+
+    std::future<bool> calibration = sensor->sensor->CalibrateSensorAsync(frames, duration_ms);
+
+    // Without the acquisition thread, frames are retrieved here
+    while (!sensor->sensor->get_sensor_acquisition_status() && calibration.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      sensor->sensor->RetrieveFrameData();
+
+    return calibration.get() ? 1 : 0;
+  }
+  catch (...)
+  {
+    return 0;
+  }
+}
+
+int uskin_is_calibrated(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return 0;
+
+  return sensor->sensor->get_sensor_calibration_status() ? 1 : 0;
+}
+
+int uskin_set_fixed_point_normalization(uskin_sensor *sensor, int fixed_point)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    sensor->sensor->SetNormalizationMode(fixed_point ? USKIN_NORMALIZATION_FIXED_POINT : USKIN_NORMALIZATION_FLOAT);
+  }
+  catch (...)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+int uskin_start_acquisition(uskin_sensor *sensor, int normalize)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    return sensor->sensor->StartAcquisition(normalize != 0) ? 1 : 0;
+  }
+  catch (...)
+  {
+    return 0;
+  }
+}
+
+int uskin_stop_acquisition(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    sensor->sensor->StopAcquisition();
+  }
+  catch (...)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+int uskin_frame_size(uskin_sensor *sensor)
+{
+  if (sensor == NULL)
+    return -1;
+
+  return sensor->sensor->GetUskinFrameSize();
+}
+
+int uskin_read_frame(uskin_sensor *sensor, int32_t *raw, int32_t *normalized, int64_t *timestamp_ns)
+{
+  if (sensor == NULL)
+    return 0;
+
+  try
+  {
+    if (!sensor->sensor->get_sensor_status())
+      return 0;
+
+    if (!sensor->sensor->get_sensor_acquisition_status())
+    {
+      sensor->sensor->RetrieveFrameData();
+
+      if (normalized != NULL)
+        sensor->sensor->NormalizeData();
+    }
+
+    sensor->sensor->CopyFrameData(raw, normalized, (long long *)timestamp_ns);
+  }
+  catch (...)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+int uskin_read_frames(uskin_sensor *sensor, int max_frames, int32_t *raw, int32_t *normalized, int64_t *timestamps, uint64_t *dropped_frames)
+{
+  unsigned long long dropped = 0;
+
+  if (sensor == NULL || max_frames < 0 || sensor->sensor->GetFrameHistory() == NULL)
+    return -1;
+
+  int frames_copied;
+
+  try
+  {
+    frames_copied = sensor->sensor->CopyQueuedFrames(&sensor->next_frame, max_frames, raw, normalized, (long long *)timestamps, &dropped);
+  }
+  catch (...)
+  {
+    return -1;
+  }
+
+  if (dropped_frames != NULL)
+    *dropped_frames = dropped;
+
+  return frames_copied;
+}
+
+int uskin_get_calibration(uskin_sensor *sensor, uint32_t *min_readings)
+{
+  if (sensor == NULL || min_readings == NULL)
+    return 0;
+
+  try
+  {
+    // Copied under the sensor's calibration lock: an asynchronous calibration may swap the baseline in meanwhile
+    std::vector<unsigned long int> calibration(sensor->sensor->GetUskinFrameSize() * 3);
+
+    if (!sensor->sensor->CopyCalibrationValues(calibration.data()))
+      return 0;
+
+    for (size_t i = 0; i < calibration.size(); i++)
+      min_readings[i] = calibration[i];
+  }
+  catch (...)
+  {
+    return 0;
+  }
+
+  return 1;
+}
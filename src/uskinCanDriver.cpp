@@ -14,6 +14,7 @@
 
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "../include/uskinCanDriver.h"
 
 //###################### Utils #########################
@@ -67,6 +68,15 @@ UskinSensor::UskinSensor() : frame_columns(USKIN_COLUMNS), frame_rows(USKIN_ROWS
   frame_reading->instant_reading = new struct _uskin_node_time_unit_reading[frame_size];
   frame_reading->number_of_nodes = frame_size;
 
+  normalized_generation = new unsigned long[frame_size]();
+  force_generation = new unsigned long[frame_size]();
+  poll_buffer = new can_frame *[frame_size];
+
+  calibration_in_progress = false;
+  acquisition_running = false;
+  frames_retrieved = 0;
+  automatic_recording = true;
+
   return;
 };
 
@@ -80,6 +90,15 @@ UskinSensor::UskinSensor(std::string new_log_file) : frame_columns(USKIN_COLUMNS
   frame_reading->instant_reading = new struct _uskin_node_time_unit_reading[frame_size];
   frame_reading->number_of_nodes = frame_size;
 
+  normalized_generation = new unsigned long[frame_size]();
+  force_generation = new unsigned long[frame_size]();
+  poll_buffer = new can_frame *[frame_size];
+
+  calibration_in_progress = false;
+  acquisition_running = false;
+  frames_retrieved = 0;
+  automatic_recording = true;
+
   return;
 };
 
@@ -93,6 +112,15 @@ UskinSensor::UskinSensor(int column_nodes, int row_nodes) : frame_columns(column
   frame_reading->instant_reading = new struct _uskin_node_time_unit_reading[frame_size];
   frame_reading->number_of_nodes = frame_size;
 
+  normalized_generation = new unsigned long[frame_size]();
+  force_generation = new unsigned long[frame_size]();
+  poll_buffer = new can_frame *[frame_size];
+
+  calibration_in_progress = false;
+  acquisition_running = false;
+  frames_retrieved = 0;
+  automatic_recording = true;
+
   return;
 };
 
@@ -106,26 +134,82 @@ UskinSensor::UskinSensor(int column_nodes, int row_nodes, std::string new_log_fi
   frame_reading->instant_reading = new struct _uskin_node_time_unit_reading[frame_size];
   frame_reading->number_of_nodes = frame_size;
 
+  normalized_generation = new unsigned long[frame_size]();
+  force_generation = new unsigned long[frame_size]();
+  poll_buffer = new can_frame *[frame_size];
+
+  calibration_in_progress = false;
+  acquisition_running = false;
+  frames_retrieved = 0;
+  automatic_recording = true;
+
+  return;
+};
+
+// The sensor takes ownership of new_driver, which can be any CanDriver derived frame source (e.g. ReplayCanDriver)
+UskinSensor::UskinSensor(int column_nodes, int row_nodes, CanDriver *new_driver) : frame_size(column_nodes * row_nodes), frame_columns(column_nodes), frame_rows(row_nodes)
+{
+  open_log_file(log_file);
+
+  driver = new_driver;
+
+  frame_reading = new uskin_time_unit_reading;
+  frame_reading->instant_reading = new struct _uskin_node_time_unit_reading[frame_size];
+  frame_reading->number_of_nodes = frame_size;
+
+  normalized_generation = new unsigned long[frame_size]();
+  force_generation = new unsigned long[frame_size]();
+  poll_buffer = new can_frame *[frame_size];
+
+  calibration_in_progress = false;
+  acquisition_running = false;
+  frames_retrieved = 0;
+  automatic_recording = true;
+
   return;
 };
 
 UskinSensor::~UskinSensor()
 {
+  StopAcquisition();
+
   delete driver;
-  delete frame_reading->instant_reading;
+  delete frame_filter;
+  delete frame_history;
+  delete contact_features;
+  delete slip_detector;
+  delete[] slip_events;
+  delete tactile_image;
+  delete force_calibration;
+  delete health_monitor;
+  delete[] node_received;
+  delete decimator;
+  delete[] normalized_generation;
+  delete[] force_generation;
+  delete[] poll_buffer;
+
+  if (calibration_in_progress)
+  {
+    calibration_promise.set_value(false);
+    calibration_in_progress = false;
+  }
+  delete[] calibration_min_reads;
+  delete[] frame_reading->instant_reading;
   delete frame_reading;
 
-  if (get_sensor_calibration_status())
+  if (frame_min_reads != NULL)
   {
     for (int i = 0; i < frame_size; i++)
     {
-      delete frame_min_reads[i];
-      // delete frame_max_reads[i];
+      delete[] frame_min_reads[i];
+      // delete[] frame_max_reads[i];
     }
-    delete frame_min_reads;
-    // delete frame_max_reads;
+    delete[] frame_min_reads;
+    // delete[] frame_max_reads;
   }
 
+  delete[] fixed_point_scales;
+
   if (data_is_being_saved)
     csv_file.close();
 };
@@ -150,6 +234,22 @@ int UskinSensor::convertIndextoCanID(int index)
   return can_id;
 }
 
+// Switch the CAN driver to the PACKET_MMAP receive ring
+void UskinSensor::EnableMmapReceive()
+{
+  logInfo(1, ">> UskinSensor::EnableMmapReceive()");
+
+  if (sensor_has_started)
+  {
+    logError(2, "Receive mode must be selected before starting the sensor");
+    return;
+  }
+
+  driver->enableMmapReceive();
+
+  logInfo(1, "<< UskinSensor::EnableMmapReceive()");
+}
+
 // Open connection and request data
 int UskinSensor::StartSensor()
 {
@@ -180,6 +280,8 @@ int UskinSensor::StopSensor()
 {
   logInfo(1, ">> UskinSensor::StopSensor()");
 
+  StopAcquisition();
+
   driver->stopData();
   sensor_has_started = 0;
 
@@ -215,41 +317,272 @@ void UskinSensor::CalibrateSensor()
     return;
   }
 
-  // If sensor has been calibrated before, structures have already been created
-  if (get_sensor_calibration_status())
+  std::future<bool> calibration = CalibrateSensorAsync(10); // Minimum values out of 10 frame readings
+
+  // Retrieve frames on this thread until the calibration stage has collected enough of them, unless the acquisition thread already does
+  if (acquisition_running)
+    calibration.wait();
+
+  while (calibration.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    RetrieveFrameData();
+
+  calibration.get();
+
+  logInfo(1, "<< UskinSensor::CalibrateSensor()");
+};
+
+// Start collecting minimum readings from the frames retrieved from now on. Previous calibration values
+// stay in use (and normalization keeps working) until the new ones are complete
+std::future<bool> UskinSensor::CalibrateSensorAsync(int number_of_frames, long duration_ms, std::function<void(bool)> callback)
+{
+  logInfo(1, ">> UskinSensor::CalibrateSensorAsync(" + std::to_string(number_of_frames) + ", " + std::to_string(duration_ms) + ")");
+
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  if (calibration_in_progress)
+  {
+    logError(2, "A calibration is already in progress");
+
+    std::promise<bool> rejected;
+    rejected.set_value(false);
+
+    logInfo(1, "<< UskinSensor::CalibrateSensorAsync()");
+
+    return rejected.get_future();
+  }
+
+  if (calibration_min_reads == NULL)
+    calibration_min_reads = new unsigned long int[frame_size * 3];
+
+  for (int i = 0; i < frame_size * 3; i++)
+    calibration_min_reads[i] = 65000;
+
+  calibration_frames_left = number_of_frames;
+  calibration_valid_frames = 0;
+  calibration_deadline_ns = 0;
+
+  if (duration_ms > 0)
+  {
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+    calibration_deadline_ns = current_time.tv_sec * 1000000000LL + current_time.tv_nsec + duration_ms * 1000000LL;
+  }
+
+  calibration_callback = callback;
+  calibration_promise = std::promise<bool>();
+  calibration_in_progress = true;
+
+  logInfo(1, "<< UskinSensor::CalibrateSensorAsync()");
+
+  return calibration_promise.get_future();
+}
+
+// Calibration stage: accumulate minimum readings of the frame just retrieved. Called with frame_mutex held, so the
+// completion callback is returned to be run once it has been released (it may read the frame)
+std::function<void()> UskinSensor::updateCalibration(bool frame_is_valid)
+{
+  std::unique_lock<std::mutex> lock(calibration_mutex);
+
+  if (!calibration_in_progress)
+    return nullptr;
+
+  if (frame_is_valid)
   {
-    // Disabling the flag so that data retrieved is not normalized
-    sensor_is_calibrated = 0;
+    for (int i = 0; i < frame_size; i++) // For each of the sensor's nodes
+    {
+      if ((unsigned long int)frame_reading->instant_reading[i].x_value < calibration_min_reads[3 * i])
+        calibration_min_reads[3 * i] = frame_reading->instant_reading[i].x_value;
+      if ((unsigned long int)frame_reading->instant_reading[i].y_value < calibration_min_reads[3 * i + 1])
+        calibration_min_reads[3 * i + 1] = frame_reading->instant_reading[i].y_value;
+      if ((unsigned long int)frame_reading->instant_reading[i].z_value < calibration_min_reads[3 * i + 2])
+        calibration_min_reads[3 * i + 2] = frame_reading->instant_reading[i].z_value;
+    }
+
+    calibration_valid_frames++;
+  }
+
+  calibration_frames_left--;
 
-    retrieveSensorMinReadings(10); // Retrieve minimum values out of 10 frame readings
+  bool complete = calibration_frames_left <= 0;
 
-    sensor_is_calibrated = 1;
+  if (calibration_deadline_ns > 0)
+  {
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+    complete = current_time.tv_sec * 1000000000LL + current_time.tv_nsec >= calibration_deadline_ns;
   }
-  else // first time calibrating the sensor, structures need to be allocated
+
+  if (!complete)
+    return nullptr;
+
+  // Without a single frame of data the minimums are still their initial values: the previous baseline is kept
+  bool succeeded = calibration_valid_frames > 0;
+
+  if (succeeded)
+    commitCalibration();
+  else
+    logError(2, "No frames were retrieved during calibration, the previous calibration values are kept");
+
+  std::function<void(bool)> callback = calibration_callback;
+  calibration_callback = nullptr;
+  calibration_in_progress = false;
+  calibration_promise.set_value(succeeded);
+
+  if (!callback)
+    return nullptr;
+
+  return [callback, succeeded]() { callback(succeeded); };
+}
+
+// End the calibration in progress, if any, without replacing the baseline
+void UskinSensor::failCalibration()
+{
+  std::unique_lock<std::mutex> lock(calibration_mutex);
+
+  if (!calibration_in_progress)
+    return;
+
+  std::function<void(bool)> callback = calibration_callback;
+  calibration_callback = nullptr;
+  calibration_in_progress = false;
+  calibration_promise.set_value(false);
+
+  lock.unlock();
+
+  if (callback)
+    callback(false);
+}
+
+// Swap the collected minimum readings in as the new baseline. Called with calibration_mutex held
+void UskinSensor::commitCalibration()
+{
+  if (frame_min_reads == NULL) // first time calibrating the sensor, structures need to be allocated
   {
-    frame_min_reads_size = frame_size;
-    frame_min_reads = (unsigned long int **)std::malloc(frame_min_reads_size * sizeof(unsigned long int *));
+    frame_min_reads = new unsigned long int *[frame_size];
 
-    for (int i = 0; i < frame_min_reads_size; i++)
+    for (int i = 0; i < frame_size; i++)
     {
-      frame_min_reads[i] = new unsigned long int[3]{65000, 65000, 65000};
+      frame_min_reads[i] = new unsigned long int[3];
     }
+  }
+
+  for (int i = 0; i < frame_size; i++)
+  {
+    frame_min_reads[i][0] = calibration_min_reads[3 * i];
+    frame_min_reads[i][1] = calibration_min_reads[3 * i + 1];
+    frame_min_reads[i][2] = calibration_min_reads[3 * i + 2];
+  }
+
+  updateFixedPointScales();
 
-    retrieveSensorMinReadings(10);
+  if (force_calibration != NULL)
+  {
+    for (int i = 0; i < frame_size; i++)
+      force_calibration->setBaseline(i, frame_min_reads[i][0], frame_min_reads[i][1], frame_min_reads[i][2]);
   }
 
   sensor_is_calibrated = 1;
-  logInfo(1, "<< UskinSensor::CalibrateSensor()");
-};
+  frame_generation++; // Derived values of the current frame use the old baseline
+
+  logInfo(2, "New calibration values are in use");
+}
+
+// Precompute the fixed point scales of the calibration in frame_min_reads. Called with calibration_mutex held
+void UskinSensor::updateFixedPointScales()
+{
+  if (fixed_point_scales == NULL)
+    fixed_point_scales = new uskin_fixed_point_scale[frame_size * 3];
+
+  for (int i = 0; i < frame_size; i++)
+  {
+    fixed_point_scales[3 * i] = fixedPointScale(frame_min_reads[i][0], XNODEMAXREAD);
+    fixed_point_scales[3 * i + 1] = fixedPointScale(frame_min_reads[i][1], YNODEMAXREAD);
+    fixed_point_scales[3 * i + 2] = fixedPointScale(frame_min_reads[i][2], ZNODEMAXREAD);
+  }
+}
+
+// Normalize node (of index index) in the current mode. Called with calibration_mutex held, once calibrated
+void UskinSensor::normalizeNode(_uskin_node_time_unit_reading *node, int index)
+{
+  if (normalization_mode == USKIN_NORMALIZATION_FIXED_POINT)
+    node->normalizeFixedPoint(&fixed_point_scales[3 * index]);
+  else
+    node->normalize(frame_min_reads[index]);
+}
+
+void UskinSensor::updateDerivedValues(int node, bool normalized, bool forces)
+{
+  const int first = node < 0 ? 0 : node;
+  const int last = node < 0 ? frame_size : node + 1;
+
+  if (normalized)
+  {
+    std::lock_guard<std::mutex> lock(calibration_mutex);
+
+    for (int i = first; i < last && sensor_is_calibrated; i++)
+    {
+      if (normalized_generation[i] != frame_generation)
+      {
+        normalizeNode(&frame_reading->instant_reading[i], i);
+        normalized_generation[i] = frame_generation;
+      }
+    }
+  }
+
+  if (forces && force_calibration != NULL && (sensor_is_calibrated || !force_calibration->usesBaseline()))
+  {
+    int stale_nodes = 0;
+
+    for (int i = first; i < last; i++)
+      stale_nodes += force_generation[i] != frame_generation;
+
+    // A whole frame goes through the vectorized kernel, single nodes through the scalar one
+    if (node < 0 && stale_nodes > 0)
+    {
+      force_calibration->apply(frame_reading->instant_reading);
+
+      for (int i = 0; i < frame_size; i++)
+        force_generation[i] = frame_generation;
+    }
+    else if (stale_nodes > 0)
+    {
+      force_calibration->applyNode(frame_reading->instant_reading, node);
+      force_generation[node] = frame_generation;
+    }
+  }
+}
+
+// Check if an asynchronous calibration is collecting frames
+bool UskinSensor::get_sensor_calibration_in_progress()
+{
+  return calibration_in_progress;
+}
 
 unsigned long int ** UskinSensor::getCalibrationValues()
 {
   return frame_min_reads;
 };
 
+bool UskinSensor::CopyCalibrationValues(unsigned long int *min_readings)
+{
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  if (!sensor_is_calibrated)
+    return false;
+
+  for (int i = 0; i < frame_size; i++)
+  {
+    min_readings[3 * i] = frame_min_reads[i][0];
+    min_readings[3 * i + 1] = frame_min_reads[i][1];
+    min_readings[3 * i + 2] = frame_min_reads[i][2];
+  }
+
+  return true;
+}
+
 
 // Read and store latest sensor's frame reading. It will be stored at uskinCanDrive.frame_reading
-void UskinSensor::RetrieveFrameData()
+int UskinSensor::RetrieveFrameData()
 {
   logInfo(1, ">> UskinSensor::GetFrameData_xyzValues()");
 
@@ -262,28 +595,159 @@ void UskinSensor::RetrieveFrameData()
   if (!sensor_has_started)
   {
     logError(2, "You must start the sensor first!!");
-    return;
+    return 0;
   }
 
   n_frames_read = driver->readData(raw_data, frame_size, convertIndextoCanID(frame_size - 1));
 
+  storeFrame(raw_data, n_frames_read);
+
+  logInfo(1, "<< UskinSensor::GetFrameData_xyzValues()");
+
+  return n_frames_read > 0;
+};
+
+// Retrieve a frame if the driver has received all of its messages, without waiting for them
+int UskinSensor::PollFrameData()
+{
+  logInfo(1, ">> UskinSensor::PollFrameData()");
+
+  int n_frames_read;
+
+  if (!sensor_has_started)
+  {
+    logError(2, "You must start the sensor first!!");
+    return -1;
+  }
+
+  n_frames_read = driver->pollData(poll_buffer, frame_size, convertIndextoCanID(frame_size - 1));
+
+  if (n_frames_read <= 0)
+  {
+    logInfo(1, "<< UskinSensor::PollFrameData(" + std::to_string(n_frames_read) + ")");
+    return n_frames_read;
+  }
+
+  storeFrame(poll_buffer, n_frames_read);
+
+  logInfo(1, "<< UskinSensor::PollFrameData(1)");
+
+  return 1;
+}
+
+int UskinSensor::GetReceiveDescriptor()
+{
+  return driver->getReceiveDescriptor();
+}
+
+// Store the messages read by the driver as the current frame and run the per frame stages. Takes ownership of raw_data
+void UskinSensor::storeFrame(can_frame **raw_data, int n_frames_read)
+{
+  std::unique_lock<std::mutex> frame_lock(frame_mutex);
+
+  // Attach a timestamp to data. A read without data (timeout, error, end of a replay) keeps the previous frame as it was
+  struct timespec received_at = driver->getLastFrameTimestamp();
+  if (n_frames_read > 0 && received_at.tv_sec != 0) // Receive time of the frame's last message, as given by the driver
+  {
+    frame_reading->timestamp.tv_sec = received_at.tv_sec;
+    frame_reading->timestamp.tv_usec = received_at.tv_nsec / 1000;
+    frame_reading->timestamp_ns = received_at.tv_sec * 1000000000LL + received_at.tv_nsec;
+  }
+  else if (n_frames_read > 0)
+  {
+    gettimeofday(&frame_reading->timestamp, NULL);
+    frame_reading->timestamp_ns = frame_reading->timestamp.tv_sec * 1000000000LL + frame_reading->timestamp.tv_usec * 1000LL;
+  }
+
+  if (health_monitor != NULL)
+    memset(node_received, 0, frame_size * sizeof(bool));
+
   for (int i = 0; i < n_frames_read; i++)
   {
     // Convert and store raw can_frame data
     int index = convertCanIDtoIndex(raw_data[i]->can_id);
+
+    if (index < 0 || index >= frame_size) // Message from another device on the bus
+    {
+      delete raw_data[i];
+      continue;
+    }
+
+    // Before storeNodeReading, which releases the message
+    USKIN_PROBE_FRAME_RECEIVED(raw_data[i]->can_id, index, frame_reading->timestamp_ns);
     storeNodeReading(&frame_reading->instant_reading[index], raw_data[i], index);
+
+    if (health_monitor != NULL)
+      node_received[index] = true;
   }
 
-  // Attach a timestamp to data
-  gettimeofday(&frame_reading->timestamp, NULL);
+  if (n_frames_read > 0)
+  {
+    frame_generation++;
+    frame_sequence++;
+  }
 
-  // Save data if CSV file has been opened, otherwise just print it in log file
-  SaveData();
+  if (health_monitor != NULL && n_frames_read > 0)
+    frame_reading->health_flags = health_monitor->process(frame_reading->instant_reading, node_received, frame_reading->timestamp_ns);
 
-  logInfo(1, "<< UskinSensor::GetFrameData_xyzValues()");
+  // A read without data (timeout, error) leaves the previous frame in place: it must not be filtered or queued again
+  if (frame_filter != NULL && n_frames_read > 0)
+    frame_filter->filter(frame_reading->instant_reading);
 
-  return;
-};
+  if (frame_history != NULL && n_frames_read > 0)
+    frame_history->push(frame_reading->timestamp_ns, frame_reading->instant_reading);
+
+  std::function<void()> calibration_handler;
+
+  if (calibration_in_progress)
+    calibration_handler = updateCalibration(n_frames_read > 0);
+
+  if (decimator != NULL && decimator->getNumberOfStreams() > 0 && n_frames_read > 0)
+  {
+    updateDerivedValues(-1, false, true); // Streams decimate every frame's forces
+    decimator->process(frame_reading->instant_reading, frame_reading->timestamp_ns);
+  }
+
+  int n_slip_events = 0;
+  std::function<void(const uskin_slip_event &)> slip_handler;
+
+  if (slip_detector != NULL && n_frames_read > 0)
+  {
+    n_slip_events = slip_detector->process(frame_reading->instant_reading, frame_reading->timestamp_ns, slip_events);
+
+    if (n_slip_events > 0)
+      slip_handler = slip_callback;
+  }
+
+  frame_lock.unlock();
+
+  if (calibration_handler)
+    calibration_handler();
+
+  if (slip_handler)
+  {
+    for (int i = 0; i < n_slip_events; i++)
+      slip_handler(slip_events[i]);
+  }
+
+  // Only frames that carried data are counted and recorded
+  if (n_frames_read <= 0)
+    return;
+
+  unsigned long frame_number;
+  {
+    std::lock_guard<std::mutex> lock(frame_count_mutex);
+    frame_number = ++frames_retrieved;
+  }
+  frame_count_changed.notify_all();
+
+  USKIN_PROBE_FRAME_COMPLETED(frame_number, n_frames_read, frame_reading->timestamp_ns);
+  (void)frame_number; // Only read by the probe, which may be compiled out
+
+  // Save data if CSV file has been opened, otherwise just print it in log file
+  if (automatic_recording)
+    SaveData();
+}
 
 // Get x, y and z displacement readings for a single node
 _uskin_node_time_unit_reading *UskinSensor::GetNodeData_xyzValues(int node)
@@ -296,6 +760,11 @@ _uskin_node_time_unit_reading *UskinSensor::GetNodeData_xyzValues(int node)
     return NULL;
   }
 
+  {
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    updateDerivedValues(node, true, true);
+  }
+
   logInfo(1, "<< UskinSensor::GetNodeData_xyzValues(" + std::to_string(node) + ")");
 
   // logInfo(2, "================================================" + frame_reading->instant_reading[node].to_str());
@@ -307,6 +776,11 @@ _uskin_node_time_unit_reading *UskinSensor::GetFrameData()
 {
   logInfo(1, ">> UskinSensor::GetFrameData()");
 
+  {
+    std::lock_guard<std::mutex> frame_lock(frame_mutex);
+    updateDerivedValues(-1, true, true);
+  }
+
   return frame_reading->instant_reading;
   logInfo(1, "<< UskinSensor::GetFrameData()");
 }
@@ -316,6 +790,9 @@ _uskin_node_time_unit_reading *UskinSensor::GetFrameData()
 // Print frame reading contents
 void UskinSensor::PrintData()
 {
+  if (!DEBUG) // Nothing would be logged
+    return;
+
   logInfo(3, "Message recieved at " + std::string(asctime(gmtime(&frame_reading->timestamp.tv_sec))) + "." + std::to_string(frame_reading->timestamp.tv_usec) + "\n");
 
   for (int i = 0; i < frame_size; i++)
@@ -332,6 +809,9 @@ void UskinSensor::PrintData()
 // Print frame reading contents
 void UskinSensor::PrintNormalizedData()
 {
+  if (!DEBUG)
+    return;
+
   logInfo(3, "Message recieved at " + std::string(asctime(gmtime(&frame_reading->timestamp.tv_sec))) + "." + std::to_string(frame_reading->timestamp.tv_usec) + "\n");
 
   for (int i = 0; i < frame_size; i++)
@@ -368,6 +848,8 @@ void UskinSensor::SaveData()
 
     csv_file << std::endl;
 
+    USKIN_PROBE_RECORD_ENQUEUED((unsigned long)frames_retrieved, frame_reading->timestamp_ns);
+
     logInfo(2, "Data has been recorded");
     PrintData();
   }
@@ -431,6 +913,11 @@ void UskinSensor::SaveNormalizedData()
     struct tm *timeinfo;
     char time_str[20];
 
+    {
+      std::lock_guard<std::mutex> frame_lock(frame_mutex);
+      updateDerivedValues(-1, true, false);
+    }
+
     // Append reading timestamp
     timeinfo = localtime(&frame_reading->timestamp.tv_sec);
     strftime(time_str, 20, "%F_%T", timeinfo);
@@ -444,6 +931,8 @@ void UskinSensor::SaveNormalizedData()
 
     normalized_csv_file << std::endl;
 
+    USKIN_PROBE_RECORD_ENQUEUED((unsigned long)frames_retrieved, frame_reading->timestamp_ns);
+
     logInfo(2, "Data has been recorded");
     PrintNormalizedData();
   }
@@ -497,6 +986,26 @@ void UskinSensor::SaveNormalizedData(std::string filename)
   return;
 }
 
+// Open new candump log with provided filename and timestamp, all CAN frames received will be stored in it
+void UskinSensor::SaveRawCanData(std::string filename)
+{
+  logInfo(1, ">> UskinSensor::SaveRawCanData(" + filename + ")");
+
+  time_t timer;
+  struct tm *timeinfo;
+  char log_name[20];
+  time(&timer);
+  timeinfo = localtime(&timer);
+  strftime(log_name, 20, "%F_%T", timeinfo);
+
+  if (!driver->startCandumpLog(filename + "_" + std::string(log_name) + ".log"))
+    logError(2, "Problems opening candump log");
+
+  logInfo(1, "<< UskinSensor::SaveRawCanData()");
+
+  return;
+}
+
 // Check if sensor has started
 bool UskinSensor::get_sensor_status()
 {
@@ -534,7 +1043,7 @@ void UskinSensor::retrieveSensorMinReadings(int number_of_readings)
   for (int i = 0; i < number_of_readings; i++)
   {
     RetrieveFrameData();
-    for (int i = 0; i < frame_min_reads_size; i++) // For each of the sensor's nodes
+    for (int i = 0; i < frame_size && frame_min_reads != NULL; i++) // For each of the sensor's nodes
     {
 
       if (frame_reading->instant_reading[i].x_value < frame_min_reads[i][0])
@@ -545,6 +1054,13 @@ void UskinSensor::retrieveSensorMinReadings(int number_of_readings)
         frame_min_reads[i][2] = frame_reading->instant_reading[i].z_value; //Minimum z value for node i
     }
   }
+
+  if (frame_min_reads != NULL)
+  {
+    std::lock_guard<std::mutex> lock(calibration_mutex);
+    updateFixedPointScales();
+  }
+
   return;
 }
 
@@ -556,8 +1072,34 @@ bool UskinSensor::NormalizeData()
   if (get_sensor_calibration_status()) // If sensor was calibrated, normalize values
   {
     logInfo(2, "Attempting to normalize uskin frame readings...");
-    frame_reading->normalize();
-    SaveNormalizedData();
+    bool new_frame;
+    {
+      std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+      // Frame stages run once per frame; calling again for the same frame is free
+      new_frame = frame_stages_sequence != frame_sequence;
+
+      if (new_frame)
+      {
+        updateDerivedValues(-1, true, false);
+
+        if (contact_features == NULL)
+        {
+          contact_features = new UskinContactFeatures(frame_columns, frame_rows);
+          contact_features->configure(contact_config);
+        }
+        contact_features->compute(frame_reading->instant_reading, &frame_reading->contact);
+
+        if (tactile_image != NULL)
+          tactile_image->render(frame_reading->instant_reading);
+
+        frame_stages_sequence = frame_sequence;
+
+        USKIN_PROBE_NORMALIZE((unsigned long)frames_retrieved, frame_reading->timestamp_ns);
+      }
+    }
+    if (new_frame && automatic_recording)
+      SaveNormalizedData();
     logInfo(1, "<< UskinSensor::NormalizeData()");
     return true;
   }
@@ -566,14 +1108,598 @@ bool UskinSensor::NormalizeData()
   return false;
 }
 
-// Create necessary columns in CSV file
-void UskinSensor::initializeCSVdataStructure(std::ofstream *csv)
+// Start the acquisition thread. The sensor must have been started
+int UskinSensor::StartAcquisition(bool normalize)
 {
-  *csv << "Timestamp";
+  logInfo(1, ">> UskinSensor::StartAcquisition()");
 
-  for (int i = 0; i < frame_size; i++)
+  if (!sensor_has_started)
   {
-    *csv << ",CAN ID, X Values,Y Values, Z Values";
+    logError(2, "You must start the sensor first!!");
+    logInfo(1, "<< UskinSensor::StartAcquisition()");
+    return 0;
+  }
+
+  if (acquisition_running)
+  {
+    logError(2, "Acquisition thread is already running");
+    logInfo(1, "<< UskinSensor::StartAcquisition()");
+    return 0;
+  }
+
+  if (acquisition_thread.joinable()) // Stopped by itself, at the end of a replay
+    acquisition_thread.join();
+
+  acquisition_normalizes = normalize;
+  acquisition_running = true;
+  acquisition_thread = std::thread(&UskinSensor::acquisitionLoop, this);
+
+  logInfo(1, "<< UskinSensor::StartAcquisition()");
+
+  return 1;
+}
+
+// Stop the acquisition thread. Returns once the frame being retrieved has been completed
+void UskinSensor::StopAcquisition()
+{
+  logInfo(1, ">> UskinSensor::StopAcquisition()");
+
+  acquisition_running = false;
+
+  if (acquisition_thread.joinable())
+    acquisition_thread.join();
+
+  logInfo(1, "<< UskinSensor::StopAcquisition()");
+}
+
+void UskinSensor::acquisitionLoop()
+{
+  int failed_reads = 0;
+
+  while (acquisition_running)
+  {
+    if (!RetrieveFrameData())
+    {
+      if (IsDriverFinished())
+      {
+        logInfo(2, "The driver has no more frames, acquisition stopped");
+        acquisition_running = false;
+        failCalibration(); // Its frames will never come
+        break;
+      }
+
+      // Timeouts and read errors: back off (1 ms, doubling) so a connection in error does not keep the thread spinning
+      std::this_thread::sleep_for(std::chrono::milliseconds(std::min(USKIN_ACQUISITION_MAX_BACKOFF_MS, 1 << std::min(failed_reads++, 16))));
+      continue;
+    }
+
+    failed_reads = 0;
+
+    if (acquisition_normalizes && get_sensor_calibration_status())
+      NormalizeData();
+  }
+}
+
+bool UskinSensor::IsDriverFinished()
+{
+  return driver->isFinished();
+}
+
+bool UskinSensor::get_sensor_acquisition_status()
+{
+  return acquisition_running;
+}
+
+unsigned long UskinSensor::GetFrameCount()
+{
+  return frames_retrieved;
+}
+
+bool UskinSensor::WaitForFrame(unsigned long last_frame_count, long timeout_ms)
+{
+  std::unique_lock<std::mutex> lock(frame_count_mutex);
+
+  return frame_count_changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, last_frame_count] { return frames_retrieved > last_frame_count; });
+}
+
+void UskinSensor::CopyFrame(_uskin_node_time_unit_reading *nodes, long long *timestamp_ns)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  updateDerivedValues(-1, false, true);
+
+  memcpy(nodes, frame_reading->instant_reading, frame_size * sizeof(_uskin_node_time_unit_reading));
+
+  if (timestamp_ns != NULL)
+    *timestamp_ns = frame_reading->timestamp_ns;
+}
+
+bool UskinSensor::NormalizeFrame(_uskin_node_time_unit_reading *nodes)
+{
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  if (!sensor_is_calibrated)
+    return false;
+
+  for (int i = 0; i < frame_size; i++)
+    normalizeNode(&nodes[i], i);
+
+  return true;
+}
+
+void UskinSensor::SetNormalizationMode(uskin_normalization_mode mode)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  normalization_mode = mode;
+  frame_generation++; // Normalized values of the current frame are in the old mode
+}
+
+uskin_normalization_mode UskinSensor::GetNormalizationMode()
+{
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  return normalization_mode;
+}
+
+void UskinSensor::SetAutomaticRecording(bool enable)
+{
+  automatic_recording = enable;
+}
+
+void UskinSensor::CopyFrameData(int *raw_values, int *normalized_values, long long *timestamp_ns)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (normalized_values != NULL)
+    updateDerivedValues(-1, true, false);
+
+  for (int i = 0; i < frame_size; i++)
+  {
+    _uskin_node_time_unit_reading *node = &frame_reading->instant_reading[i];
+
+    if (raw_values != NULL)
+    {
+      raw_values[3 * i] = node->x_value;
+      raw_values[3 * i + 1] = node->y_value;
+      raw_values[3 * i + 2] = node->z_value;
+    }
+
+    if (normalized_values != NULL)
+    {
+      normalized_values[3 * i] = node->x_value_normalized;
+      normalized_values[3 * i + 1] = node->y_value_normalized;
+      normalized_values[3 * i + 2] = node->z_value_normalized;
+    }
+  }
+
+  if (timestamp_ns != NULL)
+    *timestamp_ns = frame_reading->timestamp_ns;
+}
+
+int UskinSensor::CopyQueuedFrames(unsigned long long *next_frame, int max_frames, int *raw_values, int *normalized_values, long long *timestamps, unsigned long long *dropped_frames)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (dropped_frames != NULL)
+    *dropped_frames = 0;
+
+  if (frame_history == NULL)
+  {
+    logError(2, "Frame history must be enabled to read queued frames");
+    return 0;
+  }
+
+  unsigned long long frames_pushed = frame_history->getFramesPushed();
+  unsigned long long oldest_frame = frames_pushed - frame_history->size();
+
+  if (*next_frame < oldest_frame)
+  {
+    if (dropped_frames != NULL)
+      *dropped_frames = oldest_frame - *next_frame;
+    *next_frame = oldest_frame;
+  }
+
+  int frames_copied = 0;
+  int frame_values = frame_size * 3;
+
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  for (; *next_frame < frames_pushed && frames_copied < max_frames; (*next_frame)++, frames_copied++)
+  {
+    int index = *next_frame - oldest_frame;
+    const int *frame = frame_history->getFrame(index);
+
+    if (raw_values != NULL)
+      memcpy(&raw_values[frames_copied * frame_values], frame, frame_values * sizeof(int));
+
+    if (timestamps != NULL)
+      timestamps[frames_copied] = frame_history->getTimestamp(index);
+
+    // Queued frames are normalized with the current calibration values
+    if (normalized_values != NULL)
+    {
+      int *normalized = &normalized_values[frames_copied * frame_values];
+
+      for (int i = 0; i < frame_size; i++)
+      {
+        if (sensor_is_calibrated && normalization_mode == USKIN_NORMALIZATION_FIXED_POINT)
+        {
+          normalized[3 * i] = normalizeReadingFixedPoint(frame[3 * i], fixed_point_scales[3 * i], -100);
+          normalized[3 * i + 1] = normalizeReadingFixedPoint(frame[3 * i + 1], fixed_point_scales[3 * i + 1], -100);
+          normalized[3 * i + 2] = normalizeReadingFixedPoint(frame[3 * i + 2], fixed_point_scales[3 * i + 2], 0);
+        }
+        else if (sensor_is_calibrated)
+        {
+          normalized[3 * i] = normalizeReading(frame[3 * i], frame_min_reads[i][0], XNODEMAXREAD, -100);
+          normalized[3 * i + 1] = normalizeReading(frame[3 * i + 1], frame_min_reads[i][1], YNODEMAXREAD, -100);
+          normalized[3 * i + 2] = normalizeReading(frame[3 * i + 2], frame_min_reads[i][2], ZNODEMAXREAD, 0);
+        }
+        else
+        {
+          normalized[3 * i] = normalized[3 * i + 1] = normalized[3 * i + 2] = 0;
+        }
+      }
+    }
+  }
+
+  return frames_copied;
+}
+
+bool UskinSensor::SampleFrameHistory(long long tick_ns, bool interpolate, float *values, long long *sample_ns, long long *newest_ns)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (frame_history == NULL || frame_history->size() == 0)
+    return false;
+
+  *newest_ns = frame_history->getTimestamp(frame_history->size() - 1);
+
+  if (interpolate && frame_history->interpolate(tick_ns, values))
+  {
+    *sample_ns = tick_ns;
+    return true;
+  }
+
+  // Nearest frame (for ticks outside the stored span this is the oldest or newest frame)
+  int nearest = frame_history->findNearest(tick_ns);
+  const int *frame = frame_history->getFrame(nearest);
+
+  for (int i = 0; i < frame_size * 3; i++)
+    values[i] = frame[i];
+
+  *sample_ns = frame_history->getTimestamp(nearest);
+
+  return true;
+}
+
+bool UskinSensor::CopyLastFrames(int number_of_frames, int *raw_values)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  const int *window = frame_history != NULL ? frame_history->getWindow(number_of_frames) : NULL;
+
+  if (window == NULL)
+    return false;
+
+  memcpy(raw_values, window, number_of_frames * frame_size * 3 * sizeof(int));
+
+  return true;
+}
+
+// Configure the temporal filter of one axis (USKIN_AXIS_X, USKIN_AXIS_Y or USKIN_AXIS_Z)
+void UskinSensor::SetFilter(int axis, uskin_filter_config config)
+{
+  logInfo(1, ">> UskinSensor::SetFilter(" + std::to_string(axis) + ")");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (frame_filter == NULL)
+    frame_filter = new UskinFrameFilter(frame_size);
+
+  frame_filter->configureAxis(axis, config);
+
+  logInfo(1, "<< UskinSensor::SetFilter(" + std::to_string(axis) + ")");
+}
+
+void UskinSensor::DisableFilter()
+{
+  logInfo(1, ">> UskinSensor::DisableFilter()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete frame_filter;
+  frame_filter = NULL;
+
+  logInfo(1, "<< UskinSensor::DisableFilter()");
+}
+
+// Allocate a history of the last number_of_frames frames. Any previous history is discarded
+void UskinSensor::EnableFrameHistory(int number_of_frames)
+{
+  logInfo(1, ">> UskinSensor::EnableFrameHistory(" + std::to_string(number_of_frames) + ")");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete frame_history;
+  frame_history = number_of_frames > 0 ? new UskinFrameHistory(number_of_frames, frame_size) : NULL;
+
+  logInfo(1, "<< UskinSensor::EnableFrameHistory(" + std::to_string(number_of_frames) + ")");
+}
+
+UskinFrameHistory *UskinSensor::GetFrameHistory()
+{
+  return frame_history;
+}
+
+// Timestamp of the latest frame retrieved, in nanoseconds
+long long UskinSensor::GetFrameTimestamp()
+{
+  return frame_reading->timestamp_ns;
+}
+
+void UskinSensor::SetContactConfiguration(uskin_contact_config config)
+{
+  logInfo(1, ">> UskinSensor::SetContactConfiguration()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  contact_config = config;
+
+  if (contact_features != NULL)
+    contact_features->configure(contact_config);
+
+  logInfo(1, "<< UskinSensor::SetContactConfiguration()");
+}
+
+uskin_contact_features UskinSensor::GetContactFeatures()
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  return frame_reading->contact;
+}
+
+void UskinSensor::CopyContactLabels(int *labels)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (contact_features == NULL)
+    memset(labels, 0, frame_size * sizeof(int));
+  else
+    memcpy(labels, contact_features->getNodeLabels(), frame_size * sizeof(int));
+}
+
+void UskinSensor::EnableSlipDetection(uskin_slip_config config, std::function<void(const uskin_slip_event &)> callback)
+{
+  logInfo(1, ">> UskinSensor::EnableSlipDetection()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (slip_detector == NULL)
+  {
+    slip_detector = new UskinSlipDetector(frame_size);
+    slip_events = new uskin_slip_event[frame_size];
+  }
+
+  slip_detector->configure(config);
+  slip_callback = callback;
+
+  logInfo(1, "<< UskinSensor::EnableSlipDetection()");
+}
+
+void UskinSensor::DisableSlipDetection()
+{
+  logInfo(1, ">> UskinSensor::DisableSlipDetection()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete slip_detector;
+  delete[] slip_events;
+  slip_detector = NULL;
+  slip_events = NULL;
+  slip_callback = nullptr;
+
+  logInfo(1, "<< UskinSensor::DisableSlipDetection()");
+}
+
+UskinSlipDetector *UskinSensor::GetSlipDetector()
+{
+  return slip_detector;
+}
+
+void UskinSensor::EnableTactileImage(int output_rows, int output_columns, uskin_interpolation method)
+{
+  logInfo(1, ">> UskinSensor::EnableTactileImage(" + std::to_string(output_rows) + "x" + std::to_string(output_columns) + ")");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete tactile_image;
+  tactile_image = output_rows > 0 && output_columns > 0 ? new UskinTactileImage(frame_columns, frame_rows, output_rows, output_columns, method) : NULL;
+
+  logInfo(1, "<< UskinSensor::EnableTactileImage()");
+}
+
+void UskinSensor::DisableTactileImage()
+{
+  logInfo(1, ">> UskinSensor::DisableTactileImage()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete tactile_image;
+  tactile_image = NULL;
+
+  logInfo(1, "<< UskinSensor::DisableTactileImage()");
+}
+
+UskinTactileImage *UskinSensor::GetTactileImage()
+{
+  return tactile_image;
+}
+
+bool UskinSensor::CopyTactileImage(int axis, float *image)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (tactile_image == NULL || axis < 0 || axis > 2)
+    return false;
+
+  const int output_columns = tactile_image->getOutputColumns();
+  const int stride = tactile_image->getRowStride();
+  const float *source = tactile_image->getImage(axis);
+
+  for (int row = 0; row < tactile_image->getOutputRows(); row++)
+    memcpy(&image[row * output_columns], &source[row * stride], output_columns * sizeof(float));
+
+  return true;
+}
+
+bool UskinSensor::LoadForceCalibration(std::string filename)
+{
+  logInfo(1, ">> UskinSensor::LoadForceCalibration(" + filename + ")");
+
+  UskinForceCalibration *new_calibration = new UskinForceCalibration(frame_size);
+
+  if (!new_calibration->loadFile(filename))
+  {
+    delete new_calibration;
+    logInfo(1, "<< UskinSensor::LoadForceCalibration()");
+    return false;
+  }
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+  std::lock_guard<std::mutex> lock(calibration_mutex);
+
+  if (sensor_is_calibrated)
+  {
+    for (int i = 0; i < frame_size; i++)
+      new_calibration->setBaseline(i, frame_min_reads[i][0], frame_min_reads[i][1], frame_min_reads[i][2]);
+  }
+
+  delete force_calibration;
+  force_calibration = new_calibration;
+
+  for (int i = 0; i < frame_size; i++)
+    force_generation[i] = frame_generation - 1; // Stale
+
+  logInfo(1, "<< UskinSensor::LoadForceCalibration()");
+
+  return true;
+}
+
+void UskinSensor::DisableForceCalibration()
+{
+  logInfo(1, ">> UskinSensor::DisableForceCalibration()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete force_calibration;
+  force_calibration = NULL;
+
+  logInfo(1, "<< UskinSensor::DisableForceCalibration()");
+}
+
+bool UskinSensor::get_sensor_force_calibration_status()
+{
+  return force_calibration != NULL;
+}
+
+// Create necessary columns in CSV file
+void UskinSensor::initializeCSVdataStructure(std::ofstream *csv)
+{
+  *csv << "Timestamp";
+
+  for (int i = 0; i < frame_size; i++)
+  {
+    *csv << ",CAN ID, X Values,Y Values, Z Values";
   }
   *csv << std::endl;
-}
\ No newline at end of file
+}
+
+void UskinSensor::EnableHealthMonitor(uskin_health_config config)
+{
+  logInfo(1, ">> UskinSensor::EnableHealthMonitor()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (health_monitor == NULL)
+  {
+    health_monitor = new UskinHealthMonitor(frame_size);
+    node_received = new bool[frame_size];
+  }
+
+  health_monitor->configure(config);
+
+  logInfo(1, "<< UskinSensor::EnableHealthMonitor()");
+}
+
+void UskinSensor::DisableHealthMonitor()
+{
+  logInfo(1, ">> UskinSensor::DisableHealthMonitor()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  delete health_monitor;
+  delete[] node_received;
+  health_monitor = NULL;
+  node_received = NULL;
+
+  for (int i = 0; i < frame_size; i++)
+    frame_reading->instant_reading[i].health_flags = 0;
+  frame_reading->health_flags = 0;
+
+  logInfo(1, "<< UskinSensor::DisableHealthMonitor()");
+}
+
+UskinHealthMonitor *UskinSensor::GetHealthMonitor()
+{
+  return health_monitor;
+}
+
+uskin_node_health UskinSensor::GetNodeHealth(int node)
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (health_monitor == NULL)
+    return uskin_node_health();
+
+  return health_monitor->getNodeHealth(node);
+}
+
+unsigned int UskinSensor::GetFrameHealth()
+{
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  return frame_reading->health_flags;
+}
+
+UskinDecimatedStream *UskinSensor::SubscribeDecimated(double rate_hz, uskin_decimation_mode mode)
+{
+  logInfo(1, ">> UskinSensor::SubscribeDecimated(" + std::to_string(rate_hz) + ")");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (decimator == NULL)
+    decimator = new UskinDecimator(frame_size);
+
+  UskinDecimatedStream *stream = decimator->subscribe(rate_hz, mode);
+
+  if (stream == NULL)
+    logError(2, "Invalid decimated stream rate");
+
+  logInfo(1, "<< UskinSensor::SubscribeDecimated()");
+
+  return stream;
+}
+
+void UskinSensor::UnsubscribeDecimated(UskinDecimatedStream *stream)
+{
+  logInfo(1, ">> UskinSensor::UnsubscribeDecimated()");
+
+  std::lock_guard<std::mutex> frame_lock(frame_mutex);
+
+  if (decimator == NULL || !decimator->unsubscribe(stream))
+    logError(2, "Stream is not subscribed to this sensor");
+
+  logInfo(1, "<< UskinSensor::UnsubscribeDecimated()");
+}
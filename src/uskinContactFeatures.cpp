@@ -0,0 +1,166 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinContactFeatures.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinContactFeatures.h"
+#include "../include/uskinCanDriver.h"
+
+//###################### UskinContactFeatures #########################
+
+UskinContactFeatures::UskinContactFeatures(int number_of_columns, int number_of_rows) : columns(number_of_columns), rows(number_of_rows), number_of_nodes(number_of_columns * number_of_rows)
+{
+  labels = new int[number_of_nodes];
+  was_in_contact = new bool[number_of_nodes];
+  stack = new int[number_of_nodes];
+
+  reset();
+}
+
+UskinContactFeatures::~UskinContactFeatures()
+{
+  delete[] labels;
+  delete[] was_in_contact;
+  delete[] stack;
+}
+
+void UskinContactFeatures::configure(uskin_contact_config new_config)
+{
+  if (new_config.low_threshold < 1)
+    new_config.low_threshold = 1;
+
+  if (new_config.low_threshold > new_config.high_threshold)
+    new_config.low_threshold = new_config.high_threshold;
+
+  config = new_config;
+}
+
+uskin_contact_config UskinContactFeatures::getConfiguration()
+{
+  return config;
+}
+
+void UskinContactFeatures::reset()
+{
+  memset(labels, 0, number_of_nodes * sizeof(int));
+  memset(was_in_contact, 0, number_of_nodes * sizeof(bool));
+}
+
+const int *UskinContactFeatures::getNodeLabels()
+{
+  return labels;
+}
+
+void UskinContactFeatures::compute(const _uskin_node_time_unit_reading *frame, uskin_contact_features *features)
+{
+  int number_of_labels = 0;
+  float weighted_column = 0, weighted_row = 0, weighted_x = 0, weighted_y = 0;
+
+  memset(labels, 0, number_of_nodes * sizeof(int));
+
+  features->nodes_in_contact = 0;
+  features->total_force = 0;
+  features->number_of_regions = 0;
+
+  for (int seed = 0; seed < number_of_nodes; seed++)
+  {
+    int z = frame[seed].z_value_normalized;
+
+    if (labels[seed] != 0 || z < config.low_threshold || (z < config.high_threshold && !was_in_contact[seed]))
+      continue;
+
+    // Flood fill a new region from this seed over nodes above the low threshold
+    uskin_contact_region region;
+    int stack_size = 0;
+
+    region.label = ++number_of_labels;
+    labels[seed] = region.label;
+    stack[stack_size++] = seed;
+
+    while (stack_size > 0)
+    {
+      int node = stack[--stack_size];
+      int column = node / rows;
+      int row = node % rows;
+      float force = frame[node].z_value_normalized;
+
+      region.number_of_nodes++;
+      region.total_force += force;
+      region.center_column += force * column;
+      region.center_row += force * row;
+
+      if (region.peak_node < 0 || frame[node].z_value_normalized > frame[region.peak_node].z_value_normalized)
+        region.peak_node = node;
+
+      weighted_x += force * frame[node].x_value_normalized;
+      weighted_y += force * frame[node].y_value_normalized;
+
+      for (int d_column = -1; d_column <= 1; d_column++)
+      {
+        for (int d_row = -1; d_row <= 1; d_row++)
+        {
+          if ((d_column == 0 && d_row == 0) || (!config.eight_connected && d_column != 0 && d_row != 0))
+            continue;
+
+          int neighbour_column = column + d_column;
+          int neighbour_row = row + d_row;
+
+          if (neighbour_column < 0 || neighbour_column >= columns || neighbour_row < 0 || neighbour_row >= rows)
+            continue;
+
+          int neighbour = neighbour_column * rows + neighbour_row;
+
+          if (labels[neighbour] == 0 && frame[neighbour].z_value_normalized >= config.low_threshold)
+          {
+            labels[neighbour] = region.label;
+            stack[stack_size++] = neighbour;
+          }
+        }
+      }
+    }
+
+    features->nodes_in_contact += region.number_of_nodes;
+    features->total_force += region.total_force;
+    weighted_column += region.center_column;
+    weighted_row += region.center_row;
+
+    if (region.total_force > 0)
+    {
+      region.center_column /= region.total_force;
+      region.center_row /= region.total_force;
+    }
+
+    if (features->number_of_regions < USKIN_MAX_CONTACT_REGIONS)
+      features->regions[features->number_of_regions++] = region;
+  }
+
+  for (int i = 0; i < number_of_nodes; i++)
+    was_in_contact[i] = labels[i] != 0;
+
+  features->in_contact = number_of_labels > 0;
+
+  if (features->total_force > 0)
+  {
+    features->center_column = weighted_column / features->total_force;
+    features->center_row = weighted_row / features->total_force;
+    features->shear_x = weighted_x / features->total_force;
+    features->shear_y = weighted_y / features->total_force;
+  }
+  else
+  {
+    features->center_column = features->center_row = 0;
+    features->shear_x = features->shear_y = 0;
+  }
+
+  features->shear_magnitude = sqrtf(features->shear_x * features->shear_x + features->shear_y * features->shear_y);
+  features->shear_direction = atan2f(features->shear_y, features->shear_x);
+}
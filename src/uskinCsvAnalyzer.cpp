@@ -0,0 +1,657 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinCsvAnalyzer.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <fcntl.h>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "../include/uskinCsvAnalyzer.h"
+#include "../include/uskinCanDriver.h"
+
+#define USKIN_CSV_BINARY_HEADER_SIZE 24
+// Values converted at a time when writing or reading 16 bit columns
+#define USKIN_CSV_CONVERSION_VALUES (1 << 18)
+
+//###################### Utils #########################
+
+// Run task(0) to task(number_of_tasks - 1) on number_of_threads threads, each taking the next task when done
+static void parallelFor(int number_of_tasks, int number_of_threads, std::function<void(int)> task)
+{
+  std::atomic<int> next_task(0);
+  std::vector<std::thread> workers;
+
+  auto work = [&]() {
+    for (int current; (current = next_task++) < number_of_tasks;)
+      task(current);
+  };
+
+  for (int i = 1; i < std::min(number_of_threads, number_of_tasks); i++)
+    workers.push_back(std::thread(work));
+
+  work();
+
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+// Decimal digits without reading past line_end (the mapped file is not NUL terminated). NULL if there are none
+static inline const char *parseDecimal(const char *cursor, const char *line_end, long long *value)
+{
+  const char *start = cursor;
+
+  *value = 0;
+
+  while (cursor < line_end && *cursor >= '0' && *cursor <= '9')
+    *value = *value * 10 + (*cursor++ - '0');
+
+  return cursor > start ? cursor : NULL;
+}
+
+static inline const char *parseSigned(const char *cursor, const char *line_end, int *value)
+{
+  bool negative = cursor < line_end && *cursor == '-';
+  long long magnitude;
+
+  cursor = parseDecimal(cursor + negative, line_end, &magnitude);
+
+  if (cursor == NULL || magnitude > INT_MAX)
+    return NULL;
+
+  *value = negative ? -magnitude : magnitude;
+
+  return cursor;
+}
+
+static inline const char *parseHex(const char *cursor, const char *line_end, __u32 *value)
+{
+  const char *start = cursor;
+
+  *value = 0;
+
+  for (; cursor < line_end && cursor - start < 8; cursor++)
+  {
+    char c = *cursor | 0x20; // Lower case letters
+
+    if (*cursor >= '0' && *cursor <= '9')
+      *value = *value << 4 | (*cursor - '0');
+    else if (c >= 'a' && c <= 'f')
+      *value = *value << 4 | (c - 'a' + 10);
+    else
+      break;
+  }
+
+  return cursor > start ? cursor : NULL;
+}
+
+static inline const char *expect(const char *cursor, const char *line_end, char separator)
+{
+  return cursor != NULL && cursor < line_end && *cursor == separator ? cursor + 1 : NULL;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static long long daysFromCivil(long long year, int month, int day)
+{
+  year -= month <= 2;
+
+  long long era = (year >= 0 ? year : year - 399) / 400;
+  long long year_of_era = year - era * 400;
+  long long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+  return era * 146097 + day_of_era - 719468;
+}
+
+// SaveData writes local time. mktime (slow, and serialized by the C library) is only called when the hour changes
+struct local_time_offset
+{
+  long long hour = LLONG_MIN; // Hours since the epoch, of the local time read as UTC
+  long long offset_s = 0;
+};
+
+// "%F_%T.usec" as written by SaveData (microseconds without leading zeros, read the same way as ReplayCanDriver)
+static const char *parseTimestamp(const char *cursor, const char *line_end, local_time_offset *local, long long *timestamp_ns)
+{
+  long long year, month, day, hour, minute, second, microseconds = 0;
+
+  cursor = parseDecimal(cursor, line_end, &year);
+  cursor = cursor ? parseDecimal(expect(cursor, line_end, '-'), line_end, &month) : NULL;
+  cursor = cursor ? parseDecimal(expect(cursor, line_end, '-'), line_end, &day) : NULL;
+  cursor = cursor ? parseDecimal(expect(cursor, line_end, '_'), line_end, &hour) : NULL;
+  cursor = cursor ? parseDecimal(expect(cursor, line_end, ':'), line_end, &minute) : NULL;
+  cursor = cursor ? parseDecimal(expect(cursor, line_end, ':'), line_end, &second) : NULL;
+
+  if (cursor == NULL || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    return NULL;
+
+  if (cursor < line_end && *cursor == '.' && (cursor = parseDecimal(cursor + 1, line_end, &microseconds)) == NULL)
+    return NULL;
+
+  long long days = daysFromCivil(year, month, day);
+
+  if (days * 24 + hour != local->hour)
+  {
+    struct tm timeinfo;
+
+    memset(&timeinfo, 0, sizeof(timeinfo));
+    timeinfo.tm_year = year - 1900;
+    timeinfo.tm_mon = month - 1;
+    timeinfo.tm_mday = day;
+    timeinfo.tm_hour = hour;
+    timeinfo.tm_isdst = -1;
+
+    local->hour = days * 24 + hour;
+    local->offset_s = mktime(&timeinfo) - local->hour * 3600;
+  }
+
+  *timestamp_ns = (local->hour * 3600 + local->offset_s + minute * 60 + second) * 1000000000LL + microseconds * 1000;
+
+  return cursor;
+}
+
+static bool writeAll(int file_descriptor, const void *data, size_t size)
+{
+  const char *cursor = (const char *)data;
+
+  while (size > 0)
+  {
+    ssize_t written = write(file_descriptor, cursor, size);
+
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+
+    cursor += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+static bool readAll(int file_descriptor, void *data, size_t size)
+{
+  char *cursor = (char *)data;
+
+  while (size > 0)
+  {
+    ssize_t bytes_read = read(file_descriptor, cursor, size);
+
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      return false;
+
+    cursor += bytes_read;
+    size -= bytes_read;
+  }
+
+  return true;
+}
+
+//###################### UskinCsvAnalyzer #########################
+
+UskinCsvAnalyzer::UskinCsvAnalyzer(uskin_csv_config new_config) : config(new_config)
+{
+  if (config.chunk_bytes == 0)
+    config.chunk_bytes = USKIN_CSV_CHUNK_BYTES;
+}
+
+int UskinCsvAnalyzer::numberOfThreads()
+{
+  if (config.threads > 0)
+    return config.threads;
+
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void UskinCsvAnalyzer::clear()
+{
+  number_of_nodes = 0;
+  number_of_frames = 0;
+  malformed_rows = 0;
+
+  node_ids.clear();
+  timestamps.clear();
+  values.clear();
+}
+
+int UskinCsvAnalyzer::openFile(std::string file_name)
+{
+  logInfo(1, ">> UskinCsvAnalyzer::openFile(" + file_name + ")");
+
+  struct stat file_status;
+  int file_descriptor = open(file_name.c_str(), O_RDONLY);
+
+  clear();
+
+  if (file_descriptor < 0 || fstat(file_descriptor, &file_status) < 0)
+  {
+    logError(2, "Could not open recording " + file_name);
+
+    if (file_descriptor >= 0)
+      close(file_descriptor);
+
+    return 0;
+  }
+
+  const size_t file_size = file_status.st_size;
+  const char *file_data = NULL;
+
+  if (file_size > 0)
+  {
+    void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+
+    if (mapping != MAP_FAILED)
+    {
+      madvise(mapping, file_size, MADV_SEQUENTIAL);
+      file_data = (const char *)mapping;
+    }
+  }
+
+  close(file_descriptor);
+
+  if (file_data == NULL)
+  {
+    logError(2, "Could not map recording " + file_name);
+    return 0;
+  }
+
+  const char *file_end = file_data + file_size;
+  const char *first_row = file_data;
+
+  // Skip the header written by initializeCSVdataStructure (and blank lines), as ReplayCanDriver
+  while (first_row < file_end && !(*first_row >= '0' && *first_row <= '9'))
+  {
+    const char *line_end = (const char *)memchr(first_row, '\n', file_end - first_row);
+    first_row = line_end != NULL ? line_end + 1 : file_end;
+  }
+
+  // The first data row gives the node IDs, in the order of every row
+  const char *line_end = (const char *)memchr(first_row, '\n', file_end - first_row);
+  local_time_offset local;
+  long long timestamp_ns;
+  const char *cursor = first_row < file_end ? parseTimestamp(first_row, line_end != NULL ? line_end : file_end, &local, &timestamp_ns) : NULL;
+
+  line_end = line_end != NULL ? line_end : file_end;
+
+  while (cursor != NULL && cursor < line_end && *cursor == ',')
+  {
+    __u32 node_id;
+    int value;
+
+    cursor = parseHex(cursor + 1, line_end, &node_id);
+
+    for (int axis = 0; axis < 3 && cursor != NULL; axis++)
+      cursor = parseSigned(expect(cursor, line_end, ','), line_end, &value);
+
+    if (cursor != NULL)
+      node_ids.push_back(node_id);
+  }
+
+  number_of_nodes = node_ids.size();
+
+  if (number_of_nodes == 0)
+  {
+    logError(2, "No data rows in recording " + file_name);
+    munmap((void *)file_data, file_size);
+    clear();
+    return 0;
+  }
+
+  // Chunks start after the line feed that ends the previous one. A row longer than a chunk leaves empty chunks
+  const size_t data_size = file_end - first_row;
+  const int number_of_chunks = (data_size + config.chunk_bytes - 1) / config.chunk_bytes;
+  std::vector<const char *> chunk_starts(number_of_chunks + 1, file_end);
+  std::vector<unsigned long> chunk_rows(number_of_chunks + 1, 0);
+
+  chunk_starts[0] = first_row;
+
+  for (int chunk = 1; chunk < number_of_chunks; chunk++)
+  {
+    const char *boundary = std::max(chunk_starts[chunk - 1], first_row + chunk * config.chunk_bytes - 1);
+    const char *line_feed = (const char *)memchr(boundary, '\n', file_end - boundary);
+
+    chunk_starts[chunk] = line_feed != NULL ? line_feed + 1 : file_end;
+  }
+
+  // Rows of every chunk, so each one is parsed straight into its place in the columns
+  parallelFor(number_of_chunks, numberOfThreads(), [&](int chunk) {
+    const char *cursor = chunk_starts[chunk];
+    const char *chunk_end = chunk_starts[chunk + 1];
+    unsigned long rows = 0;
+
+    while (cursor < chunk_end)
+    {
+      const char *line_feed = (const char *)memchr(cursor, '\n', chunk_end - cursor);
+
+      rows++;
+      cursor = line_feed != NULL ? line_feed + 1 : chunk_end;
+    }
+
+    chunk_rows[chunk + 1] = rows;
+  });
+
+  for (int chunk = 0; chunk < number_of_chunks; chunk++)
+    chunk_rows[chunk + 1] += chunk_rows[chunk];
+
+  const unsigned long rows = chunk_rows[number_of_chunks];
+  std::vector<char> row_valid(rows);
+
+  timestamps.resize(rows);
+  values.resize(rows * number_of_nodes * 3);
+
+  parallelFor(number_of_chunks, numberOfThreads(), [&](int chunk) {
+    const char *cursor = chunk_starts[chunk];
+    const char *chunk_end = chunk_starts[chunk + 1];
+    local_time_offset local;
+
+    for (unsigned long row = chunk_rows[chunk]; cursor < chunk_end; row++)
+    {
+      const char *line_feed = (const char *)memchr(cursor, '\n', chunk_end - cursor);
+      const char *line_end = line_feed != NULL ? line_feed : chunk_end;
+      const char *next_line = line_feed != NULL ? line_feed + 1 : chunk_end;
+
+      if (line_end > cursor && line_end[-1] == '\r')
+        line_end--;
+
+      cursor = parseTimestamp(cursor, line_end, &local, &timestamps[row]);
+
+      for (int node = 0; node < number_of_nodes && cursor != NULL; node++)
+      {
+        __u32 node_id;
+
+        cursor = parseHex(expect(cursor, line_end, ','), line_end, &node_id);
+
+        if (cursor != NULL && node_id != node_ids[node])
+          cursor = NULL;
+
+        for (int axis = 0; axis < 3 && cursor != NULL; axis++)
+          cursor = parseSigned(expect(cursor, line_end, ','), line_end, &values[(node * 3 + axis) * rows + row]);
+      }
+
+      row_valid[row] = cursor == line_end;
+      cursor = next_line;
+    }
+  });
+
+  munmap((void *)file_data, file_size);
+
+  number_of_frames = std::count(row_valid.begin(), row_valid.end(), 1);
+  malformed_rows = rows - number_of_frames;
+
+  // Close the gaps of malformed rows (rare), then pack the columns to number_of_frames values each
+  if (malformed_rows > 0)
+  {
+    std::vector<unsigned long> valid_rows;
+
+    valid_rows.reserve(number_of_frames);
+
+    for (unsigned long row = 0; row < rows; row++)
+    {
+      if (row_valid[row])
+        valid_rows.push_back(row);
+    }
+
+    parallelFor(number_of_nodes * 3 + 1, numberOfThreads(), [&](int column) {
+      if (column == number_of_nodes * 3)
+      {
+        for (unsigned long frame = 0; frame < number_of_frames; frame++)
+          timestamps[frame] = timestamps[valid_rows[frame]];
+        return;
+      }
+
+      int *column_values = &values[column * rows];
+
+      for (unsigned long frame = 0; frame < number_of_frames; frame++)
+        column_values[frame] = column_values[valid_rows[frame]];
+    });
+
+    for (int column = 1; column < number_of_nodes * 3; column++)
+      memmove(&values[column * number_of_frames], &values[column * rows], number_of_frames * sizeof(int));
+
+    timestamps.resize(number_of_frames);
+    values.resize(number_of_frames * number_of_nodes * 3);
+
+    logError(2, std::to_string(malformed_rows) + " malformed rows skipped in " + file_name);
+  }
+
+  logInfo(2, "Read " + std::to_string(number_of_frames) + " frames of " + std::to_string(number_of_nodes) + " nodes from " + file_name);
+  logInfo(1, "<< UskinCsvAnalyzer::openFile()");
+
+  return 1;
+}
+
+std::vector<uskin_csv_node_statistics> UskinCsvAnalyzer::computeStatistics()
+{
+  logInfo(1, ">> UskinCsvAnalyzer::computeStatistics()");
+
+  std::vector<uskin_csv_node_statistics> statistics(number_of_nodes);
+
+  for (int node = 0; node < number_of_nodes; node++)
+    statistics[node].node_id = node_ids[node];
+
+  parallelFor(number_of_nodes * 3, numberOfThreads(), [&](int column) {
+    const int node = column / 3, axis = column % 3;
+    const int *column_values = &values[column * number_of_frames];
+    uskin_csv_axis_statistics &axis_statistics = statistics[node].axis[axis];
+
+    if (number_of_frames == 0)
+      return;
+
+    int min_value = column_values[0], max_value = column_values[0];
+    long long sum = 0;
+
+    for (unsigned long frame = 0; frame < number_of_frames; frame++)
+    {
+      min_value = std::min(min_value, column_values[frame]);
+      max_value = std::max(max_value, column_values[frame]);
+      sum += column_values[frame];
+    }
+
+    axis_statistics.min = min_value;
+    axis_statistics.max = max_value;
+    axis_statistics.mean = (double)sum / number_of_frames;
+
+    if (!config.percentiles.empty())
+    {
+      std::vector<int> sorted(column_values, column_values + number_of_frames);
+
+      for (double percentile : config.percentiles)
+      {
+        long rank = (long)std::ceil(percentile / 100 * number_of_frames) - 1;
+
+        rank = std::max(0L, std::min((long)number_of_frames - 1, rank));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        axis_statistics.percentiles.push_back(sorted[rank]);
+      }
+    }
+
+    if (axis != 2)
+      return;
+
+    // Same normalization and hysteresis as a calibrated sensor with UskinContactFeatures
+    unsigned long min_read = ULONG_MAX;
+    bool in_contact = false;
+
+    for (unsigned long frame = 0; frame < std::min(number_of_frames, (unsigned long)std::max(1, config.calibration_frames)); frame++)
+      min_read = std::min(min_read, (unsigned long)std::max(0, column_values[frame]));
+
+    for (unsigned long frame = 0; frame < number_of_frames; frame++)
+    {
+      int normalized = normalizeReading(column_values[frame], min_read, ZNODEMAXREAD, 0);
+
+      if (normalized >= config.contact_high_threshold && !in_contact)
+        statistics[node].contacts++;
+
+      in_contact = normalized >= (in_contact ? config.contact_low_threshold : config.contact_high_threshold);
+      statistics[node].contact_frames += in_contact;
+    }
+  });
+
+  logInfo(1, "<< UskinCsvAnalyzer::computeStatistics()");
+
+  return statistics;
+}
+
+int UskinCsvAnalyzer::saveBinary(std::string file_name)
+{
+  logInfo(1, ">> UskinCsvAnalyzer::saveBinary(" + file_name + ")");
+
+  // Raw readings fit 16 bits
+  bool fits_16_bits = std::all_of(values.begin(), values.end(), [](int value) { return value >= 0 && value <= USHRT_MAX; });
+  int file_descriptor = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  uint8_t header[USKIN_CSV_BINARY_HEADER_SIZE];
+  uint32_t magic = USKIN_CSV_BINARY_MAGIC, version = USKIN_CSV_BINARY_VERSION, nodes = number_of_nodes, value_bytes = fits_16_bits ? 2 : 4;
+  uint64_t frames = number_of_frames;
+
+  memcpy(header, &magic, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &nodes, 4);
+  memcpy(header + 12, &value_bytes, 4);
+  memcpy(header + 16, &frames, 8);
+
+  bool written = file_descriptor >= 0 && writeAll(file_descriptor, header, sizeof(header)) && writeAll(file_descriptor, node_ids.data(), node_ids.size() * sizeof(__u32)) && writeAll(file_descriptor, timestamps.data(), timestamps.size() * sizeof(long long));
+
+  if (!fits_16_bits)
+  {
+    written = written && writeAll(file_descriptor, values.data(), values.size() * sizeof(int));
+  }
+  else
+  {
+    std::vector<uint16_t> converted(std::min(values.size(), (size_t)USKIN_CSV_CONVERSION_VALUES));
+
+    for (size_t start = 0; written && start < values.size(); start += converted.size())
+    {
+      size_t n_values = std::min(converted.size(), values.size() - start);
+
+      std::copy(values.begin() + start, values.begin() + start + n_values, converted.begin());
+      written = writeAll(file_descriptor, converted.data(), n_values * sizeof(uint16_t));
+    }
+  }
+
+  if (file_descriptor >= 0 && close(file_descriptor) < 0)
+    written = false;
+
+  if (!written)
+    logError(2, "Could not write " + file_name);
+
+  logInfo(1, "<< UskinCsvAnalyzer::saveBinary()");
+
+  return written;
+}
+
+int UskinCsvAnalyzer::openBinary(std::string file_name)
+{
+  logInfo(1, ">> UskinCsvAnalyzer::openBinary(" + file_name + ")");
+
+  uint8_t header[USKIN_CSV_BINARY_HEADER_SIZE];
+  uint32_t magic, version, nodes, value_bytes;
+  uint64_t frames;
+  struct stat file_status;
+  int file_descriptor = open(file_name.c_str(), O_RDONLY);
+
+  clear();
+
+  bool valid = file_descriptor >= 0 && fstat(file_descriptor, &file_status) == 0 && readAll(file_descriptor, header, sizeof(header));
+
+  if (valid)
+  {
+    memcpy(&magic, header, 4);
+    memcpy(&version, header + 4, 4);
+    memcpy(&nodes, header + 8, 4);
+    memcpy(&value_bytes, header + 12, 4);
+    memcpy(&frames, header + 16, 8);
+
+    valid = magic == USKIN_CSV_BINARY_MAGIC && version == USKIN_CSV_BINARY_VERSION && (value_bytes == 2 || value_bytes == 4) && nodes > 0 && nodes <= USHRT_MAX;
+
+    // The size also checks frames before anything is allocated from it
+    valid = valid && frames <= (uint64_t)file_status.st_size && (uint64_t)file_status.st_size == sizeof(header) + nodes * 4ULL + frames * 8 + frames * nodes * 3 * value_bytes;
+  }
+
+  if (valid)
+  {
+    number_of_nodes = nodes;
+    number_of_frames = frames;
+    node_ids.resize(nodes);
+    timestamps.resize(frames);
+    values.resize(frames * nodes * 3);
+
+    valid = readAll(file_descriptor, node_ids.data(), nodes * sizeof(__u32)) && readAll(file_descriptor, timestamps.data(), frames * sizeof(long long));
+
+    if (value_bytes == 4)
+    {
+      valid = valid && readAll(file_descriptor, values.data(), values.size() * sizeof(int));
+    }
+    else
+    {
+      std::vector<uint16_t> converted(std::min(values.size(), (size_t)USKIN_CSV_CONVERSION_VALUES));
+
+      for (size_t start = 0; valid && start < values.size(); start += converted.size())
+      {
+        size_t n_values = std::min(converted.size(), values.size() - start);
+
+        valid = readAll(file_descriptor, converted.data(), n_values * sizeof(uint16_t));
+        std::copy(converted.begin(), converted.begin() + n_values, values.begin() + start);
+      }
+    }
+  }
+
+  if (file_descriptor >= 0)
+    close(file_descriptor);
+
+  if (!valid)
+  {
+    logError(2, "Not a valid binary recording: " + file_name);
+    clear();
+  }
+
+  logInfo(1, "<< UskinCsvAnalyzer::openBinary()");
+
+  return valid;
+}
+
+int UskinCsvAnalyzer::getNumberOfNodes()
+{
+  return number_of_nodes;
+}
+
+unsigned long UskinCsvAnalyzer::getNumberOfFrames()
+{
+  return number_of_frames;
+}
+
+unsigned long UskinCsvAnalyzer::getMalformedRows()
+{
+  return malformed_rows;
+}
+
+const std::vector<__u32> &UskinCsvAnalyzer::getNodeIds()
+{
+  return node_ids;
+}
+
+const long long *UskinCsvAnalyzer::getTimestamps()
+{
+  return timestamps.data();
+}
+
+const int *UskinCsvAnalyzer::getColumn(int node, int axis)
+{
+  if (node < 0 || node >= number_of_nodes || axis < 0 || axis > 2)
+    return NULL;
+
+  return &values[(node * 3 + axis) * number_of_frames];
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinDecimation.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <algorithm>
+#include "../include/uskinDecimation.h"
+#include "../include/uskinCanDriver.h"
+
+// Flag of UskinDecimatedStream::middle: the block it refers to has not been read yet
+#define USKIN_DECIMATION_NEW_BLOCK 4
+#define USKIN_DECIMATION_BLOCK_MASK 3
+
+//###################### UskinDecimatedStream #########################
+
+UskinDecimatedStream::UskinDecimatedStream(int number_of_nodes, double rate_hz, uskin_decimation_mode new_mode) : number_of_nodes(number_of_nodes), padded_nodes(padNodeCount(number_of_nodes)), period_ns(rate_hz > 0 ? (long long)(1e9 / rate_hz) : 1000000000LL), mode(new_mode), middle(2)
+{
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+    accumulator[c] = allocateNodeArray(padded_nodes);
+
+  window_health_flags = new unsigned int[number_of_nodes];
+
+  for (int b = 0; b < 3; b++)
+  {
+    blocks[b].nodes = new _uskin_node_time_unit_reading[number_of_nodes];
+    blocks[b].timestamp_ns = 0;
+    blocks[b].frames = 0;
+
+    for (int i = 0; i < number_of_nodes; i++)
+      blocks[b].nodes[i].clear();
+  }
+
+  resetWindow();
+}
+
+UskinDecimatedStream::~UskinDecimatedStream()
+{
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+    freeNodeArray(accumulator[c]);
+
+  delete[] window_health_flags;
+
+  for (int b = 0; b < 3; b++)
+    delete[] blocks[b].nodes;
+}
+
+void UskinDecimatedStream::resetWindow()
+{
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+    memset(accumulator[c], 0, padded_nodes * sizeof(float));
+
+  memset(window_health_flags, 0, number_of_nodes * sizeof(unsigned int));
+  frames_in_window = 0;
+}
+
+void UskinDecimatedStream::accumulate(float *const *input, const _uskin_node_time_unit_reading *frame, long long timestamp_ns)
+{
+  // A frame past the end of the period (or from before it, e.g. a replay looping back) closes the period
+  if (frames_in_window > 0 && (timestamp_ns >= window_end_ns || timestamp_ns < window_end_ns - period_ns))
+  {
+    publish(frame);
+    resetWindow();
+  }
+
+  // Periods are aligned to multiples of the period, so streams of the same rate of different sensors line up
+  if (frames_in_window == 0)
+    window_end_ns = (timestamp_ns / period_ns + 1) * period_ns;
+
+  const int lanes = padded_nodes / USKIN_VECTOR_LANES;
+
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+  {
+    const uskin_vec4 *in = (const uskin_vec4 *)input[c];
+    uskin_vec4 *acc = (uskin_vec4 *)accumulator[c];
+
+    if (mode == USKIN_DECIMATION_MAX_HOLD && frames_in_window > 0)
+    {
+      for (int i = 0; i < lanes; i++)
+        acc[i] = vec_max(acc[i], in[i]);
+    }
+    else
+    {
+      for (int i = 0; i < lanes; i++)
+        acc[i] += in[i];
+    }
+  }
+
+  for (int i = 0; i < number_of_nodes; i++)
+    window_health_flags[i] |= frame[i].health_flags;
+
+  frames_in_window++;
+  blocks[back].timestamp_ns = timestamp_ns;
+}
+
+void UskinDecimatedStream::publish(const _uskin_node_time_unit_reading *frame)
+{
+  block &output = blocks[back];
+  const float scale = mode == USKIN_DECIMATION_AVERAGE ? 1.0f / frames_in_window : 1.0f;
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    _uskin_node_time_unit_reading &node = output.nodes[i];
+
+    node.clear();
+    node.node_id = frame[i].node_id;
+    node.index = frame[i].index;
+    node.x_value = lrintf(accumulator[0][i] * scale);
+    node.y_value = lrintf(accumulator[1][i] * scale);
+    node.z_value = lrintf(accumulator[2][i] * scale);
+    node.x_value_filtered = accumulator[3][i] * scale;
+    node.y_value_filtered = accumulator[4][i] * scale;
+    node.z_value_filtered = accumulator[5][i] * scale;
+    node.x_force = accumulator[6][i] * scale;
+    node.y_force = accumulator[7][i] * scale;
+    node.z_force = accumulator[8][i] * scale;
+    node.health_flags = window_health_flags[i];
+  }
+
+  output.frames = frames_in_window;
+
+  back = middle.exchange(back | USKIN_DECIMATION_NEW_BLOCK) & USKIN_DECIMATION_BLOCK_MASK;
+
+  {
+    std::lock_guard<std::mutex> lock(published_mutex);
+    blocks_published++;
+  }
+  published_changed.notify_all();
+}
+
+bool UskinDecimatedStream::read(_uskin_node_time_unit_reading *nodes, long long *timestamp_ns, int *frames)
+{
+  if (!(middle.load() & USKIN_DECIMATION_NEW_BLOCK))
+    return false;
+
+  front = middle.exchange(front) & USKIN_DECIMATION_BLOCK_MASK;
+
+  memcpy(nodes, blocks[front].nodes, number_of_nodes * sizeof(_uskin_node_time_unit_reading));
+
+  if (timestamp_ns != NULL)
+    *timestamp_ns = blocks[front].timestamp_ns;
+
+  if (frames != NULL)
+    *frames = blocks[front].frames;
+
+  return true;
+}
+
+bool UskinDecimatedStream::wait(long timeout_ms)
+{
+  std::unique_lock<std::mutex> lock(published_mutex);
+
+  return published_changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return (middle.load() & USKIN_DECIMATION_NEW_BLOCK) != 0; });
+}
+
+double UskinDecimatedStream::getRate()
+{
+  return 1e9 / period_ns;
+}
+
+uskin_decimation_mode UskinDecimatedStream::getMode()
+{
+  return mode;
+}
+
+unsigned long UskinDecimatedStream::getBlocksPublished()
+{
+  std::lock_guard<std::mutex> lock(published_mutex);
+
+  return blocks_published;
+}
+
+//###################### UskinDecimator #########################
+
+UskinDecimator::UskinDecimator(int number_of_nodes) : number_of_nodes(number_of_nodes), padded_nodes(padNodeCount(number_of_nodes))
+{
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+    input[c] = allocateNodeArray(padded_nodes);
+}
+
+UskinDecimator::~UskinDecimator()
+{
+  for (UskinDecimatedStream *stream : streams)
+    delete stream;
+
+  for (int c = 0; c < USKIN_DECIMATION_CHANNELS; c++)
+    freeNodeArray(input[c]);
+}
+
+UskinDecimatedStream *UskinDecimator::subscribe(double rate_hz, uskin_decimation_mode mode)
+{
+  if (rate_hz <= 0)
+    return NULL;
+
+  streams.push_back(new UskinDecimatedStream(number_of_nodes, rate_hz, mode));
+
+  return streams.back();
+}
+
+bool UskinDecimator::unsubscribe(UskinDecimatedStream *stream)
+{
+  std::vector<UskinDecimatedStream *>::iterator position = std::find(streams.begin(), streams.end(), stream);
+
+  if (position == streams.end())
+    return false;
+
+  delete stream;
+  streams.erase(position);
+
+  return true;
+}
+
+int UskinDecimator::getNumberOfStreams()
+{
+  return streams.size();
+}
+
+void UskinDecimator::process(const _uskin_node_time_unit_reading *frame, long long timestamp_ns)
+{
+  if (streams.empty())
+    return;
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    input[0][i] = frame[i].x_value;
+    input[1][i] = frame[i].y_value;
+    input[2][i] = frame[i].z_value;
+    input[3][i] = frame[i].x_value_filtered;
+    input[4][i] = frame[i].y_value_filtered;
+    input[5][i] = frame[i].z_value_filtered;
+    input[6][i] = frame[i].x_force;
+    input[7][i] = frame[i].y_force;
+    input[8][i] = frame[i].z_force;
+  }
+
+  for (UskinDecimatedStream *stream : streams)
+    stream->accumulate(input, frame, timestamp_ns);
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinDiscovery.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <net/if_arp.h>
+#include <array>
+#include "../include/uskinDiscovery.h"
+#include "../include/uskinCanDriver.h"
+
+// Node IDs are three hex digits B R C of 0 to 9 each
+#define USKIN_DISCOVERY_DIGITS 10
+// Listening slices while waiting for a stopped patch to go quiet
+#define USKIN_DISCOVERY_QUIET_SLICE_MS 5
+
+// Node messages received on one interface during one listening window
+struct discovery_window
+{
+  unsigned long messages[USKIN_DISCOVERY_DIGITS][USKIN_DISCOVERY_DIGITS][USKIN_DISCOVERY_DIGITS]; // [block][row][column]
+  __u32 start_request_id; // Start request sent by another host during the window (0 if none)
+  long long duration_ns;
+};
+
+struct discovery_interface
+{
+  std::string name;
+  int s;
+  discovery_window window;
+  bool streaming[USKIN_DISCOVERY_DIGITS]; // Blocks streaming before discovery started
+};
+
+// Node messages carry 8 bytes with a standard ID of hex digits B R C (B > 0), see UskinSensor::convertCanIDtoIndex
+static bool decodeNodeID(const can_frame &message, int *block, int *row, int *column)
+{
+  if (message.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG) || message.can_dlc != 8)
+    return false;
+
+  *block = message.can_id >> 8 & 0xf;
+  *row = message.can_id >> 4 & 0xf;
+  *column = message.can_id & 0xf;
+
+  return *block > 0 && *block < USKIN_DISCOVERY_DIGITS && *row < USKIN_DISCOVERY_DIGITS && *column < USKIN_DISCOVERY_DIGITS;
+}
+
+// Same layout as CanDriver::getDataRequestFrame(true)
+static bool isStartRequest(const can_frame &message)
+{
+  return message.can_dlc == 2 && message.data[0] == 0x07 && message.data[1] == 0x00;
+}
+
+static int openListener(std::string interface_name)
+{
+  struct sockaddr_can addr;
+  int s = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+
+  if (s < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = if_nametoindex(interface_name.c_str());
+
+  if (addr.can_ifindex == 0 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    close(s);
+    return -1;
+  }
+
+  return s;
+}
+
+static void sendRequest(discovery_interface &interface, __u32 device_id, bool start)
+{
+  CanDriver request_source(interface.name, device_id);
+  can_frame request = request_source.getDataRequestFrame(start);
+
+  if (send(interface.s, &request, sizeof(request), 0) != sizeof(request))
+    logError(2, "Could not send a request to " + std::to_string(device_id) + " on " + interface.name);
+}
+
+// Count the node messages received on every interface for window_ms
+static void listenWindow(std::vector<discovery_interface> &interfaces, long window_ms)
+{
+  std::vector<struct pollfd> descriptors(interfaces.size());
+
+  for (size_t i = 0; i < interfaces.size(); i++)
+  {
+    memset(&interfaces[i].window, 0, sizeof(discovery_window));
+    descriptors[i].fd = interfaces[i].s;
+    descriptors[i].events = POLLIN;
+  }
+
+  const long long start_ns = monotonicNow();
+  const long long deadline_ns = start_ns + window_ms * 1000000LL;
+  long long now_ns;
+
+  while ((now_ns = monotonicNow()) < deadline_ns)
+  {
+    if (poll(descriptors.data(), descriptors.size(), (deadline_ns - now_ns + 999999) / 1000000) <= 0)
+      continue;
+
+    for (size_t i = 0; i < interfaces.size(); i++)
+    {
+      if (!(descriptors[i].revents & POLLIN))
+        continue;
+
+      can_frame message;
+      int block, row, column;
+
+      while (recv(interfaces[i].s, &message, sizeof(message), MSG_DONTWAIT) == sizeof(message))
+      {
+        if (decodeNodeID(message, &block, &row, &column))
+          interfaces[i].window.messages[block][row][column]++;
+        else if (isStartRequest(message))
+          interfaces[i].window.start_request_id = message.can_id & CAN_SFF_MASK;
+      }
+    }
+  }
+
+  for (discovery_interface &interface : interfaces)
+    interface.window.duration_ns = monotonicNow() - start_ns;
+}
+
+static bool blockActive(const discovery_window &window, int block)
+{
+  for (int row = 0; row < USKIN_DISCOVERY_DIGITS; row++)
+  {
+    for (int column = 0; column < USKIN_DISCOVERY_DIGITS; column++)
+    {
+      if (window.messages[block][row][column] > 0)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// Grid of a block from the largest row and column received
+static uskin_discovered_sensor describeBlock(const discovery_interface &interface, int block)
+{
+  uskin_discovered_sensor discovered;
+  unsigned long busiest_node = 0;
+
+  discovered.interface_name = interface.name;
+  discovered.id_block = block;
+
+  for (int row = 0; row < USKIN_DISCOVERY_DIGITS; row++)
+  {
+    for (int column = 0; column < USKIN_DISCOVERY_DIGITS; column++)
+    {
+      unsigned long messages = interface.window.messages[block][row][column];
+
+      if (messages == 0)
+        continue;
+
+      discovered.rows = std::max(discovered.rows, row + 1);
+      discovered.columns = std::max(discovered.columns, column + 1);
+      discovered.nodes_seen++;
+      busiest_node = std::max(busiest_node, messages);
+    }
+  }
+
+  discovered.complete = discovered.nodes_seen == discovered.rows * discovered.columns;
+
+  if (interface.window.duration_ns > 0)
+    discovered.frame_rate_hz = busiest_node * 1e9 / interface.window.duration_ns;
+
+  return discovered;
+}
+
+//###################### UskinBusDiscovery #########################
+
+UskinBusDiscovery::UskinBusDiscovery(uskin_discovery_config new_config) : config(new_config)
+{
+  if (config.window_ms <= 0)
+    config.window_ms = USKIN_DISCOVERY_WINDOW_MS;
+}
+
+std::vector<std::string> UskinBusDiscovery::listCanInterfaces()
+{
+  std::vector<std::string> interfaces;
+  struct if_nameindex *names = if_nameindex();
+  int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if (names != NULL && s >= 0)
+  {
+    for (struct if_nameindex *current = names; current->if_index != 0; current++)
+    {
+      struct ifreq request;
+
+      memset(&request, 0, sizeof(request));
+      strncpy(request.ifr_name, current->if_name, IFNAMSIZ - 1);
+
+      if (ioctl(s, SIOCGIFHWADDR, &request) == 0 && request.ifr_hwaddr.sa_family == ARPHRD_CAN)
+        interfaces.push_back(current->if_name);
+    }
+  }
+
+  if (names != NULL)
+    if_freenameindex(names);
+
+  if (s >= 0)
+    close(s);
+
+  return interfaces;
+}
+
+std::vector<uskin_discovered_sensor> UskinBusDiscovery::discover(std::vector<std::string> interface_names)
+{
+  logInfo(1, ">> UskinBusDiscovery::discover()");
+
+  std::vector<uskin_discovered_sensor> found;
+  std::vector<discovery_interface> interfaces;
+
+  if (interface_names.empty())
+    interface_names = listCanInterfaces();
+
+  for (std::string &name : interface_names)
+  {
+    discovery_interface interface;
+
+    interface.name = name;
+    interface.s = openListener(name);
+    memset(interface.streaming, 0, sizeof(interface.streaming));
+
+    if (interface.s < 0)
+    {
+      logError(2, "Could not listen on " + name);
+      continue;
+    }
+
+    interfaces.push_back(interface);
+  }
+
+  // Patches already streaming (e.g. started by another process)
+  listenWindow(interfaces, config.window_ms);
+
+  for (discovery_interface &interface : interfaces)
+  {
+    for (int block = 1; block < USKIN_DISCOVERY_DIGITS; block++)
+    {
+      if (!blockActive(interface.window, block))
+        continue;
+
+      interface.streaming[block] = true;
+
+      uskin_discovered_sensor discovered = describeBlock(interface, block);
+      discovered.device_id = interface.window.start_request_id;
+      discovered.was_streaming = true;
+      found.push_back(discovered);
+    }
+  }
+
+  // Each candidate is started on every interface at once; node IDs that appear belong to it. Patches already
+  // streaming are ignored, and a candidate is only stopped if it started something
+  for (size_t candidate = 0; config.probe && candidate < config.device_ids.size(); candidate++)
+  {
+    const __u32 device_id = config.device_ids[candidate];
+    bool any_started = false;
+    std::vector<std::array<bool, USKIN_DISCOVERY_DIGITS>> started(interfaces.size()); // Blocks started per interface, all false
+
+    for (discovery_interface &interface : interfaces)
+      sendRequest(interface, device_id, true);
+
+    listenWindow(interfaces, config.window_ms);
+
+    for (size_t i = 0; i < interfaces.size(); i++)
+    {
+      bool started_here = false;
+
+      for (int block = 1; block < USKIN_DISCOVERY_DIGITS; block++)
+      {
+        if (interfaces[i].streaming[block] || !blockActive(interfaces[i].window, block))
+          continue;
+
+        uskin_discovered_sensor discovered = describeBlock(interfaces[i], block);
+        discovered.device_id = device_id;
+        found.push_back(discovered);
+
+        started[i][block] = true;
+        started_here = true;
+      }
+
+      if (started_here)
+        sendRequest(interfaces[i], device_id, false);
+
+      any_started |= started_here;
+    }
+
+    // The next candidate must not be credited with this one's remaining messages
+    for (long waited_ms = 0; any_started && waited_ms < USKIN_DISCOVERY_QUIET_MS; waited_ms += USKIN_DISCOVERY_QUIET_SLICE_MS)
+    {
+      listenWindow(interfaces, USKIN_DISCOVERY_QUIET_SLICE_MS);
+
+      any_started = false;
+
+      for (size_t i = 0; i < interfaces.size(); i++)
+      {
+        for (int block = 1; block < USKIN_DISCOVERY_DIGITS; block++)
+          any_started |= started[i][block] && blockActive(interfaces[i].window, block);
+      }
+    }
+  }
+
+  for (discovery_interface &interface : interfaces)
+    close(interface.s);
+
+  logInfo(2, "Found " + std::to_string(found.size()) + " sensors on " + std::to_string(interfaces.size()) + " interfaces");
+  logInfo(1, "<< UskinBusDiscovery::discover()");
+
+  return found;
+}
+
+UskinSensor *UskinBusDiscovery::createSensor(const uskin_discovered_sensor &discovered)
+{
+  if (discovered.id_block != 1 || discovered.rows <= 0 || discovered.columns <= 0)
+  {
+    logError(2, "Node IDs " + std::to_string(discovered.id_block) + "RC are not read by UskinSensor");
+    return NULL;
+  }
+
+  if (!discovered.complete)
+    logError(2, "Only " + std::to_string(discovered.nodes_seen) + " nodes of the " + std::to_string(discovered.rows) + "x" + std::to_string(discovered.columns) + " grid were seen");
+
+  CanDriver *driver = discovered.device_id != 0 ? new CanDriver(discovered.interface_name, discovered.device_id) : new CanDriver(discovered.interface_name);
+
+  return new UskinSensor(discovered.columns, discovered.rows, driver);
+}
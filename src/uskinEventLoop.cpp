@@ -0,0 +1,242 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinEventLoop.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "../include/uskinEventLoop.h"
+#include "../include/uskinCanDriver.h"
+
+// Events handled per epoll_wait call
+#define USKIN_EVENT_LOOP_MAX_EVENTS 64
+
+//###################### UskinEventLoop #########################
+
+UskinEventLoop::UskinEventLoop() : stop_requested(false)
+{
+  epoll_descriptor = epoll_create1(EPOLL_CLOEXEC);
+  wake_descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (epoll_descriptor < 0 || wake_descriptor < 0)
+  {
+    logError(2, "Could not create the event loop descriptors");
+    return;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = NULL; // The wake descriptor
+
+  epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, wake_descriptor, &event);
+}
+
+UskinEventLoop::~UskinEventLoop()
+{
+  for (watched_sensor *current : sensors)
+    delete current;
+
+  releaseRemoved();
+
+  if (wake_descriptor >= 0)
+    close(wake_descriptor);
+
+  if (epoll_descriptor >= 0)
+    close(epoll_descriptor);
+}
+
+bool UskinEventLoop::addSensor(UskinSensor *sensor, std::function<void()> on_frame, std::function<void()> on_error)
+{
+  int descriptor = sensor->GetReceiveDescriptor();
+
+  if (epoll_descriptor < 0 || descriptor < 0)
+  {
+    logError(2, "The sensor has no receive descriptor, it must be started first");
+    return false;
+  }
+
+  watched_sensor *current = new watched_sensor;
+  current->sensor = sensor;
+  current->descriptor = descriptor;
+  current->on_frame = on_frame;
+  current->on_error = on_error;
+  current->removed = false;
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = current;
+
+  if (epoll_ctl(epoll_descriptor, EPOLL_CTL_ADD, descriptor, &event) < 0)
+  {
+    logError(2, "Could not watch descriptor " + std::to_string(descriptor));
+    delete current;
+    return false;
+  }
+
+  sensors.push_back(current);
+
+  return true;
+}
+
+bool UskinEventLoop::removeSensor(UskinSensor *sensor)
+{
+  for (std::vector<watched_sensor *>::iterator current = sensors.begin(); current != sensors.end(); ++current)
+  {
+    if ((*current)->sensor != sensor)
+      continue;
+
+    epoll_ctl(epoll_descriptor, EPOLL_CTL_DEL, (*current)->descriptor, NULL);
+
+    // Events already returned by epoll_wait may still point to it
+    (*current)->removed = true;
+    removed_sensors.push_back(*current);
+    sensors.erase(current);
+
+    if (!dispatching)
+      releaseRemoved();
+
+    return true;
+  }
+
+  return false;
+}
+
+int UskinEventLoop::getNumberOfSensors()
+{
+  return sensors.size();
+}
+
+void UskinEventLoop::releaseRemoved()
+{
+  for (watched_sensor *current : removed_sensors)
+    delete current;
+
+  removed_sensors.clear();
+}
+
+void UskinEventLoop::wake()
+{
+  uint64_t one = 1;
+
+  if (write(wake_descriptor, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    logError(2, "Could not wake the event loop");
+}
+
+void UskinEventLoop::post(std::function<void()> work)
+{
+  {
+    std::lock_guard<std::mutex> lock(posted_mutex);
+    posted.push_back(work);
+  }
+
+  wake();
+}
+
+void UskinEventLoop::runPosted()
+{
+  uint64_t count;
+
+  if (read(wake_descriptor, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    logError(2, "Could not read the event loop wake descriptor");
+
+  {
+    std::lock_guard<std::mutex> lock(posted_mutex);
+    running_posted.swap(posted);
+  }
+
+  // Work posted from here on runs on the next call
+  for (std::function<void()> &work : running_posted)
+    work();
+
+  running_posted.clear();
+}
+
+int UskinEventLoop::runOnce(long timeout_ms)
+{
+  struct epoll_event events[USKIN_EVENT_LOOP_MAX_EVENTS];
+  int frames = 0;
+
+  int n_events = epoll_wait(epoll_descriptor, events, USKIN_EVENT_LOOP_MAX_EVENTS, timeout_ms < 0 ? -1 : (int)timeout_ms);
+
+  if (n_events < 0)
+  {
+    if (errno != EINTR)
+      logError(2, "Error while waiting for events");
+
+    return 0;
+  }
+
+  dispatching = true;
+
+  for (int i = 0; i < n_events; i++)
+  {
+    watched_sensor *current = (watched_sensor *)events[i].data.ptr;
+
+    if (current == NULL)
+    {
+      runPosted();
+      continue;
+    }
+
+    int polled = 0;
+
+    // Level triggered: a frame still incomplete once the socket is drained waits for its next message
+    while (!current->removed && (polled = current->sensor->PollFrameData()) > 0)
+    {
+      frames++;
+
+      if (current->on_frame)
+        current->on_frame();
+    }
+
+    // A failed descriptor stays readable, so it would wake every epoll_wait: stop watching it
+    if (!current->removed && (polled < 0 || (events[i].events & (EPOLLERR | EPOLLHUP))))
+    {
+      logError(2, "Could not read descriptor " + std::to_string(current->descriptor) + ", the sensor was removed");
+
+      removeSensor(current->sensor);
+
+      // Still valid while dispatching
+      if (current->on_error)
+        current->on_error();
+    }
+  }
+
+  dispatching = false;
+
+  releaseRemoved();
+
+  return frames;
+}
+
+void UskinEventLoop::run()
+{
+  logInfo(1, ">> UskinEventLoop::run()");
+
+  while (!stop_requested)
+    runOnce(-1);
+
+  stop_requested = false;
+
+  logInfo(1, "<< UskinEventLoop::run()");
+}
+
+void UskinEventLoop::stop()
+{
+  stop_requested = true;
+  wake();
+}
+
+int UskinEventLoop::getDescriptor()
+{
+  return epoll_descriptor;
+}
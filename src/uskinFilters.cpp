@@ -0,0 +1,260 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFilters.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinFilters.h"
+#include "../include/uskinCanDriver.h"
+
+//###################### Utils #########################
+
+// 16 byte aligned, zero initialized array of floats
+float *allocateNodeArray(int number_of_elements)
+{
+  void *array = NULL;
+
+  if (posix_memalign(&array, sizeof(uskin_vec4), number_of_elements * sizeof(float)) != 0)
+    return NULL;
+
+  memset(array, 0, number_of_elements * sizeof(float));
+
+  return (float *)array;
+}
+
+void freeNodeArray(float *array)
+{
+  free(array);
+}
+
+int padNodeCount(int number_of_nodes)
+{
+  return (number_of_nodes + USKIN_VECTOR_LANES - 1) / USKIN_VECTOR_LANES * USKIN_VECTOR_LANES;
+}
+
+//###################### UskinFrameFilter #########################
+
+UskinFrameFilter::UskinFrameFilter(int number_of_nodes) : number_of_nodes(number_of_nodes), padded_nodes(padNodeCount(number_of_nodes))
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    input[axis] = allocateNodeArray(padded_nodes);
+    output[axis] = allocateNodeArray(padded_nodes);
+    state_1[axis] = allocateNodeArray(padded_nodes);
+    state_2[axis] = allocateNodeArray(padded_nodes);
+    median_history[axis] = allocateNodeArray(5 * padded_nodes);
+
+    b0[axis] = 1;
+    b1[axis] = b2[axis] = a1[axis] = a2[axis] = 0;
+  }
+}
+
+UskinFrameFilter::~UskinFrameFilter()
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    freeNodeArray(input[axis]);
+    freeNodeArray(output[axis]);
+    freeNodeArray(state_1[axis]);
+    freeNodeArray(state_2[axis]);
+    freeNodeArray(median_history[axis]);
+  }
+}
+
+// Set filter type and parameters of one axis (USKIN_AXIS_X, USKIN_AXIS_Y or USKIN_AXIS_Z)
+void UskinFrameFilter::configureAxis(int axis, uskin_filter_config new_config)
+{
+  if (axis < 0 || axis > 2)
+  {
+    logError(2, "Invalid filter axis " + std::to_string(axis));
+    return;
+  }
+
+  if (new_config.type == USKIN_FILTER_MEDIAN && new_config.median_window != 3 && new_config.median_window != 5)
+  {
+    logError(2, "Median window must be 3 or 5, using 3");
+    new_config.median_window = 3;
+  }
+
+  config[axis] = new_config;
+
+  if (new_config.type == USKIN_FILTER_BIQUAD_LOWPASS)
+  {
+    float w0 = 2 * M_PI * new_config.cutoff_frequency / new_config.sample_frequency;
+    float alpha = sinf(w0) / (2 * new_config.q);
+    float cos_w0 = cosf(w0);
+    float a0 = 1 + alpha;
+
+    b0[axis] = ((1 - cos_w0) / 2) / a0;
+    b1[axis] = (1 - cos_w0) / a0;
+    b2[axis] = ((1 - cos_w0) / 2) / a0;
+    a1[axis] = (-2 * cos_w0) / a0;
+    a2[axis] = (1 - alpha) / a0;
+  }
+
+  reset();
+}
+
+uskin_filter_config UskinFrameFilter::getAxisConfiguration(int axis)
+{
+  return config[axis];
+}
+
+// Forget filter history. State will be seeded again from the next frame
+void UskinFrameFilter::reset()
+{
+  state_initialized = false;
+  median_position = 0;
+}
+
+// Initialize every filter in steady state with the current input (output equals input)
+void UskinFrameFilter::seedState()
+{
+  for (int axis = 0; axis < 3; axis++)
+  {
+    for (int i = 0; i < padded_nodes; i++)
+    {
+      float x = input[axis][i];
+
+      if (config[axis].type == USKIN_FILTER_BIQUAD_LOWPASS)
+      {
+        state_1[axis][i] = (1 - b0[axis]) * x;
+        state_2[axis][i] = (b2[axis] - a2[axis]) * x;
+      }
+      else
+      {
+        state_1[axis][i] = x;
+        state_2[axis][i] = 0;
+      }
+
+      for (int k = 0; k < 5; k++)
+        median_history[axis][k * padded_nodes + i] = x;
+    }
+  }
+
+  state_initialized = true;
+}
+
+void UskinFrameFilter::filterIIR(int axis)
+{
+  const uskin_vec4 alpha = vec_set(config[axis].alpha);
+  const uskin_vec4 *x = (const uskin_vec4 *)input[axis];
+  uskin_vec4 *y = (uskin_vec4 *)state_1[axis];
+  uskin_vec4 *out = (uskin_vec4 *)output[axis];
+
+  for (int i = 0; i < padded_nodes / USKIN_VECTOR_LANES; i++)
+  {
+    y[i] += alpha * (x[i] - y[i]);
+    out[i] = y[i];
+  }
+}
+
+// Direct form II transposed
+void UskinFrameFilter::filterBiquad(int axis)
+{
+  const uskin_vec4 vb0 = vec_set(b0[axis]), vb1 = vec_set(b1[axis]), vb2 = vec_set(b2[axis]);
+  const uskin_vec4 va1 = vec_set(a1[axis]), va2 = vec_set(a2[axis]);
+  const uskin_vec4 *x = (const uskin_vec4 *)input[axis];
+  uskin_vec4 *z1 = (uskin_vec4 *)state_1[axis];
+  uskin_vec4 *z2 = (uskin_vec4 *)state_2[axis];
+  uskin_vec4 *out = (uskin_vec4 *)output[axis];
+
+  for (int i = 0; i < padded_nodes / USKIN_VECTOR_LANES; i++)
+  {
+    uskin_vec4 y = vb0 * x[i] + z1[i];
+    z1[i] = vb1 * x[i] - va1 * y + z2[i];
+    z2[i] = vb2 * x[i] - va2 * y;
+    out[i] = y;
+  }
+}
+
+// Branch-free median using min/max sorting networks
+void UskinFrameFilter::filterMedian(int axis)
+{
+  const int window = config[axis].median_window;
+  const int lanes = padded_nodes / USKIN_VECTOR_LANES;
+  uskin_vec4 *history = (uskin_vec4 *)median_history[axis];
+  const uskin_vec4 *x = (const uskin_vec4 *)input[axis];
+  uskin_vec4 *out = (uskin_vec4 *)output[axis];
+
+  for (int i = 0; i < lanes; i++)
+    history[(median_position % window) * lanes + i] = x[i];
+
+  for (int i = 0; i < lanes; i++)
+  {
+    uskin_vec4 a = history[i], b = history[lanes + i], c = history[2 * lanes + i];
+
+    if (window == 3)
+    {
+      out[i] = vec_max(vec_min(a, b), vec_min(vec_max(a, b), c));
+    }
+    else
+    {
+      uskin_vec4 d = history[3 * lanes + i], e = history[4 * lanes + i];
+
+      // Drop the lowest and the highest of (a, b, c, d); median of 5 is the median of the rest and e
+      uskin_vec4 f = vec_max(vec_min(a, b), vec_min(c, d));
+      uskin_vec4 g = vec_min(vec_max(a, b), vec_max(c, d));
+      out[i] = vec_max(vec_min(f, g), vec_min(vec_max(f, g), e));
+    }
+  }
+}
+
+// Gather the frame into per axis arrays, filter all nodes of each axis in one pass and scatter the results back
+void UskinFrameFilter::filter(_uskin_node_time_unit_reading *frame)
+{
+  logInfo(3, ">> UskinFrameFilter::filter()");
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    input[USKIN_AXIS_X][i] = frame[i].x_value;
+    input[USKIN_AXIS_Y][i] = frame[i].y_value;
+    input[USKIN_AXIS_Z][i] = frame[i].z_value;
+  }
+
+  if (!state_initialized)
+    seedState();
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    switch (config[axis].type)
+    {
+    case USKIN_FILTER_IIR:
+      filterIIR(axis);
+      break;
+    case USKIN_FILTER_BIQUAD_LOWPASS:
+      filterBiquad(axis);
+      break;
+    case USKIN_FILTER_MEDIAN:
+      filterMedian(axis);
+      break;
+    default:
+      memcpy(output[axis], input[axis], padded_nodes * sizeof(float));
+      break;
+    }
+  }
+
+  median_position = (median_position + 1) % 15; // Multiple of both window sizes
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    frame[i].x_value_filtered = output[USKIN_AXIS_X][i];
+    frame[i].y_value_filtered = output[USKIN_AXIS_Y][i];
+    frame[i].z_value_filtered = output[USKIN_AXIS_Z][i];
+  }
+
+  logInfo(3, "<< UskinFrameFilter::filter()");
+}
+
+const float *UskinFrameFilter::getFilteredValues(int axis)
+{
+  return output[axis];
+}
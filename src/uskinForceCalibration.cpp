@@ -0,0 +1,274 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinForceCalibration.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "../include/uskinForceCalibration.h"
+#include "../include/uskinCanDriver.h"
+
+// Coefficients of one node, in the layout of the unified kernel
+struct node_force_model
+{
+  int node;
+  float offset[3];
+  float matrix[3][3];
+  float square[3];
+  float cube[3];
+};
+
+//###################### UskinForceCalibration #########################
+
+UskinForceCalibration::UskinForceCalibration(int number_of_nodes) : number_of_nodes(number_of_nodes), padded_nodes(padNodeCount(number_of_nodes))
+{
+  for (int a = 0; a < 3; a++)
+  {
+    offset[a] = allocateNodeArray(padded_nodes);
+    square[a] = allocateNodeArray(padded_nodes);
+    cube[a] = allocateNodeArray(padded_nodes);
+    baseline[a] = allocateNodeArray(padded_nodes);
+    input[a] = allocateNodeArray(padded_nodes);
+    output[a] = allocateNodeArray(padded_nodes);
+
+    for (int b = 0; b < 3; b++)
+      matrix[a][b] = allocateNodeArray(padded_nodes);
+  }
+
+  node_calibrated = new bool[number_of_nodes];
+  memset(node_calibrated, 0, number_of_nodes * sizeof(bool));
+}
+
+UskinForceCalibration::~UskinForceCalibration()
+{
+  for (int a = 0; a < 3; a++)
+  {
+    freeNodeArray(offset[a]);
+    freeNodeArray(square[a]);
+    freeNodeArray(cube[a]);
+    freeNodeArray(baseline[a]);
+    freeNodeArray(input[a]);
+    freeNodeArray(output[a]);
+
+    for (int b = 0; b < 3; b++)
+      freeNodeArray(matrix[a][b]);
+  }
+
+  delete[] node_calibrated;
+}
+
+void UskinForceCalibration::clearModels()
+{
+  for (int a = 0; a < 3; a++)
+  {
+    memset(offset[a], 0, padded_nodes * sizeof(float));
+    memset(square[a], 0, padded_nodes * sizeof(float));
+    memset(cube[a], 0, padded_nodes * sizeof(float));
+
+    for (int b = 0; b < 3; b++)
+      memset(matrix[a][b], 0, padded_nodes * sizeof(float));
+  }
+
+  memset(node_calibrated, 0, number_of_nodes * sizeof(bool));
+}
+
+bool UskinForceCalibration::loadFile(std::string filename)
+{
+  logInfo(1, ">> UskinForceCalibration::loadFile(" + filename + ")");
+
+  std::ifstream file(filename.c_str());
+  std::vector<node_force_model> models;
+  std::string line;
+  bool file_relative_to_baseline = true;
+  int line_number = 0;
+
+  if (!file.is_open())
+  {
+    logError(2, "Could not open force calibration " + filename);
+    logInfo(1, "<< UskinForceCalibration::loadFile()");
+    return false;
+  }
+
+  while (std::getline(file, line))
+  {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream fields(line);
+    std::string first, type;
+
+    if (!(fields >> first))
+      continue;
+
+    if (first == "input")
+    {
+      fields >> type;
+
+      if (type != "baseline" && type != "raw")
+      {
+        logError(2, filename + ":" + std::to_string(line_number) + ": input must be 'baseline' or 'raw'");
+        logInfo(1, "<< UskinForceCalibration::loadFile()");
+        return false;
+      }
+
+      file_relative_to_baseline = type == "baseline";
+      continue;
+    }
+
+    node_force_model model;
+    bool valid;
+
+    memset(&model, 0, sizeof(model));
+    model.node = atoi(first.c_str());
+    fields >> type;
+
+    if (type == "linear")
+    {
+      for (int a = 0; a < 3; a++)
+        for (int b = 0; b < 3; b++)
+          fields >> model.matrix[a][b];
+
+      valid = (bool)(fields >> model.offset[0] >> model.offset[1] >> model.offset[2]);
+    }
+    else if (type == "poly")
+    {
+      valid = true;
+
+      for (int a = 0; a < 3 && valid; a++)
+        valid = (bool)(fields >> model.offset[a] >> model.matrix[a][a] >> model.square[a] >> model.cube[a]);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    if (!valid || model.node < 0 || model.node >= number_of_nodes || first.find_first_not_of("0123456789") != std::string::npos)
+    {
+      logError(2, filename + ":" + std::to_string(line_number) + ": invalid node model");
+      logInfo(1, "<< UskinForceCalibration::loadFile()");
+      return false;
+    }
+
+    models.push_back(model);
+  }
+
+  clearModels();
+  relative_to_baseline = file_relative_to_baseline;
+
+  for (const node_force_model &model : models)
+  {
+    int i = model.node;
+
+    for (int a = 0; a < 3; a++)
+    {
+      offset[a][i] = model.offset[a];
+      square[a][i] = model.square[a];
+      cube[a][i] = model.cube[a];
+
+      for (int b = 0; b < 3; b++)
+        matrix[a][b][i] = model.matrix[a][b];
+    }
+
+    node_calibrated[i] = true;
+  }
+
+  if ((int)models.size() < number_of_nodes)
+    logError(2, "Force calibration " + filename + " has models for " + std::to_string(models.size()) + " of " + std::to_string(number_of_nodes) + " nodes");
+
+  logInfo(1, "<< UskinForceCalibration::loadFile()");
+
+  return true;
+}
+
+bool UskinForceCalibration::usesBaseline()
+{
+  return relative_to_baseline;
+}
+
+void UskinForceCalibration::setBaseline(int node, float x, float y, float z)
+{
+  if (node < 0 || node >= number_of_nodes)
+    return;
+
+  baseline[0][node] = x;
+  baseline[1][node] = y;
+  baseline[2][node] = z;
+}
+
+bool UskinForceCalibration::isNodeCalibrated(int node)
+{
+  return node >= 0 && node < number_of_nodes && node_calibrated[node];
+}
+
+void UskinForceCalibration::apply(_uskin_node_time_unit_reading *frame)
+{
+  const int lanes = padded_nodes / USKIN_VECTOR_LANES;
+  const float baseline_scale = relative_to_baseline ? 1 : 0;
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    input[0][i] = frame[i].x_value - baseline_scale * baseline[0][i];
+    input[1][i] = frame[i].y_value - baseline_scale * baseline[1][i];
+    input[2][i] = frame[i].z_value - baseline_scale * baseline[2][i];
+  }
+
+  const uskin_vec4 *r[3] = {(const uskin_vec4 *)input[0], (const uskin_vec4 *)input[1], (const uskin_vec4 *)input[2]};
+
+  for (int a = 0; a < 3; a++)
+  {
+    const uskin_vec4 *o = (const uskin_vec4 *)offset[a];
+    const uskin_vec4 *m0 = (const uskin_vec4 *)matrix[a][0];
+    const uskin_vec4 *m1 = (const uskin_vec4 *)matrix[a][1];
+    const uskin_vec4 *m2 = (const uskin_vec4 *)matrix[a][2];
+    const uskin_vec4 *c2 = (const uskin_vec4 *)square[a];
+    const uskin_vec4 *c3 = (const uskin_vec4 *)cube[a];
+    uskin_vec4 *f = (uskin_vec4 *)output[a];
+
+    for (int i = 0; i < lanes; i++)
+    {
+      uskin_vec4 own = r[a][i];
+
+      f[i] = o[i] + m0[i] * r[0][i] + m1[i] * r[1][i] + m2[i] * r[2][i] + (c2[i] + c3[i] * own) * own * own;
+    }
+  }
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    frame[i].x_force = output[0][i];
+    frame[i].y_force = output[1][i];
+    frame[i].z_force = output[2][i];
+  }
+}
+
+void UskinForceCalibration::applyNode(_uskin_node_time_unit_reading *frame, int node)
+{
+  const float baseline_scale = relative_to_baseline ? 1 : 0;
+  const int i = node;
+  float r[3];
+
+  r[0] = frame[i].x_value - baseline_scale * baseline[0][i];
+  r[1] = frame[i].y_value - baseline_scale * baseline[1][i];
+  r[2] = frame[i].z_value - baseline_scale * baseline[2][i];
+
+  for (int a = 0; a < 3; a++)
+    output[a][i] = offset[a][i] + matrix[a][0][i] * r[0] + matrix[a][1][i] * r[1] + matrix[a][2][i] * r[2] + (square[a][i] + cube[a][i] * r[a]) * r[a] * r[a];
+
+  frame[i].x_force = output[0][i];
+  frame[i].y_force = output[1][i];
+  frame[i].z_force = output[2][i];
+}
+
+const float *UskinForceCalibration::getForces(int axis)
+{
+  return output[axis];
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFrameFusion.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinFrameFusion.h"
+#include "../include/uskinCanDriver.h"
+
+//###################### UskinFrameFusion #########################
+
+UskinFrameFusion::UskinFrameFusion(uskin_fusion_mode new_mode) : mode(new_mode){};
+
+UskinFrameFusion::~UskinFrameFusion()
+{
+  delete[] fused_frame;
+};
+
+int UskinFrameFusion::addSensor(UskinSensor *sensor)
+{
+  logInfo(1, ">> UskinFrameFusion::addSensor()");
+
+  if (sensor->GetFrameHistory() == NULL)
+    sensor->EnableFrameHistory(USKIN_FUSION_DEFAULT_HISTORY);
+
+  sensors.push_back(sensor);
+  node_offsets.push_back(total_nodes);
+  sensor_status.push_back(uskin_fusion_sensor_status());
+
+  total_nodes += sensor->GetUskinFrameSize();
+
+  delete[] fused_frame;
+  fused_frame = new float[total_nodes * 3]();
+
+  logInfo(1, "<< UskinFrameFusion::addSensor()");
+
+  return sensors.size() - 1;
+}
+
+int UskinFrameFusion::getNumberOfSensors()
+{
+  return sensors.size();
+}
+
+int UskinFrameFusion::getTotalNodes()
+{
+  return total_nodes;
+}
+
+int UskinFrameFusion::getNodeOffset(int sensor)
+{
+  return node_offsets[sensor];
+}
+
+bool UskinFrameFusion::fuse(long long tick_ns)
+{
+  logInfo(2, ">> UskinFrameFusion::fuse(" + std::to_string(tick_ns) + ")");
+
+  bool all_valid = true;
+
+  last_tick_ns = tick_ns;
+
+  for (unsigned int s = 0; s < sensors.size(); s++)
+  {
+    uskin_fusion_sensor_status *status = &sensor_status[s];
+    float *output = &fused_frame[node_offsets[s] * 3];
+    long long newest_ns;
+
+    // Sampled under the sensor's frame lock: the acquisition thread keeps pushing into the history
+    if (!sensors[s]->SampleFrameHistory(tick_ns, mode == USKIN_FUSION_INTERPOLATE, output, &status->sample_ns, &newest_ns))
+    {
+      status->valid = false;
+      all_valid = false;
+      logError(3, "Sensor " + std::to_string(s) + " has no frames to fuse");
+      continue;
+    }
+
+    status->valid = true;
+    status->age_ns = tick_ns - newest_ns;
+
+    status->skew_ns = status->sample_ns - tick_ns;
+  }
+
+  logInfo(2, "<< UskinFrameFusion::fuse()");
+
+  return all_valid;
+}
+
+bool UskinFrameFusion::fuse()
+{
+  return fuse(now());
+}
+
+const float *UskinFrameFusion::getFusedFrame()
+{
+  return fused_frame;
+}
+
+long long UskinFrameFusion::getLastTick()
+{
+  return last_tick_ns;
+}
+
+uskin_fusion_sensor_status UskinFrameFusion::getSensorStatus(int sensor)
+{
+  return sensor_status[sensor];
+}
+
+long long UskinFrameFusion::getMaxSkew()
+{
+  long long max_skew = 0;
+
+  for (unsigned int s = 0; s < sensor_status.size(); s++)
+  {
+    long long skew = sensor_status[s].skew_ns < 0 ? -sensor_status[s].skew_ns : sensor_status[s].skew_ns;
+
+    if (sensor_status[s].valid && skew > max_skew)
+      max_skew = skew;
+  }
+
+  return max_skew;
+}
+
+// Current CLOCK_REALTIME time in nanoseconds
+long long UskinFrameFusion::now()
+{
+  struct timespec current_time;
+
+  clock_gettime(CLOCK_REALTIME, &current_time);
+
+  return current_time.tv_sec * 1000000000LL + current_time.tv_nsec;
+}
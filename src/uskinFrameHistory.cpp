@@ -0,0 +1,198 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinFrameHistory.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinFrameHistory.h"
+#include "../include/uskinCanDriver.h"
+
+//###################### UskinFrameHistory #########################
+
+UskinFrameHistory::UskinFrameHistory(int capacity, int number_of_nodes) : capacity(capacity), number_of_nodes(number_of_nodes), frame_stride(number_of_nodes * 3)
+{
+  values = new int[2 * capacity * frame_stride]();
+  timestamps = new long long[2 * capacity]();
+}
+
+UskinFrameHistory::~UskinFrameHistory()
+{
+  delete[] values;
+  delete[] timestamps;
+}
+
+int UskinFrameHistory::physicalSlot(int index)
+{
+  return (head - frames_stored + index + capacity) % capacity;
+}
+
+// Store a frame, overwriting the oldest one when the history is full
+void UskinFrameHistory::push(long long timestamp_ns, const _uskin_node_time_unit_reading *frame)
+{
+  int *slot = &values[head * frame_stride];
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    slot[3 * i] = frame[i].x_value;
+    slot[3 * i + 1] = frame[i].y_value;
+    slot[3 * i + 2] = frame[i].z_value;
+  }
+
+  // Mirror copy, keeps windows contiguous across the wrap-around
+  memcpy(&values[(head + capacity) * frame_stride], slot, frame_stride * sizeof(int));
+
+  timestamps[head] = timestamp_ns;
+  timestamps[head + capacity] = timestamp_ns;
+
+  head = (head + 1) % capacity;
+
+  if (frames_stored < capacity)
+    frames_stored++;
+
+  frames_pushed++;
+}
+
+void UskinFrameHistory::clear()
+{
+  head = 0;
+  frames_stored = 0;
+}
+
+int UskinFrameHistory::size()
+{
+  return frames_stored;
+}
+
+int UskinFrameHistory::getCapacity()
+{
+  return capacity;
+}
+
+int UskinFrameHistory::getNumberOfNodes()
+{
+  return number_of_nodes;
+}
+
+unsigned long long UskinFrameHistory::getFramesPushed()
+{
+  return frames_pushed;
+}
+
+const int *UskinFrameHistory::getFrame(int index)
+{
+  if (index < 0 || index >= frames_stored)
+    return NULL;
+
+  return &values[physicalSlot(index) * frame_stride];
+}
+
+long long UskinFrameHistory::getTimestamp(int index)
+{
+  if (index < 0 || index >= frames_stored)
+    return 0;
+
+  return timestamps[physicalSlot(index)];
+}
+
+const int *UskinFrameHistory::getWindow(int number_of_frames)
+{
+  if (number_of_frames <= 0 || number_of_frames > frames_stored)
+    return NULL;
+
+  return &values[physicalSlot(frames_stored - number_of_frames) * frame_stride];
+}
+
+const long long *UskinFrameHistory::getWindowTimestamps(int number_of_frames)
+{
+  if (number_of_frames <= 0 || number_of_frames > frames_stored)
+    return NULL;
+
+  return &timestamps[physicalSlot(frames_stored - number_of_frames)];
+}
+
+int UskinFrameHistory::findRange(long long start_ns, long long end_ns, int *first_index)
+{
+  int low = 0, high = frames_stored;
+
+  // First frame with timestamp >= start_ns
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+
+    if (getTimestamp(middle) < start_ns)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  *first_index = low;
+
+  // First frame with timestamp > end_ns
+  high = frames_stored;
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+
+    if (getTimestamp(middle) <= end_ns)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low - *first_index;
+}
+
+int UskinFrameHistory::findNearest(long long timestamp_ns)
+{
+  int first;
+
+  if (frames_stored == 0)
+    return -1;
+
+  // first is the first frame at or after timestamp_ns, compare it with its predecessor
+  findRange(timestamp_ns, timestamp_ns, &first);
+
+  if (first == frames_stored)
+    return frames_stored - 1;
+
+  if (first > 0 && timestamp_ns - getTimestamp(first - 1) <= getTimestamp(first) - timestamp_ns)
+    return first - 1;
+
+  return first;
+}
+
+bool UskinFrameHistory::interpolate(long long timestamp_ns, float *output)
+{
+  int after;
+
+  if (frames_stored == 0 || timestamp_ns < getTimestamp(0) || timestamp_ns > getTimestamp(frames_stored - 1))
+    return false;
+
+  findRange(timestamp_ns, timestamp_ns, &after);
+
+  const int *next = getFrame(after);
+
+  if (getTimestamp(after) == timestamp_ns || after == 0)
+  {
+    for (int i = 0; i < frame_stride; i++)
+      output[i] = next[i];
+
+    return true;
+  }
+
+  const int *previous = getFrame(after - 1);
+  float weight = (float)(timestamp_ns - getTimestamp(after - 1)) / (getTimestamp(after) - getTimestamp(after - 1));
+
+  for (int i = 0; i < frame_stride; i++)
+    output[i] = previous[i] + weight * (next[i] - previous[i]);
+
+  return true;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinHealthMonitor.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinHealthMonitor.h"
+#include "../include/uskinCanDriver.h"
+
+static const int axis_max_read[3] = {XNODEMAXREAD, YNODEMAXREAD, ZNODEMAXREAD};
+
+//###################### UskinHealthMonitor #########################
+
+UskinHealthMonitor::UskinHealthMonitor(int number_of_nodes) : number_of_nodes(number_of_nodes)
+{
+  nodes = new node_state[number_of_nodes];
+
+  reset();
+}
+
+UskinHealthMonitor::~UskinHealthMonitor()
+{
+  delete[] nodes;
+}
+
+void UskinHealthMonitor::configure(uskin_health_config new_config)
+{
+  if (new_config.smoothing <= 0 || new_config.smoothing > 1)
+    new_config.smoothing = uskin_health_config().smoothing;
+
+  config = new_config;
+}
+
+uskin_health_config UskinHealthMonitor::getConfiguration()
+{
+  return config;
+}
+
+void UskinHealthMonitor::reset()
+{
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    memset(nodes[i].previous, 0, sizeof(nodes[i].previous));
+    memset(nodes[i].delta_mean, 0, sizeof(nodes[i].delta_mean));
+    memset(nodes[i].delta_variance, 0, sizeof(nodes[i].delta_variance));
+    nodes[i].seen = false;
+    nodes[i].health = uskin_node_health();
+  }
+}
+
+unsigned int UskinHealthMonitor::process(_uskin_node_time_unit_reading *frame, const bool *received, long long timestamp_ns)
+{
+  const float alpha = config.smoothing;
+  const long long stuck_ns = config.stuck_time_ms * 1000000LL;
+  unsigned int frame_flags = 0;
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    node_state &node = nodes[i];
+    uskin_node_health &health = node.health;
+
+    if (!received[i])
+    {
+      health.missing_frames++;
+      health.consecutive_missing++;
+    }
+    else
+    {
+      const int value[3] = {frame[i].x_value, frame[i].y_value, frame[i].z_value};
+      bool at_rail = false;
+      bool changed = !node.seen;
+      float largest_variance = 0;
+
+      health.consecutive_missing = 0;
+
+      for (int a = 0; a < 3; a++)
+      {
+        at_rail |= value[a] <= config.rail_margin || value[a] >= axis_max_read[a] - config.rail_margin;
+
+        if (!node.seen)
+          continue;
+
+        // Exponentially weighted mean and variance of the change since the previous frame
+        float delta = value[a] - node.previous[a];
+        float difference = delta - node.delta_mean[a];
+        float increment = alpha * difference;
+
+        node.delta_mean[a] += increment;
+        node.delta_variance[a] = (1 - alpha) * (node.delta_variance[a] + difference * increment);
+
+        if (node.delta_variance[a] > largest_variance)
+          largest_variance = node.delta_variance[a];
+
+        changed |= delta != 0;
+      }
+
+      if (changed)
+        health.last_change_ns = timestamp_ns;
+
+      if (at_rail)
+        health.rail_hits++;
+
+      health.rail_share += alpha * ((at_rail ? 1 : 0) - health.rail_share);
+      health.noise = sqrtf(largest_variance);
+
+      memcpy(node.previous, value, sizeof(value));
+      node.seen = true;
+    }
+
+    unsigned int flags = 0;
+
+    if (health.consecutive_missing >= config.dead_frames)
+      flags |= USKIN_NODE_DEAD;
+    else if (node.seen)
+    {
+      if (stuck_ns > 0 && timestamp_ns - health.last_change_ns >= stuck_ns)
+        flags |= USKIN_NODE_STUCK;
+
+      if (config.noise_threshold > 0 && health.noise > config.noise_threshold)
+        flags |= USKIN_NODE_NOISY;
+
+      if (health.rail_share > config.saturated_ratio)
+        flags |= USKIN_NODE_SATURATED;
+    }
+
+    health.flags = flags;
+    frame[i].health_flags = flags;
+    frame_flags |= flags;
+  }
+
+  return frame_flags;
+}
+
+uskin_node_health UskinHealthMonitor::getNodeHealth(int node)
+{
+  if (node < 0 || node >= number_of_nodes)
+    return uskin_node_health();
+
+  return nodes[node].health;
+}
+
+unsigned int UskinHealthMonitor::getFlags(int node)
+{
+  return getNodeHealth(node).flags;
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinPipeline.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include "../include/uskinPipeline.h"
+
+// Idle workers spin for a short while before sleeping, so hand-off latency stays low at high frame rates
+#define USKIN_PIPELINE_SPIN_COUNT 64
+#define USKIN_PIPELINE_IDLE_SLEEP_US 20
+
+//###################### Stages #########################
+
+UskinFunctionStage::UskinFunctionStage(std::string new_name, std::function<bool(uskin_pipeline_frame *)> new_function) : name(new_name), function(new_function){};
+
+bool UskinFunctionStage::process(uskin_pipeline_frame *frame)
+{
+  return function(frame);
+}
+
+std::string UskinFunctionStage::getName()
+{
+  return name;
+}
+
+UskinNormalizeStage::UskinNormalizeStage(UskinSensor *new_sensor) : sensor(new_sensor){};
+
+bool UskinNormalizeStage::process(uskin_pipeline_frame *frame)
+{
+  frame->normalized = sensor->NormalizeFrame(frame->nodes);
+
+  return true;
+}
+
+std::string UskinNormalizeStage::getName()
+{
+  return "normalize";
+}
+
+UskinCsvRecorderStage::UskinCsvRecorderStage(std::string filename, bool normalized) : record_normalized(normalized)
+{
+  csv_file.open(filename.c_str());
+
+  if (!csv_file.is_open())
+    logError(2, "Could not open " + filename);
+}
+
+UskinCsvRecorderStage::~UskinCsvRecorderStage()
+{
+  if (csv_file.is_open())
+    csv_file.close();
+}
+
+bool UskinCsvRecorderStage::isOpen()
+{
+  return csv_file.is_open();
+}
+
+bool UskinCsvRecorderStage::process(uskin_pipeline_frame *frame)
+{
+  if (!csv_file.is_open() || (record_normalized && !frame->normalized))
+    return true;
+
+  // Header is written with the first frame, once the number of nodes is known
+  if (!header_written)
+  {
+    csv_file << "Timestamp";
+    for (int i = 0; i < frame->number_of_nodes; i++)
+      csv_file << ",CAN ID, X Values,Y Values, Z Values";
+    csv_file << "\n";
+    header_written = true;
+  }
+
+  time_t seconds = frame->timestamp_ns / 1000000000LL;
+  struct tm timeinfo;
+  char time_str[32];
+
+  localtime_r(&seconds, &timeinfo);
+  strftime(time_str, 20, "%F_%T", &timeinfo);
+  snprintf(time_str + strlen(time_str), sizeof(time_str) - strlen(time_str), ".%06lld", frame->timestamp_ns % 1000000000LL / 1000);
+  csv_file << time_str;
+
+  for (int i = 0; i < frame->number_of_nodes; i++)
+  {
+    const _uskin_node_time_unit_reading *node = &frame->nodes[i];
+
+    if (record_normalized)
+      csv_file << "," << std::hex << node->node_id << std::dec << "," << node->x_value_normalized << "," << node->y_value_normalized << "," << node->z_value_normalized;
+    else
+      csv_file << "," << std::hex << node->node_id << std::dec << "," << node->x_value << "," << node->y_value << "," << node->z_value;
+  }
+
+  csv_file << "\n";
+
+  USKIN_PROBE_RECORD_ENQUEUED(frame->sequence, frame->timestamp_ns);
+
+  return true;
+}
+
+std::string UskinCsvRecorderStage::getName()
+{
+  return record_normalized ? "normalized csv recorder" : "csv recorder";
+}
+
+//###################### UskinPipeline #########################
+
+UskinPipeline::UskinPipeline(UskinSensor *new_sensor, int new_pool_size) : sensor(new_sensor), pool_size(new_pool_size > 0 ? new_pool_size : 64), free_frames(pool_size)
+{
+  const int number_of_nodes = sensor->GetUskinFrameSize();
+
+  pool = new uskin_pipeline_frame[pool_size];
+  pool_nodes = new _uskin_node_time_unit_reading[pool_size * number_of_nodes];
+
+  for (int i = 0; i < pool_size; i++)
+  {
+    pool[i].nodes = &pool_nodes[i * number_of_nodes];
+    pool[i].number_of_nodes = number_of_nodes;
+
+    for (int j = 0; j < number_of_nodes; j++)
+      pool[i].nodes[j].clear();
+
+    free_frames.push(&pool[i]);
+  }
+
+  // Source segment
+  segments.push_back(new segment);
+  segments[0]->thread_id = 0;
+
+  running = false;
+  frames_processed = 0;
+  frames_dropped = 0;
+}
+
+UskinPipeline::~UskinPipeline()
+{
+  stop();
+
+  for (segment *current : segments)
+  {
+    for (UskinPipelineStage *stage : current->stages)
+      delete stage;
+
+    delete current->input;
+    delete current;
+  }
+
+  delete[] pool_nodes;
+  delete[] pool;
+}
+
+bool UskinPipeline::addStage(UskinPipelineStage *stage, int thread_id)
+{
+  segment *last = segments.back();
+
+  if (running)
+  {
+    logError(2, "Stages cannot be added to a running pipeline");
+    delete stage;
+    return false;
+  }
+
+  if (thread_id < last->thread_id)
+  {
+    logError(2, "Stage " + stage->getName() + " cannot run on thread " + std::to_string(thread_id) + " after a stage on thread " + std::to_string(last->thread_id));
+    delete stage;
+    return false;
+  }
+
+  if (thread_id != last->thread_id)
+  {
+    last = new segment;
+    last->thread_id = thread_id;
+    last->input = new UskinSpscQueue<uskin_pipeline_frame *>(pool_size);
+    segments.push_back(last);
+  }
+
+  last->stages.push_back(stage);
+
+  return true;
+}
+
+bool UskinPipeline::addStage(std::string name, std::function<bool(uskin_pipeline_frame *)> function, int thread_id)
+{
+  return addStage(new UskinFunctionStage(name, function), thread_id);
+}
+
+void UskinPipeline::setThreadAffinity(int thread_id, int cpu)
+{
+  for (segment *current : segments)
+  {
+    if (current->thread_id == thread_id)
+      current->cpu = cpu;
+  }
+}
+
+void UskinPipeline::pinThread(int segment_index)
+{
+  segment *current = segments[segment_index];
+
+  if (current->cpu < 0)
+    return;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(current->cpu, &cpus);
+
+  if (pthread_setaffinity_np(current->thread.native_handle(), sizeof(cpus), &cpus) != 0)
+    logError(2, "Could not pin pipeline thread " + std::to_string(current->thread_id) + " to CPU " + std::to_string(current->cpu));
+}
+
+bool UskinPipeline::start()
+{
+  logInfo(1, ">> UskinPipeline::start()");
+
+  if (running)
+  {
+    logError(2, "Pipeline is already running");
+    logInfo(1, "<< UskinPipeline::start()");
+    return false;
+  }
+
+  if (!sensor->get_sensor_status() || sensor->get_sensor_acquisition_status())
+  {
+    logError(2, "The sensor must be started, without its acquisition thread, before starting a pipeline");
+    logInfo(1, "<< UskinPipeline::start()");
+    return false;
+  }
+
+  sensor->SetAutomaticRecording(false);
+  running = true;
+
+  for (segment *current : segments)
+    current->finished = false;
+
+  // Consumers first, so no queue is pushed before its worker exists
+  for (int i = segments.size() - 1; i > 0; i--)
+  {
+    segments[i]->thread = std::thread(&UskinPipeline::workerLoop, this, i);
+    pinThread(i);
+  }
+
+  segments[0]->thread = std::thread(&UskinPipeline::sourceLoop, this);
+  pinThread(0);
+
+  logInfo(1, "<< UskinPipeline::start()");
+
+  return true;
+}
+
+// Frames already retrieved are drained through the remaining stages before the workers exit
+void UskinPipeline::stop()
+{
+  if (!running)
+    return;
+
+  logInfo(1, ">> UskinPipeline::stop()");
+
+  running = false;
+
+  // Each worker returns once its upstream segment has finished and its queue is empty
+  for (segment *current : segments)
+  {
+    if (current->thread.joinable())
+      current->thread.join();
+  }
+
+  sensor->SetAutomaticRecording(true);
+
+  logInfo(1, "<< UskinPipeline::stop()");
+}
+
+bool UskinPipeline::isRunning()
+{
+  return running && !segments[0]->finished;
+}
+
+unsigned long long UskinPipeline::getFramesProcessed()
+{
+  return frames_processed;
+}
+
+unsigned long long UskinPipeline::getFramesDropped()
+{
+  return frames_dropped;
+}
+
+void UskinPipeline::runSegment(int segment_index, uskin_pipeline_frame *frame)
+{
+  for (UskinPipelineStage *stage : segments[segment_index]->stages)
+  {
+    if (!frame->discarded && !stage->process(frame))
+      frame->discarded = true;
+  }
+
+  if (segment_index + 1 < (int)segments.size())
+  {
+    segments[segment_index + 1]->input->push(frame); // Never full: queues hold the whole pool
+    return;
+  }
+
+  if (!frame->discarded)
+    frames_processed++;
+
+  free_frames.push(frame);
+}
+
+void UskinPipeline::sourceLoop()
+{
+  int failed_reads = 0;
+
+  while (running)
+  {
+    uskin_pipeline_frame *frame;
+
+    // A read without data leaves the previous frame in place, it is not passed on again
+    if (!sensor->RetrieveFrameData())
+    {
+      if (sensor->IsDriverFinished())
+      {
+        logInfo(2, "The sensor has no more frames, pipeline source stopped");
+        break;
+      }
+
+      // Timeouts and read errors: back off as the sensor's acquisition thread does
+      std::this_thread::sleep_for(std::chrono::milliseconds(std::min(USKIN_ACQUISITION_MAX_BACKOFF_MS, 1 << std::min(failed_reads++, 16))));
+      continue;
+    }
+
+    failed_reads = 0;
+
+    if (!free_frames.pop(frame))
+    {
+      frames_dropped++;
+      continue;
+    }
+
+    sensor->CopyFrame(frame->nodes, &frame->timestamp_ns);
+    frame->sequence = next_sequence++;
+    frame->normalized = false;
+    frame->discarded = false;
+
+    runSegment(0, frame);
+  }
+
+  segments[0]->finished = true;
+}
+
+void UskinPipeline::workerLoop(int segment_index)
+{
+  UskinSpscQueue<uskin_pipeline_frame *> *input = segments[segment_index]->input;
+  std::atomic<bool> &upstream_finished = segments[segment_index - 1]->finished;
+  int idle_spins = 0;
+
+  for (;;)
+  {
+    uskin_pipeline_frame *frame;
+
+    if (input->pop(frame))
+    {
+      runSegment(segment_index, frame);
+      idle_spins = 0;
+      continue;
+    }
+
+    // Everything the upstream segment pushed is visible once its finished flag is
+    if (upstream_finished && input->empty())
+      break;
+
+    if (++idle_spins < USKIN_PIPELINE_SPIN_COUNT)
+      std::this_thread::yield();
+    else
+      usleep(USKIN_PIPELINE_IDLE_SLEEP_US);
+  }
+
+  segments[segment_index]->finished = true;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinReplay.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <stdlib.h>
+#include "../include/uskinReplay.h"
+
+//###################### Utils #########################
+
+// Store a node reading in the payload layout used by the sensor (bytes 2-7: X, Y and Z MSB first)
+static void encodeNodeReading(can_frame *frame, canid_t can_id, unsigned int x, unsigned int y, unsigned int z)
+{
+  memset(frame, 0, sizeof(can_frame));
+
+  frame->can_id = can_id;
+  frame->can_dlc = 8;
+  frame->data[1] = x >> 8;
+  frame->data[2] = x & 0xff;
+  frame->data[3] = y >> 8;
+  frame->data[4] = y & 0xff;
+  frame->data[5] = z >> 8;
+  frame->data[6] = z & 0xff;
+}
+
+//###################### ReplayCanDriver #########################
+
+ReplayCanDriver::ReplayCanDriver(std::string recording, uskin_replay_speed new_speed_mode, double new_speed_factor) : file_name(recording), speed_mode(new_speed_mode), speed_factor(new_speed_factor)
+{
+  if (speed_mode == USKIN_REPLAY_RECORDED_SPEED || speed_factor <= 0)
+    speed_factor = 1.0;
+};
+
+ReplayCanDriver::~ReplayCanDriver()
+{
+  if (replay_file.is_open())
+    replay_file.close();
+
+  delete[] file_buffer;
+};
+
+void ReplayCanDriver::setLoop(bool enable)
+{
+  loop = enable;
+}
+
+bool ReplayCanDriver::isFinished()
+{
+  return end_of_recording;
+}
+
+unsigned long ReplayCanDriver::getFramesReplayed()
+{
+  return frames_replayed;
+}
+
+// Open the recording
+int ReplayCanDriver::openConnection()
+{
+  logInfo(1, ">> ReplayCanDriver::openConnection(" + file_name + ")");
+
+  std::string extension = file_name.size() > 4 ? file_name.substr(file_name.size() - 4) : "";
+
+  if (extension == ".log" || extension == ".asc")
+  {
+    is_capture = true;
+
+    if (!capture.openFile(file_name))
+    {
+      logError(2, "Could not open capture " + file_name);
+      logInfo(1, "<< ReplayCanDriver::openConnection()");
+      return 0;
+    }
+
+    end_of_recording = false;
+
+    logInfo(1, "<< ReplayCanDriver::openConnection()");
+
+    return 1;
+  }
+
+  if (file_buffer == NULL)
+    file_buffer = new char[USKIN_REPLAY_BUFFER_SIZE];
+
+  replay_file.rdbuf()->pubsetbuf(file_buffer, USKIN_REPLAY_BUFFER_SIZE);
+  replay_file.open(file_name.c_str());
+
+  if (!replay_file.is_open())
+  {
+    logError(2, "Could not open recording " + file_name);
+    logInfo(1, "<< ReplayCanDriver::openConnection()");
+    return 0;
+  }
+
+  end_of_recording = false;
+
+  logInfo(1, "<< ReplayCanDriver::openConnection()");
+
+  return 1;
+}
+
+void ReplayCanDriver::closeConnection()
+{
+  if (replay_file.is_open())
+    replay_file.close();
+
+  data_requested = false;
+}
+
+// Start replaying. Pacing restarts from the next frame
+int ReplayCanDriver::requestData()
+{
+  logInfo(1, ">> ReplayCanDriver::requestData()");
+
+  if (!replay_file.is_open() && !is_capture)
+  {
+    logError(2, "Recording has not been opened");
+    return 0;
+  }
+
+  recorded_start_ns = -1;
+  data_requested = true;
+
+  logInfo(1, "<< ReplayCanDriver::requestData()");
+
+  return 1;
+}
+
+void ReplayCanDriver::stopData()
+{
+  logInfo(1, ">> ReplayCanDriver::stopData()");
+
+  data_requested = false;
+
+  logInfo(1, "<< ReplayCanDriver::stopData()");
+}
+
+// Next data line of the recording, rewinding at the end if looping. Returns false at the end of the recording
+bool ReplayCanDriver::readLine()
+{
+  for (;;)
+  {
+    if (std::getline(replay_file, line))
+    {
+      // Skip CSV header and blank lines
+      if (!line.empty() && line[0] >= '0' && line[0] <= '9')
+        return true;
+
+      continue;
+    }
+
+    if (!loop)
+    {
+      end_of_recording = true;
+      return false;
+    }
+
+    replay_file.clear();
+    replay_file.seekg(0);
+    recorded_start_ns = -1;
+  }
+}
+
+// Sleep until the recorded time of a frame (scaled by the replay speed) has been reached
+void ReplayCanDriver::waitUntilDue(long long recorded_ns)
+{
+  if (speed_mode == USKIN_REPLAY_AS_FAST_AS_POSSIBLE)
+    return;
+
+  if (recorded_start_ns < 0)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    recorded_start_ns = recorded_ns;
+    return;
+  }
+
+  long long due_ns = wall_start.tv_sec * 1000000000LL + wall_start.tv_nsec + (long long)((recorded_ns - recorded_start_ns) / speed_factor);
+  struct timespec due;
+
+  due.tv_sec = due_ns / 1000000000LL;
+  due.tv_nsec = due_ns % 1000000000LL;
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+    ;
+}
+
+// Parse a line written by UskinSensor::SaveData: "%F_%T.usec" timestamp followed by (CAN ID (hex), X, Y, Z) per node
+int ReplayCanDriver::parseCSVLine(can_frame **receiving_frame, int frame_size)
+{
+  struct tm timeinfo;
+  const char *cursor;
+  char *end;
+  int retrieved_elements = 0;
+
+  memset(&timeinfo, 0, sizeof(timeinfo));
+  cursor = strptime(line.c_str(), "%Y-%m-%d_%H:%M:%S", &timeinfo);
+
+  if (cursor == NULL)
+  {
+    logError(2, "Invalid timestamp in recording: " + line.substr(0, 32));
+    return 0;
+  }
+
+  timeinfo.tm_isdst = -1; // Timestamps are written in local time
+  last_frame_timestamp.tv_sec = mktime(&timeinfo);
+  last_frame_timestamp.tv_nsec = 0;
+
+  if (*cursor == '.')
+  {
+    last_frame_timestamp.tv_nsec = strtol(cursor + 1, &end, 10) * 1000;
+    cursor = end;
+  }
+
+  while (*cursor == ',' && retrieved_elements < frame_size)
+  {
+    canid_t can_id = strtoul(cursor + 1, &end, 16);
+    unsigned int x = strtoul(end + 1, &end, 10);
+    unsigned int y = strtoul(end + 1, &end, 10);
+    unsigned int z = strtoul(end + 1, &end, 10);
+
+    receiving_frame[retrieved_elements] = new can_frame;
+    encodeNodeReading(receiving_frame[retrieved_elements], can_id, x, y, z);
+    retrieved_elements++;
+
+    cursor = end;
+  }
+
+  return retrieved_elements;
+}
+
+// Group captured CAN messages into a sensor frame, following the same rules as CanDriver::readData
+int ReplayCanDriver::readCaptureFrames(can_frame **receiving_frame, int frame_size, int max_can_ID)
+{
+  int retrieved_elements = 0;
+  can_frame frame;
+  struct timespec timestamp;
+
+  if (temporary_reading_available)
+  {
+    receiving_frame[0] = new can_frame;
+    *receiving_frame[0] = temporary_reading;
+    temporary_reading_available = false;
+    retrieved_elements++;
+  }
+
+  while (retrieved_elements < frame_size)
+  {
+    if (!capture.readFrame(&frame, &timestamp))
+    {
+      // Only rewind captures that contain data, otherwise looping would never end
+      if (!loop || frames_replayed == 0)
+      {
+        end_of_recording = true;
+        break;
+      }
+
+      capture.rewind();
+      recorded_start_ns = -1;
+      continue;
+    }
+
+    // Start / stop requests sent to the sensor are part of the capture
+    if (frame.can_id == device_id)
+      continue;
+
+    last_frame_timestamp = timestamp;
+
+    if (retrieved_elements > 0 && !checkMessagesIdOrder(convert_dec_to_24bit_hex(frame.can_id), convert_dec_to_24bit_hex(receiving_frame[retrieved_elements - 1]->can_id)))
+    {
+      temporary_reading = frame;
+      temporary_reading_available = true;
+      break;
+    }
+
+    receiving_frame[retrieved_elements] = new can_frame;
+    *receiving_frame[retrieved_elements] = frame;
+    retrieved_elements++;
+
+    if ((int)convert_dec_to_24bit_hex(frame.can_id) == max_can_ID)
+      break;
+  }
+
+  return retrieved_elements;
+}
+
+// Deliver the next recorded frame (one line of a CSV recording, or one group of CAN messages of a capture)
+int ReplayCanDriver::readData(can_frame **receiving_frame, int frame_size, int max_can_ID)
+{
+  logInfo(1, ">> ReplayCanDriver::readData()");
+
+  int retrieved_elements;
+
+  if (!data_requested)
+  {
+    logError(2, "You must first request data from the sensor");
+    logInfo(1, "<< ReplayCanDriver::readData()");
+    return 0;
+  }
+
+  if (is_capture)
+  {
+    retrieved_elements = readCaptureFrames(receiving_frame, frame_size, max_can_ID);
+  }
+  else
+  {
+    if (!readLine())
+    {
+      logInfo(2, "End of recording");
+      logInfo(1, "<< ReplayCanDriver::readData()");
+      return 0;
+    }
+
+    retrieved_elements = parseCSVLine(receiving_frame, frame_size);
+  }
+
+  if (retrieved_elements > 0)
+  {
+    waitUntilDue(last_frame_timestamp.tv_sec * 1000000000LL + last_frame_timestamp.tv_nsec);
+    frames_replayed++;
+  }
+
+  logInfo(1, "<< ReplayCanDriver::readData()");
+
+  return retrieved_elements;
+}
@@ -0,0 +1,380 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinSensorGroup.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <algorithm>
+#include "../include/uskinSensorGroup.h"
+#include "../include/uskinCanDriver.h"
+
+// Full CAN transmit queue: wait this long for room before sending the remaining requests
+#define USKIN_GROUP_SEND_RETRY_MS 10
+#define USKIN_GROUP_SEND_RETRIES 10
+
+static long long realtimeNow()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//###################### UskinSensorGroup #########################
+
+UskinSensorGroup::UskinSensorGroup(){};
+
+UskinSensorGroup::~UskinSensorGroup()
+{
+  for (command_socket &current : command_sockets)
+  {
+    if (current.s >= 0)
+      close(current.s);
+  }
+}
+
+int UskinSensorGroup::addSensor(UskinSensor *sensor)
+{
+  if (started)
+  {
+    logError(2, "Sensors cannot be added to a started group");
+    return -1;
+  }
+
+  if (sensor->get_sensor_status())
+  {
+    logError(2, "Sensors must be added to a group before they are started");
+    return -1;
+  }
+
+  sensors.push_back(sensor);
+  reports.push_back(uskin_group_sensor_report());
+
+  return sensors.size() - 1;
+}
+
+int UskinSensorGroup::getNumberOfSensors()
+{
+  return sensors.size();
+}
+
+bool UskinSensorGroup::isStarted()
+{
+  return started;
+}
+
+// Raw CAN socket used only to send requests. It does not loop its frames back to the other sockets of this host, so
+// the sensors' receiving sockets never see the other sensors' requests, and it receives nothing
+int UskinSensorGroup::getCommandSocket(std::string interface_name)
+{
+  for (command_socket &current : command_sockets)
+  {
+    if (current.interface_name == interface_name)
+      return current.s;
+  }
+
+  command_socket current;
+  struct sockaddr_can addr;
+  int loopback = 0;
+
+  current.interface_name = interface_name;
+  current.s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = if_nametoindex(interface_name.c_str());
+
+  if (current.s >= 0 &&
+      (addr.can_ifindex == 0 ||
+       setsockopt(current.s, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) < 0 ||
+       setsockopt(current.s, SOL_CAN_RAW, CAN_RAW_LOOPBACK, &loopback, sizeof(loopback)) < 0 ||
+       bind(current.s, (struct sockaddr *)&addr, sizeof(addr)) < 0))
+  {
+    close(current.s);
+    current.s = -1;
+  }
+
+  if (current.s < 0)
+    logError(2, "Could not open a command socket on " + interface_name + ", its sensors are requested one by one");
+
+  command_sockets.push_back(current);
+
+  return current.s;
+}
+
+int UskinSensorGroup::sendRequests(bool start)
+{
+  std::vector<std::string> interfaces;
+  int requests_sent = 0;
+
+  for (UskinSensor *sensor : sensors)
+  {
+    if (sensor->driver->getSocket() < 0)
+      continue;
+
+    std::string interface_name = sensor->driver->getInterfaceName();
+
+    if (std::find(interfaces.begin(), interfaces.end(), interface_name) == interfaces.end())
+      interfaces.push_back(interface_name);
+  }
+
+  std::vector<bool> request_sent(sensors.size(), false);
+
+  for (std::string &interface_name : interfaces)
+  {
+    int s = getCommandSocket(interface_name);
+
+    if (s < 0)
+      continue;
+
+    std::vector<int> members;
+    std::vector<can_frame> frames;
+
+    for (int i = 0; i < (int)sensors.size(); i++)
+    {
+      if (sensors[i]->driver->getSocket() >= 0 && sensors[i]->driver->getInterfaceName() == interface_name)
+      {
+        members.push_back(i);
+        frames.push_back(sensors[i]->driver->getDataRequestFrame(start));
+      }
+    }
+
+    const int n = members.size();
+    std::vector<struct iovec> buffers(n);
+    std::vector<struct mmsghdr> messages(n);
+
+    for (int j = 0; j < n; j++)
+    {
+      buffers[j].iov_base = &frames[j];
+      buffers[j].iov_len = sizeof(can_frame);
+
+      memset(&messages[j], 0, sizeof(struct mmsghdr));
+      messages[j].msg_hdr.msg_iov = &buffers[j];
+      messages[j].msg_hdr.msg_iovlen = 1;
+    }
+
+    long long request_ns = realtimeNow();
+    int sent = 0;
+    int retries = 0;
+
+    while (sent < n)
+    {
+      int result = sendmmsg(s, &messages[sent], n - sent, 0);
+
+      if (result > 0)
+      {
+        sent += result;
+        continue;
+      }
+
+      if (result < 0 && errno == EINTR)
+        continue;
+
+      if (result < 0 && errno == ENOBUFS && retries++ < USKIN_GROUP_SEND_RETRIES)
+      {
+        struct pollfd room = {s, POLLOUT, 0};
+        poll(&room, 1, USKIN_GROUP_SEND_RETRY_MS);
+        continue;
+      }
+
+      logError(2, "Sent " + std::to_string(sent) + " of " + std::to_string(n) + " requests on " + interface_name);
+      break;
+    }
+
+    for (int j = 0; j < sent; j++)
+    {
+      UskinSensor *sensor = sensors[members[j]];
+
+      sensor->driver->setDataRequested(start);
+      request_sent[members[j]] = true;
+
+      if (start)
+        reports[members[j]].request_ns = request_ns;
+    }
+
+    requests_sent += sent;
+  }
+
+  // Drivers without a CAN socket, or whose interface has no command socket
+  for (int i = 0; i < (int)sensors.size(); i++)
+  {
+    if (request_sent[i])
+      continue;
+
+    if (start)
+    {
+      reports[i].request_ns = realtimeNow();
+
+      if (!sensors[i]->driver->requestData())
+        continue;
+    }
+    else
+    {
+      sensors[i]->driver->stopData();
+    }
+
+    request_sent[i] = true;
+    requests_sent++;
+  }
+
+  if (start)
+  {
+    for (int i = 0; i < (int)sensors.size(); i++)
+      reports[i].started = request_sent[i];
+  }
+
+  return requests_sent;
+}
+
+// Sensors are read one after the other, but each frame carries the kernel receive time of its last message, so the
+// order in which they are read does not bias the first frame times
+void UskinSensorGroup::measureFirstFrames(long timeout_ms)
+{
+  const long long deadline_ns = realtimeNow() + timeout_ms * 1000000LL;
+  long long earliest_ns = 0;
+
+  for (int i = 0; i < (int)sensors.size(); i++)
+  {
+    uskin_group_sensor_report &report = reports[i];
+    int descriptor = sensors[i]->driver->getReceiveDescriptor();
+
+    if (!report.started)
+      continue;
+
+    if (descriptor >= 0)
+    {
+      long long remaining_ns = deadline_ns - realtimeNow();
+      struct pollfd incoming = {descriptor, POLLIN, 0};
+
+      if (remaining_ns <= 0 || poll(&incoming, 1, remaining_ns / 1000000) <= 0)
+      {
+        logError(2, "No frame from sensor " + std::to_string(i) + " within " + std::to_string(timeout_ms) + " ms");
+        continue;
+      }
+    }
+
+    // Reads without data (timeout, error) leave the sensor's previous timestamp in place: the frame is missing
+    if (!sensors[i]->RetrieveFrameData())
+    {
+      logError(2, "No frame data from sensor " + std::to_string(i));
+      continue;
+    }
+
+    report.first_frame = true;
+    report.first_frame_ns = sensors[i]->GetFrameTimestamp();
+    report.latency_ns = report.first_frame_ns - report.request_ns;
+
+    if (earliest_ns == 0 || report.first_frame_ns < earliest_ns)
+      earliest_ns = report.first_frame_ns;
+  }
+
+  for (uskin_group_sensor_report &report : reports)
+  {
+    if (report.first_frame)
+      report.skew_ns = report.first_frame_ns - earliest_ns;
+  }
+}
+
+bool UskinSensorGroup::start(long first_frame_timeout_ms)
+{
+  logInfo(1, ">> UskinSensorGroup::start()");
+
+  if (started || sensors.empty())
+  {
+    logError(2, started ? "Group has already been started" : "Group has no sensors");
+    logInfo(1, "<< UskinSensorGroup::start()");
+    return false;
+  }
+
+  for (int i = 0; i < (int)sensors.size(); i++)
+  {
+    reports[i] = uskin_group_sensor_report();
+
+    if (sensors[i]->get_sensor_status())
+    {
+      logError(2, "Sensor " + std::to_string(i) + " has already been started");
+      logInfo(1, "<< UskinSensorGroup::start()");
+      return false;
+    }
+  }
+
+  // Every connection is ready before the first request goes out
+  for (int i = 0; i < (int)sensors.size(); i++)
+  {
+    if (!sensors[i]->driver->openConnection())
+    {
+      logError(2, "Problems opening the connection of sensor " + std::to_string(i));
+
+      for (int j = 0; j < i; j++)
+        sensors[j]->driver->closeConnection();
+
+      logInfo(1, "<< UskinSensorGroup::start()");
+      return false;
+    }
+  }
+
+  int requests_sent = sendRequests(true);
+
+  for (int i = 0; i < (int)sensors.size(); i++)
+    sensors[i]->sensor_has_started = reports[i].started;
+
+  started = requests_sent > 0;
+
+  if (started)
+    measureFirstFrames(first_frame_timeout_ms);
+
+  logInfo(2, "Started " + std::to_string(requests_sent) + " of " + std::to_string(sensors.size()) + " sensors, start skew " + std::to_string(getStartSkew()) + " ns");
+  logInfo(1, "<< UskinSensorGroup::start()");
+
+  return requests_sent == (int)sensors.size();
+}
+
+void UskinSensorGroup::stop()
+{
+  if (!started)
+    return;
+
+  logInfo(1, ">> UskinSensorGroup::stop()");
+
+  for (UskinSensor *sensor : sensors)
+    sensor->StopAcquisition();
+
+  sendRequests(false);
+
+  for (UskinSensor *sensor : sensors)
+    sensor->sensor_has_started = 0;
+
+  started = false;
+
+  logInfo(1, "<< UskinSensorGroup::stop()");
+}
+
+uskin_group_sensor_report UskinSensorGroup::getSensorReport(int sensor)
+{
+  if (sensor < 0 || sensor >= (int)reports.size())
+    return uskin_group_sensor_report();
+
+  return reports[sensor];
+}
+
+long long UskinSensorGroup::getStartSkew()
+{
+  long long skew_ns = 0;
+
+  for (const uskin_group_sensor_report &report : reports)
+  {
+    if (report.first_frame && report.skew_ns > skew_ns)
+      skew_ns = report.skew_ns;
+  }
+
+  return skew_ns;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinSlipDetection.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinSlipDetection.h"
+#include "../include/uskinCanDriver.h"
+
+//###################### UskinSlipDetector #########################
+
+UskinSlipDetector::UskinSlipDetector(int number_of_nodes) : number_of_nodes(number_of_nodes), padded_nodes(padNodeCount(number_of_nodes))
+{
+  for (int axis = 0; axis < 2; axis++)
+  {
+    input[axis] = allocateNodeArray(padded_nodes);
+    samples[axis] = allocateNodeArray(USKIN_SLIP_MAX_WINDOW * padded_nodes);
+    bin_real[axis] = allocateNodeArray(USKIN_SLIP_MAX_WINDOW * padded_nodes);
+    bin_imag[axis] = allocateNodeArray(USKIN_SLIP_MAX_WINDOW * padded_nodes);
+  }
+
+  squared_derivatives = allocateNodeArray(USKIN_SLIP_MAX_WINDOW * padded_nodes);
+  energy_sum = allocateNodeArray(padded_nodes);
+  derivative_energy = allocateNodeArray(padded_nodes);
+  band_power = allocateNodeArray(padded_nodes);
+
+  slipping = new bool[number_of_nodes];
+
+  configure(config);
+}
+
+UskinSlipDetector::~UskinSlipDetector()
+{
+  for (int axis = 0; axis < 2; axis++)
+  {
+    freeNodeArray(input[axis]);
+    freeNodeArray(samples[axis]);
+    freeNodeArray(bin_real[axis]);
+    freeNodeArray(bin_imag[axis]);
+  }
+
+  freeNodeArray(squared_derivatives);
+  freeNodeArray(energy_sum);
+  freeNodeArray(derivative_energy);
+  freeNodeArray(band_power);
+
+  delete[] slipping;
+}
+
+// Set window and band. Band limits are rounded to the DFT bins of the window, excluding DC
+void UskinSlipDetector::configure(uskin_slip_config new_config)
+{
+  if (new_config.window < 4 || new_config.window > USKIN_SLIP_MAX_WINDOW)
+  {
+    logError(2, "Slip detection window must be between 4 and " + std::to_string(USKIN_SLIP_MAX_WINDOW) + " frames, using 16");
+    new_config.window = 16;
+  }
+
+  config = new_config;
+
+  const int window = config.window;
+  int last_bin;
+
+  first_bin = lroundf(config.band_low_frequency * window / config.sample_frequency);
+  last_bin = lroundf(config.band_high_frequency * window / config.sample_frequency);
+
+  first_bin = first_bin < 1 ? 1 : (first_bin > window / 2 ? window / 2 : first_bin);
+  last_bin = last_bin > window / 2 ? window / 2 : (last_bin < first_bin ? first_bin : last_bin);
+  number_of_bins = last_bin - first_bin + 1;
+
+  for (int m = 0; m < window; m++)
+  {
+    twiddle_cos[m] = cos(2 * M_PI * m / window);
+    twiddle_sin[m] = sin(2 * M_PI * m / window);
+  }
+
+  reset();
+}
+
+uskin_slip_config UskinSlipDetector::getConfiguration()
+{
+  return config;
+}
+
+// Forget the window. State will be seeded again from the next frame
+void UskinSlipDetector::reset()
+{
+  state_initialized = false;
+  position = 0;
+
+  memset(slipping, 0, number_of_nodes * sizeof(bool));
+  memset(derivative_energy, 0, padded_nodes * sizeof(float));
+  memset(band_power, 0, padded_nodes * sizeof(float));
+}
+
+// Fill the window with the current frame: no derivative and no signal in any band
+void UskinSlipDetector::seedState()
+{
+  for (int axis = 0; axis < 2; axis++)
+  {
+    for (int slot = 0; slot < config.window; slot++)
+      memcpy(&samples[axis][slot * padded_nodes], input[axis], padded_nodes * sizeof(float));
+
+    memset(bin_real[axis], 0, number_of_bins * padded_nodes * sizeof(float));
+    memset(bin_imag[axis], 0, number_of_bins * padded_nodes * sizeof(float));
+  }
+
+  memset(squared_derivatives, 0, config.window * padded_nodes * sizeof(float));
+  memset(energy_sum, 0, padded_nodes * sizeof(float));
+
+  position = 0;
+  state_initialized = true;
+}
+
+// Exact DFT bins and energy sum of the window. Called when the window is in chronological order (position == 0)
+void UskinSlipDetector::recomputeState()
+{
+  const int window = config.window;
+
+  for (int axis = 0; axis < 2; axis++)
+  {
+    for (int bin = 0; bin < number_of_bins; bin++)
+    {
+      const int k = first_bin + bin;
+      float *real = &bin_real[axis][bin * padded_nodes];
+      float *imag = &bin_imag[axis][bin * padded_nodes];
+
+      memset(real, 0, padded_nodes * sizeof(float));
+      memset(imag, 0, padded_nodes * sizeof(float));
+
+      for (int n = 0; n < window; n++)
+      {
+        const float c = twiddle_cos[(k * n) % window], s = twiddle_sin[(k * n) % window];
+        const float *x = &samples[axis][n * padded_nodes];
+
+        for (int i = 0; i < padded_nodes; i++)
+        {
+          real[i] += x[i] * c;
+          imag[i] -= x[i] * s;
+        }
+      }
+    }
+  }
+
+  memset(energy_sum, 0, padded_nodes * sizeof(float));
+
+  for (int n = 0; n < window; n++)
+    for (int i = 0; i < padded_nodes; i++)
+      energy_sum[i] += squared_derivatives[n * padded_nodes + i];
+}
+
+int UskinSlipDetector::process(const _uskin_node_time_unit_reading *frame, long long timestamp_ns, uskin_slip_event *events)
+{
+  const int window = config.window;
+  const int lanes = padded_nodes / USKIN_VECTOR_LANES;
+  const int oldest = position;
+  const int newest = (position + window - 1) % window;
+  int number_of_events = 0;
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    input[0][i] = frame[i].x_value;
+    input[1][i] = frame[i].y_value;
+  }
+
+  if (!state_initialized)
+  {
+    seedState();
+    return 0;
+  }
+
+  // Derivative energy: replace the oldest squared derivative of the window with the new one
+  {
+    const uskin_vec4 *x = (const uskin_vec4 *)input[0];
+    const uskin_vec4 *y = (const uskin_vec4 *)input[1];
+    const uskin_vec4 *previous_x = (const uskin_vec4 *)&samples[0][newest * padded_nodes];
+    const uskin_vec4 *previous_y = (const uskin_vec4 *)&samples[1][newest * padded_nodes];
+    uskin_vec4 *squared = (uskin_vec4 *)&squared_derivatives[oldest * padded_nodes];
+    uskin_vec4 *sum = (uskin_vec4 *)energy_sum;
+
+    for (int i = 0; i < lanes; i++)
+    {
+      uskin_vec4 dx = x[i] - previous_x[i], dy = y[i] - previous_y[i];
+      uskin_vec4 value = dx * dx + dy * dy;
+
+      sum[i] += value - squared[i];
+      squared[i] = value;
+    }
+  }
+
+  // Sliding DFT: X_k = (X_k + x_new - x_old) * e^(j 2 pi k / window)
+  for (int axis = 0; axis < 2; axis++)
+  {
+    const uskin_vec4 *x = (const uskin_vec4 *)input[axis];
+    uskin_vec4 *old_x = (uskin_vec4 *)&samples[axis][oldest * padded_nodes];
+
+    for (int bin = 0; bin < number_of_bins; bin++)
+    {
+      const uskin_vec4 c = vec_set(twiddle_cos[first_bin + bin]), s = vec_set(twiddle_sin[first_bin + bin]);
+      uskin_vec4 *real = (uskin_vec4 *)&bin_real[axis][bin * padded_nodes];
+      uskin_vec4 *imag = (uskin_vec4 *)&bin_imag[axis][bin * padded_nodes];
+
+      for (int i = 0; i < lanes; i++)
+      {
+        uskin_vec4 a = real[i] + x[i] - old_x[i];
+        uskin_vec4 b = imag[i];
+
+        real[i] = a * c - b * s;
+        imag[i] = a * s + b * c;
+      }
+    }
+
+    for (int i = 0; i < lanes; i++)
+      old_x[i] = x[i];
+  }
+
+  position = (position + 1) % window;
+
+  if (position == 0)
+    recomputeState();
+
+  // Mean square of a bin's sinusoid is 2 |X_k|^2 / window^2
+  {
+    const uskin_vec4 energy_scale = vec_set(1.0f / window);
+    const uskin_vec4 power_scale = vec_set(2.0f / (window * window));
+    const uskin_vec4 *sum = (const uskin_vec4 *)energy_sum;
+    uskin_vec4 *energy = (uskin_vec4 *)derivative_energy;
+    uskin_vec4 *power = (uskin_vec4 *)band_power;
+
+    for (int i = 0; i < lanes; i++)
+    {
+      uskin_vec4 total = vec_set(0);
+
+      for (int axis = 0; axis < 2; axis++)
+      {
+        for (int bin = 0; bin < number_of_bins; bin++)
+        {
+          uskin_vec4 real = ((const uskin_vec4 *)&bin_real[axis][bin * padded_nodes])[i];
+          uskin_vec4 imag = ((const uskin_vec4 *)&bin_imag[axis][bin * padded_nodes])[i];
+
+          total += real * real + imag * imag;
+        }
+      }
+
+      energy[i] = sum[i] * energy_scale;
+      power[i] = total * power_scale;
+    }
+  }
+
+  for (int i = 0; i < number_of_nodes; i++)
+  {
+    const float energy_threshold = config.derivative_energy_threshold, power_threshold = config.band_power_threshold;
+
+    if (!slipping[i])
+    {
+      if ((energy_threshold > 0 && derivative_energy[i] > energy_threshold) || (power_threshold > 0 && band_power[i] > power_threshold))
+      {
+        slipping[i] = true;
+
+        events[number_of_events].timestamp_ns = timestamp_ns;
+        events[number_of_events].node = i;
+        events[number_of_events].derivative_energy = derivative_energy[i];
+        events[number_of_events].band_power = band_power[i];
+        number_of_events++;
+      }
+    }
+    else if ((energy_threshold <= 0 || derivative_energy[i] < energy_threshold / 2) && (power_threshold <= 0 || band_power[i] < power_threshold / 2))
+    {
+      slipping[i] = false;
+    }
+  }
+
+  return number_of_events;
+}
+
+const float *UskinSlipDetector::getDerivativeEnergy()
+{
+  return derivative_energy;
+}
+
+const float *UskinSlipDetector::getBandPower()
+{
+  return band_power;
+}
+
+bool UskinSlipDetector::isSlipping(int node)
+{
+  return node >= 0 && node < number_of_nodes && slipping[node];
+}
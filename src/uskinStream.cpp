@@ -0,0 +1,669 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinStream.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include <climits>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "../include/uskinStream.h"
+#include "../include/uskinCanDriver.h"
+
+// Longest wait of the server thread for a frame before handling subscription requests anyway
+#define USKIN_STREAM_WAIT_MS 100
+#define USKIN_STREAM_REQUEST_SIZE (USKIN_STREAM_HEADER_SIZE + 6)
+#define USKIN_STREAM_FRAME_HEADER_SIZE 16
+
+//###################### Wire format #########################
+// Explicit little endian, whatever the host
+
+static uint8_t *put16(uint8_t *out, uint16_t value)
+{
+  out[0] = value;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+static uint8_t *put32(uint8_t *out, uint32_t value)
+{
+  put16(out, value);
+  put16(out + 2, value >> 16);
+  return out + 4;
+}
+
+static uint8_t *put64(uint8_t *out, uint64_t value)
+{
+  put32(out, value);
+  put32(out + 4, value >> 32);
+  return out + 8;
+}
+
+static uint16_t get16(const uint8_t *in)
+{
+  return in[0] | in[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *in)
+{
+  return get16(in) | (uint32_t)get16(in + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *in)
+{
+  return get32(in) | (uint64_t)get32(in + 4) << 32;
+}
+
+struct stream_header
+{
+  uint8_t type;
+  uint16_t content;
+  uint16_t nodes;
+  uint16_t frames;
+  uint32_t sequence;
+  uint32_t dropped;
+};
+
+static uint8_t *putHeader(uint8_t *out, const stream_header &header)
+{
+  out = put32(out, USKIN_STREAM_MAGIC);
+  *out++ = USKIN_STREAM_VERSION;
+  *out++ = header.type;
+  out = put16(out, header.content);
+  out = put16(out, header.nodes);
+  out = put16(out, header.frames);
+  out = put32(out, header.sequence);
+  return put32(out, header.dropped);
+}
+
+static bool getHeader(const uint8_t *in, int length, stream_header *header)
+{
+  if (length < USKIN_STREAM_HEADER_SIZE || get32(in) != USKIN_STREAM_MAGIC || in[4] != USKIN_STREAM_VERSION)
+    return false;
+
+  header->type = in[5];
+  header->content = get16(in + 6);
+  header->nodes = get16(in + 8);
+  header->frames = get16(in + 10);
+  header->sequence = get32(in + 12);
+  header->dropped = get32(in + 16);
+
+  return true;
+}
+
+static int frameSize(int nodes, unsigned int content)
+{
+  return USKIN_STREAM_FRAME_HEADER_SIZE + (content & USKIN_STREAM_RAW ? nodes * 3 * 2 : 0) + (content & USKIN_STREAM_NORMALIZED ? nodes * 3 : 0);
+}
+
+//###################### UskinStreamServer #########################
+
+UskinStreamServer::UskinStreamServer(UskinSensor *new_sensor, uskin_stream_config new_config) : sensor(new_sensor), config(new_config), number_of_nodes(new_sensor->GetUskinFrameSize()), running(false), datagrams_sent(0), frames_sent(0)
+{
+  batch_frames = std::max(1, std::min(USHRT_MAX, (USKIN_STREAM_MAX_DATAGRAM - USKIN_STREAM_HEADER_SIZE) / frameSize(number_of_nodes, USKIN_STREAM_RAW | USKIN_STREAM_NORMALIZED)));
+
+  raw_values.resize(batch_frames * number_of_nodes * 3);
+  normalized_values.resize(batch_frames * number_of_nodes * 3);
+  timestamps.resize(batch_frames);
+  selected.resize(batch_frames);
+  datagram.resize(USKIN_STREAM_HEADER_SIZE + batch_frames * frameSize(number_of_nodes, USKIN_STREAM_RAW | USKIN_STREAM_NORMALIZED));
+}
+
+UskinStreamServer::~UskinStreamServer()
+{
+  stop();
+}
+
+bool UskinStreamServer::openSocket()
+{
+  if (config.transport == USKIN_STREAM_UNIX)
+  {
+    struct sockaddr_un address;
+
+    if (config.unix_path.size() >= sizeof(address.sun_path))
+    {
+      logError(2, "Socket path too long: " + config.unix_path);
+      return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, config.unix_path.c_str());
+
+    unlink(config.unix_path.c_str()); // Left by a previous server
+
+    s = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (s >= 0 && bind(s, (struct sockaddr *)&address, sizeof(address)) == 0)
+      return true;
+  }
+  else
+  {
+    struct sockaddr_in address;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(config.udp_port);
+
+    s = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (s >= 0 && bind(s, (struct sockaddr *)&address, sizeof(address)) == 0)
+      return true;
+  }
+
+  logError(2, "Could not open the stream socket");
+
+  if (s >= 0)
+    close(s);
+  s = -1;
+
+  return false;
+}
+
+bool UskinStreamServer::start()
+{
+  logInfo(1, ">> UskinStreamServer::start()");
+
+  if (running)
+  {
+    logInfo(1, "<< UskinStreamServer::start()");
+    return false;
+  }
+
+  if (sensor->GetFrameHistory() == NULL)
+    sensor->EnableFrameHistory(config.history_frames);
+
+  if (!openSocket())
+  {
+    logInfo(1, "<< UskinStreamServer::start()");
+    return false;
+  }
+
+  running = true;
+  server_thread = std::thread(&UskinStreamServer::serverLoop, this);
+
+  logInfo(1, "<< UskinStreamServer::start()");
+
+  return true;
+}
+
+void UskinStreamServer::stop()
+{
+  if (!running && !server_thread.joinable())
+    return;
+
+  logInfo(1, ">> UskinStreamServer::stop()");
+
+  running = false;
+
+  if (server_thread.joinable())
+    server_thread.join();
+
+  if (s >= 0)
+    close(s);
+  s = -1;
+
+  if (config.transport == USKIN_STREAM_UNIX)
+    unlink(config.unix_path.c_str());
+
+  std::lock_guard<std::mutex> lock(subscribers_mutex);
+  subscribers.clear();
+
+  logInfo(1, "<< UskinStreamServer::stop()");
+}
+
+bool UskinStreamServer::isRunning()
+{
+  return running;
+}
+
+// Subscriptions, renewals and cancellations queued on the socket
+void UskinStreamServer::handleRequests(long long now_ns)
+{
+  uint8_t request[USKIN_STREAM_REQUEST_SIZE];
+  struct sockaddr_storage address;
+  socklen_t address_length;
+  int length;
+
+  std::lock_guard<std::mutex> lock(subscribers_mutex);
+
+  while (address_length = sizeof(address), (length = recvfrom(s, request, sizeof(request), MSG_DONTWAIT, (struct sockaddr *)&address, &address_length)) >= 0)
+  {
+    stream_header header;
+
+    if (!getHeader(request, length, &header) || address_length == 0)
+      continue;
+
+    std::vector<subscriber>::iterator current = subscribers.begin();
+
+    while (current != subscribers.end() && !(current->address_length == address_length && memcmp(&current->address, &address, address_length) == 0))
+      ++current;
+
+    if (header.type == USKIN_STREAM_UNSUBSCRIBE)
+    {
+      if (current != subscribers.end())
+        subscribers.erase(current);
+
+      continue;
+    }
+
+    if (header.type != USKIN_STREAM_SUBSCRIBE || length < USKIN_STREAM_REQUEST_SIZE)
+      continue;
+
+    if (current == subscribers.end())
+    {
+      if ((int)subscribers.size() >= config.max_subscribers)
+      {
+        logError(2, "Subscriber limit reached");
+        continue;
+      }
+
+      subscriber added;
+
+      memset(&added, 0, sizeof(added));
+      memcpy(&added.address, &address, address_length);
+      added.address_length = address_length;
+      subscribers.push_back(added);
+      current = subscribers.end() - 1;
+    }
+
+    uint32_t rate_millihertz = get32(request + USKIN_STREAM_HEADER_SIZE);
+    int max_frames = get16(request + USKIN_STREAM_HEADER_SIZE + 4);
+
+    current->content = header.content & (USKIN_STREAM_RAW | USKIN_STREAM_NORMALIZED);
+    current->period_ns = rate_millihertz > 0 ? (long long)(1e12 / rate_millihertz) : 0;
+    current->max_frames = max_frames > 0 && max_frames < batch_frames ? max_frames : batch_frames;
+    current->lease_end_ns = now_ns + USKIN_STREAM_LEASE_MS * 1000000LL;
+  }
+}
+
+void UskinStreamServer::sendDatagram(subscriber &destination, const int *frame_indexes, int n_frames, unsigned long long first_frame_number)
+{
+  const int values = number_of_nodes * 3;
+  stream_header header;
+
+  header.type = USKIN_STREAM_FRAMES;
+  header.content = destination.content;
+  header.nodes = number_of_nodes;
+  header.frames = n_frames;
+  header.sequence = destination.sequence;
+  header.dropped = destination.dropped > UINT_MAX ? UINT_MAX : destination.dropped;
+
+  uint8_t *out = putHeader(datagram.data(), header);
+
+  for (int f = 0; f < n_frames; f++)
+  {
+    const int frame = frame_indexes[f];
+
+    out = put64(out, timestamps[frame]);
+    out = put64(out, first_frame_number + frame);
+
+    if (destination.content & USKIN_STREAM_RAW)
+    {
+      const int *raw = &raw_values[frame * values];
+
+      for (int i = 0; i < values; i++)
+        out = put16(out, std::max(0, std::min(USHRT_MAX, raw[i])));
+    }
+
+    if (destination.content & USKIN_STREAM_NORMALIZED)
+    {
+      const int *normalized = &normalized_values[frame * values];
+
+      for (int i = 0; i < values; i++)
+        *out++ = (uint8_t)(int8_t)std::max(-128, std::min(127, normalized[i]));
+    }
+  }
+
+  if (sendto(s, datagram.data(), out - datagram.data(), MSG_DONTWAIT | MSG_NOSIGNAL, (struct sockaddr *)&destination.address, destination.address_length) < 0)
+  {
+    destination.dropped += n_frames;
+
+    // The subscriber's socket is gone
+    if (errno == ECONNREFUSED || errno == ENOENT)
+      destination.lease_end_ns = 0;
+
+    return;
+  }
+
+  destination.sequence++;
+  destination.dropped = 0;
+  datagrams_sent++;
+  frames_sent += n_frames;
+}
+
+void UskinStreamServer::sendFrames(unsigned long long first_frame_number, int n_frames, unsigned long long dropped_frames)
+{
+  std::lock_guard<std::mutex> lock(subscribers_mutex);
+
+  for (subscriber &destination : subscribers)
+  {
+    int n_selected = 0;
+
+    destination.dropped += dropped_frames;
+
+    for (int frame = 0; frame < n_frames; frame++)
+    {
+      const long long timestamp_ns = timestamps[frame];
+
+      if (destination.period_ns > 0)
+      {
+        // Frame times going back (e.g. a replay looping) restart the schedule
+        if (timestamp_ns < destination.next_due_ns - destination.period_ns)
+          destination.next_due_ns = timestamp_ns;
+
+        if (timestamp_ns < destination.next_due_ns)
+          continue;
+
+        destination.next_due_ns += destination.period_ns;
+
+        if (destination.next_due_ns <= timestamp_ns)
+          destination.next_due_ns = timestamp_ns + destination.period_ns;
+      }
+
+      selected[n_selected++] = frame;
+    }
+
+    for (int sent = 0; sent < n_selected; sent += destination.max_frames)
+      sendDatagram(destination, &selected[sent], std::min(destination.max_frames, n_selected - sent), first_frame_number);
+  }
+}
+
+void UskinStreamServer::serverLoop()
+{
+  unsigned long frame_count = sensor->GetFrameCount();
+  unsigned long long next_frame = 0;
+
+  // Start with the frames retrieved from now on
+  sensor->CopyQueuedFrames(&next_frame, INT_MAX, NULL, NULL, NULL, NULL);
+
+  while (running)
+  {
+    sensor->WaitForFrame(frame_count, USKIN_STREAM_WAIT_MS);
+    frame_count = sensor->GetFrameCount();
+
+    const long long now_ns = monotonicNow();
+    unsigned int content = 0;
+
+    handleRequests(now_ns);
+
+    {
+      std::lock_guard<std::mutex> lock(subscribers_mutex);
+
+      for (std::vector<subscriber>::iterator current = subscribers.begin(); current != subscribers.end();)
+      {
+        if (current->lease_end_ns <= now_ns)
+          current = subscribers.erase(current);
+        else
+          content |= (current++)->content;
+      }
+    }
+
+    if (content == 0) // Nobody to send to, skip the queued frames
+    {
+      sensor->CopyQueuedFrames(&next_frame, INT_MAX, NULL, NULL, NULL, NULL);
+      continue;
+    }
+
+    // One batch per datagram size: a single frame when the server keeps up, more when frames have queued up
+    for (;;)
+    {
+      unsigned long long dropped_frames;
+      int n_frames = sensor->CopyQueuedFrames(&next_frame, batch_frames, raw_values.data(), content & USKIN_STREAM_NORMALIZED ? normalized_values.data() : NULL, timestamps.data(), &dropped_frames);
+
+      if (n_frames == 0)
+        break;
+
+      sendFrames(next_frame - n_frames, n_frames, dropped_frames);
+
+      if (n_frames < batch_frames)
+        break;
+    }
+  }
+}
+
+int UskinStreamServer::getNumberOfSubscribers()
+{
+  std::lock_guard<std::mutex> lock(subscribers_mutex);
+
+  return subscribers.size();
+}
+
+unsigned long long UskinStreamServer::getDatagramsSent()
+{
+  return datagrams_sent;
+}
+
+unsigned long long UskinStreamServer::getFramesSent()
+{
+  return frames_sent;
+}
+
+//###################### UskinStreamClient #########################
+
+UskinStreamClient::UskinStreamClient()
+{
+  datagram.resize(USKIN_STREAM_MAX_DATAGRAM);
+}
+
+UskinStreamClient::~UskinStreamClient()
+{
+  disconnect();
+}
+
+bool UskinStreamClient::connectTo(int family, const struct sockaddr *local, socklen_t local_length, const struct sockaddr *server, socklen_t server_length, uskin_stream_subscription new_subscription)
+{
+  disconnect();
+
+  subscription = new_subscription;
+  sequence_known = false;
+
+  s = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+  // The local address is where the server sends to. Connecting filters out datagrams from anything but the server
+  if (s < 0 || bind(s, local, local_length) < 0 || connect(s, server, server_length) < 0)
+  {
+    logError(2, "Could not connect to the stream server");
+
+    if (s >= 0)
+      close(s);
+    s = -1;
+
+    return false;
+  }
+
+  next_renewal_ns = monotonicNow() + USKIN_STREAM_LEASE_MS * 1000000LL / 3;
+
+  return sendRequest(USKIN_STREAM_SUBSCRIBE);
+}
+
+bool UskinStreamClient::connectUnix(std::string path, uskin_stream_subscription new_subscription)
+{
+  struct sockaddr_un local, server;
+
+  if (path.size() >= sizeof(server.sun_path))
+    return false;
+
+  memset(&local, 0, sizeof(local));
+  local.sun_family = AF_UNIX; // Bound to an address only the family long: the kernel picks a unique abstract name
+
+  memset(&server, 0, sizeof(server));
+  server.sun_family = AF_UNIX;
+  strcpy(server.sun_path, path.c_str());
+
+  return connectTo(AF_UNIX, (struct sockaddr *)&local, sizeof(sa_family_t), (struct sockaddr *)&server, sizeof(server), new_subscription);
+}
+
+bool UskinStreamClient::connectUdp(int port, uskin_stream_subscription new_subscription)
+{
+  struct sockaddr_in local, server;
+
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  server = local;
+  server.sin_port = htons(port);
+
+  return connectTo(AF_INET, (struct sockaddr *)&local, sizeof(local), (struct sockaddr *)&server, sizeof(server), new_subscription);
+}
+
+void UskinStreamClient::disconnect()
+{
+  if (s < 0)
+    return;
+
+  sendRequest(USKIN_STREAM_UNSUBSCRIBE);
+  close(s);
+  s = -1;
+}
+
+bool UskinStreamClient::sendRequest(uskin_stream_message type)
+{
+  uint8_t request[USKIN_STREAM_REQUEST_SIZE];
+  stream_header header;
+
+  memset(&header, 0, sizeof(header));
+  header.type = type;
+  header.content = subscription.content;
+
+  uint8_t *out = putHeader(request, header);
+  out = put32(out, subscription.max_rate_hz > 0 ? (uint32_t)(subscription.max_rate_hz * 1000 + 0.5) : 0);
+  out = put16(out, std::max(0, std::min(USHRT_MAX, subscription.max_frames_per_datagram)));
+
+  return send(s, request, out - request, MSG_DONTWAIT | MSG_NOSIGNAL) == out - request;
+}
+
+int UskinStreamClient::decode(int length)
+{
+  stream_header header;
+  const uint8_t *in = datagram.data();
+
+  if (!getHeader(in, length, &header) || header.type != USKIN_STREAM_FRAMES || length != USKIN_STREAM_HEADER_SIZE + header.frames * frameSize(header.nodes, header.content))
+    return 0;
+
+  if (sequence_known && header.sequence != next_sequence)
+    datagrams_lost += (uint32_t)(header.sequence - next_sequence);
+
+  sequence_known = true;
+  next_sequence = header.sequence + 1;
+  frames_dropped += header.dropped;
+
+  const int values = header.nodes * 3;
+
+  number_of_nodes = header.nodes;
+
+  if ((int)raw_values.size() < header.frames * values)
+  {
+    raw_values.resize(header.frames * values);
+    normalized_values.resize(header.frames * values);
+  }
+
+  if ((int)frames.size() < header.frames)
+    frames.resize(header.frames);
+
+  in += USKIN_STREAM_HEADER_SIZE;
+
+  for (int f = 0; f < header.frames; f++)
+  {
+    uskin_stream_frame &frame = frames[f];
+    int *raw = &raw_values[f * values];
+    int *normalized = &normalized_values[f * values];
+
+    frame.timestamp_ns = get64(in);
+    frame.frame_number = get64(in + 8);
+    frame.raw = header.content & USKIN_STREAM_RAW ? raw : NULL;
+    frame.normalized = header.content & USKIN_STREAM_NORMALIZED ? normalized : NULL;
+    in += USKIN_STREAM_FRAME_HEADER_SIZE;
+
+    if (header.content & USKIN_STREAM_RAW)
+    {
+      for (int i = 0; i < values; i++, in += 2)
+        raw[i] = get16(in);
+    }
+
+    if (header.content & USKIN_STREAM_NORMALIZED)
+    {
+      for (int i = 0; i < values; i++)
+        normalized[i] = (int8_t)*in++;
+    }
+  }
+
+  return header.frames;
+}
+
+int UskinStreamClient::receive(long timeout_ms)
+{
+  if (s < 0)
+    return -1;
+
+  const long long deadline_ns = timeout_ms < 0 ? LLONG_MAX : monotonicNow() + timeout_ms * 1000000LL;
+
+  for (;;)
+  {
+    long long now_ns = monotonicNow();
+
+    if (now_ns >= next_renewal_ns)
+    {
+      sendRequest(USKIN_STREAM_SUBSCRIBE);
+      next_renewal_ns = now_ns + USKIN_STREAM_LEASE_MS * 1000000LL / 3;
+    }
+
+    long long wait_ns = std::min(deadline_ns, next_renewal_ns) - now_ns;
+    struct pollfd incoming = {s, POLLIN, 0};
+
+    if (poll(&incoming, 1, wait_ns > 0 ? (wait_ns + 999999) / 1000000 : 0) > 0)
+    {
+      int length = recv(s, datagram.data(), datagram.size(), MSG_DONTWAIT);
+
+      if (length > 0)
+      {
+        int n_frames = decode(length);
+
+        if (n_frames > 0)
+          return n_frames;
+      }
+      else if (length < 0 && errno != EAGAIN && errno != EINTR && errno != ECONNREFUSED) // Refused: no server yet
+      {
+        return -1;
+      }
+    }
+
+    if (monotonicNow() >= deadline_ns)
+      return 0;
+  }
+}
+
+const uskin_stream_frame *UskinStreamClient::getFrame(int frame)
+{
+  return frame >= 0 && frame < (int)frames.size() ? &frames[frame] : NULL;
+}
+
+int UskinStreamClient::getNumberOfNodes()
+{
+  return number_of_nodes;
+}
+
+unsigned long long UskinStreamClient::getDatagramsLost()
+{
+  return datagrams_lost;
+}
+
+unsigned long long UskinStreamClient::getFramesDropped()
+{
+  return frames_dropped;
+}
+
+int UskinStreamClient::getDescriptor()
+{
+  return s;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright: (C) 2019 CRISP, Advanced Robotics at Queen Mary,
+ *                Queen Mary University of London, London, UK
+ * Author: Rodrigo Neves Zenha <r.neveszenha@qmul.ac.uk>
+ * CopyPolicy: Released under the terms of the GNU GPL v3.0.
+ *
+ */
+/**
+ * \file uskinTactileImage.cpp
+ *
+ * \author Rodrigo Neves Zenha
+ * \copyright  Released under the terms of the GNU GPL v3.0.
+ */
+
+#include "../include/uskinTactileImage.h"
+#include "../include/uskinCanDriver.h"
+
+// Keys cubic convolution kernel, a = -0.5
+static float cubicWeight(float distance)
+{
+  const float a = -0.5;
+
+  distance = fabsf(distance);
+
+  if (distance <= 1)
+    return ((a + 2) * distance - (a + 3)) * distance * distance + 1;
+  if (distance < 2)
+    return ((a * distance - 5 * a) * distance + 8 * a) * distance - 4 * a;
+
+  return 0;
+}
+
+//###################### UskinTactileImage #########################
+
+UskinTactileImage::UskinTactileImage(int number_of_columns, int number_of_rows, int new_output_rows, int new_output_columns, uskin_interpolation new_method) : rows(number_of_rows), columns(number_of_columns), output_rows(new_output_rows), output_columns(new_output_columns), stride(padNodeCount(new_output_columns)), method(new_method)
+{
+  column_weights = allocateNodeArray(columns * stride);
+  row_weights = allocateNodeArray(output_rows * rows);
+  grid = allocateNodeArray(rows * columns);
+  intermediate = allocateNodeArray(rows * stride);
+
+  for (int axis = 0; axis < 3; axis++)
+    image[axis] = allocateNodeArray(output_rows * stride);
+
+  computeWeights(column_weights, columns, output_columns, stride, false);
+  computeWeights(row_weights, rows, output_rows, rows, true);
+}
+
+UskinTactileImage::~UskinTactileImage()
+{
+  freeNodeArray(column_weights);
+  freeNodeArray(row_weights);
+  freeNodeArray(grid);
+  freeNodeArray(intermediate);
+
+  for (int axis = 0; axis < 3; axis++)
+    freeNodeArray(image[axis]);
+}
+
+// Dense resampling matrix from input_size samples to output_size samples. Taps falling outside the input
+// are clamped to the border sample. Stored as weights[output * weights_stride + input] if output_major,
+// weights[input * weights_stride + output] otherwise
+void UskinTactileImage::computeWeights(float *weights, int input_size, int output_size, int weights_stride, bool output_major)
+{
+  const float scale = (float)input_size / output_size;
+
+  for (int output = 0; output < output_size; output++)
+  {
+    float source = (output + 0.5f) * scale - 0.5f;
+    int first = floorf(source);
+    float t = source - first;
+
+    int first_tap = method == USKIN_INTERPOLATION_BICUBIC ? -1 : 0;
+    int last_tap = method == USKIN_INTERPOLATION_BICUBIC ? 2 : 1;
+
+    for (int tap = first_tap; tap <= last_tap; tap++)
+    {
+      int input = first + tap;
+      float weight = method == USKIN_INTERPOLATION_BICUBIC ? cubicWeight(t - tap) : (tap == 0 ? 1 - t : t);
+
+      input = input < 0 ? 0 : (input >= input_size ? input_size - 1 : input);
+
+      if (output_major)
+        weights[output * weights_stride + input] += weight;
+      else
+        weights[input * weights_stride + output] += weight;
+    }
+  }
+}
+
+void UskinTactileImage::render(const _uskin_node_time_unit_reading *frame)
+{
+  const int lanes = stride / USKIN_VECTOR_LANES;
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    for (int column = 0; column < columns; column++)
+    {
+      for (int row = 0; row < rows; row++)
+      {
+        const _uskin_node_time_unit_reading *node = &frame[column * rows + row];
+
+        grid[row * columns + column] = axis == USKIN_AXIS_X ? node->x_value_normalized : (axis == USKIN_AXIS_Y ? node->y_value_normalized : node->z_value_normalized);
+      }
+    }
+
+    // Along the columns: intermediate[row] = sum over node columns of grid[row][column] * column_weights[column]
+    for (int row = 0; row < rows; row++)
+    {
+      uskin_vec4 *out = (uskin_vec4 *)&intermediate[row * stride];
+
+      for (int i = 0; i < lanes; i++)
+        out[i] = vec_set(0);
+
+      for (int column = 0; column < columns; column++)
+      {
+        const uskin_vec4 value = vec_set(grid[row * columns + column]);
+        const uskin_vec4 *weights = (const uskin_vec4 *)&column_weights[column * stride];
+
+        for (int i = 0; i < lanes; i++)
+          out[i] += value * weights[i];
+      }
+    }
+
+    // Along the rows: image[output_row] = sum over node rows of row_weights[output_row][row] * intermediate[row]
+    for (int output_row = 0; output_row < output_rows; output_row++)
+    {
+      uskin_vec4 *out = (uskin_vec4 *)&image[axis][output_row * stride];
+
+      for (int i = 0; i < lanes; i++)
+        out[i] = vec_set(0);
+
+      for (int row = 0; row < rows; row++)
+      {
+        const float weight = row_weights[output_row * rows + row];
+
+        if (weight == 0)
+          continue;
+
+        const uskin_vec4 vector_weight = vec_set(weight);
+        const uskin_vec4 *in = (const uskin_vec4 *)&intermediate[row * stride];
+
+        for (int i = 0; i < lanes; i++)
+          out[i] += vector_weight * in[i];
+      }
+    }
+  }
+}
+
+const float *UskinTactileImage::getImage(int axis)
+{
+  return image[axis];
+}
+
+int UskinTactileImage::getRowStride()
+{
+  return stride;
+}
+
+int UskinTactileImage::getOutputRows()
+{
+  return output_rows;
+}
+
+int UskinTactileImage::getOutputColumns()
+{
+  return output_columns;
+}
+
+uskin_interpolation UskinTactileImage::getInterpolation()
+{
+  return method;
+}